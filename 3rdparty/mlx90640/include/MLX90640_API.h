@@ -16,6 +16,15 @@
  */
 #ifndef _MLX640_API_H_
 #define _MLX640_API_H_
+
+// Sensor geometry: pixels, followed by the auxiliary words in RAM. A frame adds the control register and the subpage.
+#define MLX90640_COLUMNS 32
+#define MLX90640_ROWS 24
+#define MLX90640_PIXELS (MLX90640_COLUMNS * MLX90640_ROWS)
+#define MLX90640_AUX_WORDS 64
+#define MLX90640_RAM_WORDS (MLX90640_PIXELS + MLX90640_AUX_WORDS)
+#define MLX90640_FRAME_WORDS (MLX90640_RAM_WORDS + 2)
+#define MLX90640_EEPROM_WORDS 832
     
   typedef struct
     {
@@ -34,10 +43,10 @@
         float KsTa;
         float ksTo[4];
         int16_t ct[4];
-        float alpha[768];    
-        int16_t offset[768];    
-        float kta[768];    
-        float kv[768];
+        float alpha[MLX90640_PIXELS];    
+        int16_t offset[MLX90640_PIXELS];    
+        float kta[MLX90640_PIXELS];    
+        float kv[MLX90640_PIXELS];
         float cpAlpha[2];
         int16_t cpOffset[2];
         float ilChessC[3]; 
@@ -45,8 +54,38 @@
         uint16_t outlierPixels[5];  
     } paramsMLX90640;
 
+  typedef struct
+    {
+        uint64_t waitStart;   // steady clock [ns] when polling for new data started
+        uint64_t dataReady;   // steady clock [ns] when the data ready bit was seen
+        uint64_t readDone;    // steady clock [ns] when the RAM and control register were read
+    } timingMLX90640;
+
+  typedef struct
+    {
+        uint8_t subPageRows;  // 1: read only the rows of the measured subpage (interleaved mode)
+        uint8_t rowStart;     // first row of the region of interest, 0..23
+        uint8_t rowEnd;       // last row of the region of interest, 0..23
+        uint8_t colStart;     // first column of the region of interest, 0..31
+        uint8_t colEnd;       // last column of the region of interest, 0..31
+    } readoutMLX90640;
+
+  typedef struct
+    {
+        uint8_t stepMode;      // 1: measure a subpage only when started by MLX90640_StartMeasurement
+        uint8_t subPageRepeat; // 1: measure only the selected subpage
+        uint8_t subPage;       // selected subpage, 0 or 1
+        uint8_t refreshRate;   // 0b000..0b111 select 0.5..64 Hz
+        uint8_t chessMode;     // 1: chess reading pattern, 0: interleaved
+    } configMLX90640;
+
     int MLX90640_DumpEE(uint8_t slaveAddr, uint16_t *eeData);
     int MLX90640_GetFrameData(uint8_t slaveAddr, uint16_t *frameData);
+    int MLX90640_GetFrameDataTimed(uint8_t slaveAddr, uint16_t *frameData, timingMLX90640 *timing);
+    int MLX90640_GetFrameDataPartial(uint8_t slaveAddr, uint16_t *frameData, const readoutMLX90640 *readout, timingMLX90640 *timing);
+    int MLX90640_GetTriggeredData(uint8_t slaveAddr, uint16_t *frameData, const readoutMLX90640 *readout, uint8_t subPage, timingMLX90640 *timing);
+    // Maximum time the GetFrameData functions wait for new data before they return -9 (default 5 s).
+    void MLX90640_SetDataReadyTimeout(uint32_t timeoutMicros);
     int MLX90640_ExtractParameters(uint16_t *eeData, paramsMLX90640 *mlx90640);
     float MLX90640_GetVdd(uint16_t *frameData, const paramsMLX90640 *params);
     float MLX90640_GetTa(uint16_t *frameData, const paramsMLX90640 *params);
@@ -65,6 +104,8 @@
     int MLX90640_SetDeviceMode(uint8_t slaveAddr, uint8_t deviceMode);
     int MLX90640_SetSubPageRepeat(uint8_t slaveAddr, uint8_t subPageRepeat);
     int MLX90640_SetSubPage(uint8_t slaveAddr, uint8_t subPage);
+    uint16_t MLX90640_ComposeControlRegister(uint16_t controlRegister, const configMLX90640 *config);
+    int MLX90640_SetControlRegister(uint8_t slaveAddr, uint16_t controlRegister);
     int MLX90640_CheckInterrupt(uint8_t slaveAddr);
     void MLX90640_StartMeasurement(uint8_t slaveAddr, uint8_t subPage);
     int MLX90640_GetData(uint8_t slaveAddr, uint16_t *frameData);
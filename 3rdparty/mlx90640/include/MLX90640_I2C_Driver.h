@@ -20,6 +20,9 @@
 #include <stdint.h>
 
     void MLX90640_I2CInit(void);
+    void MLX90640_I2CSetBus(int bus);
+    // Releases the device of the current bus after an error. It is opened again by the next transfer.
+    void MLX90640_I2CReset(void);
     int MLX90640_I2CRead(uint8_t slaveAddr,uint16_t startAddress, uint16_t nMemAddressRead, uint16_t *data);
     int MLX90640_I2CWrite(uint8_t slaveAddr,uint16_t writeAddress, uint16_t data);
     void MLX90640_I2CFreqSet(int freq);
@@ -38,6 +38,8 @@ int CheckAdjacentPixels(uint16_t pix1, uint16_t pix2);
 int CheckEEPROMValid(uint16_t *eeData);  
 float GetMedian(float *values, int n);
 int IsPixelBad(uint16_t pixel,paramsMLX90640 *params);
+uint64_t SteadyClockNanos(void);
+int ReadFrameRAM(uint8_t slaveAddr, uint16_t *frameData, const readoutMLX90640 *readout, uint16_t subPage);
 
   
 int MLX90640_DumpEE(uint8_t slaveAddr, uint16_t *eeData)
@@ -48,7 +50,11 @@ int MLX90640_DumpEE(uint8_t slaveAddr, uint16_t *eeData)
 int MLX90640_CheckInterrupt(uint8_t slaveAddr)
 {
     uint16_t statusRegister;
-    MLX90640_I2CRead(slaveAddr, 0x8000, 1, &statusRegister);
+    int error = MLX90640_I2CRead(slaveAddr, 0x8000, 1, &statusRegister);
+    if(error != 0)
+    {
+        return error;
+    }
     return (statusRegister & 0b1000) > 0;
 }
 
@@ -119,7 +125,24 @@ int MLX90640_InterpolateOutliers(uint16_t *frameData, uint16_t *eepromData)
     return 0;
 }
 
+static uint64_t dataReadyTimeoutNanos = 5000000000ull;
+
+void MLX90640_SetDataReadyTimeout(uint32_t timeoutMicros)
+{
+    dataReadyTimeoutNanos = timeoutMicros * 1000ull;
+}
+
 int MLX90640_GetFrameData(uint8_t slaveAddr, uint16_t *frameData)
+{
+    return MLX90640_GetFrameDataTimed(slaveAddr, frameData, NULL);
+}
+
+int MLX90640_GetFrameDataTimed(uint8_t slaveAddr, uint16_t *frameData, timingMLX90640 *timing)
+{
+    return MLX90640_GetFrameDataPartial(slaveAddr, frameData, NULL, timing);
+}
+
+int MLX90640_GetFrameDataPartial(uint8_t slaveAddr, uint16_t *frameData, const readoutMLX90640 *readout, timingMLX90640 *timing)
 {
     uint16_t dataReady = 1;
     uint16_t controlRegister1;
@@ -127,7 +150,13 @@ int MLX90640_GetFrameData(uint8_t slaveAddr, uint16_t *frameData)
     int error = 1;
     uint8_t cnt = 0;
 
-    auto t_start = std::chrono::system_clock::now();
+    uint64_t t_start = SteadyClockNanos();
+    if(timing != NULL)
+    {
+        timing->waitStart = t_start;
+        timing->dataReady = timing->waitStart;
+        timing->readDone = timing->waitStart;
+    }
     dataReady = 0;
     while(dataReady == 0)
     {
@@ -138,13 +167,15 @@ int MLX90640_GetFrameData(uint8_t slaveAddr, uint16_t *frameData)
         }    
         dataReady = statusRegister & 0x0008;
 
-	auto t_end = std::chrono::system_clock::now();
-	auto t_elapsed = std::chrono::duration_cast<std::chrono::seconds>(t_end - t_start);
-	if (t_elapsed.count() > 5) {
+	if (SteadyClockNanos() - t_start > dataReadyTimeoutNanos) {
 		printf("frameData timeout error waiting for dataReady \n");
-		return -1;
+		return -9;
 	}
     } 
+    if(timing != NULL)
+    {
+        timing->dataReady = SteadyClockNanos();
+    }
 
     while(dataReady != 0 && cnt < 5)
     {
@@ -154,7 +185,7 @@ int MLX90640_GetFrameData(uint8_t slaveAddr, uint16_t *frameData)
             return error;
         }
 
-        error = MLX90640_I2CRead(slaveAddr, 0x0400, 832, frameData); 
+        error = ReadFrameRAM(slaveAddr, frameData, readout, statusRegister & 0x0001);
         if(error != 0)
         {
             printf("frameData read error \n");
@@ -177,15 +208,62 @@ int MLX90640_GetFrameData(uint8_t slaveAddr, uint16_t *frameData)
     }
     //printf("count: %d \n", cnt); 
     error = MLX90640_I2CRead(slaveAddr, 0x800D, 1, &controlRegister1);
-    frameData[832] = controlRegister1;
-    frameData[833] = statusRegister & 0x0001;
+    frameData[MLX90640_RAM_WORDS] = controlRegister1;
+    frameData[MLX90640_RAM_WORDS + 1] = statusRegister & 0x0001;
+    if(timing != NULL)
+    {
+        timing->readDone = SteadyClockNanos();
+    }
 
     if(error != 0)
     {
         return error;
     }
     
-    return frameData[833];    
+    return frameData[MLX90640_RAM_WORDS + 1];    
+}
+
+int MLX90640_GetTriggeredData(uint8_t slaveAddr, uint16_t *frameData, const readoutMLX90640 *readout, uint8_t subPage, timingMLX90640 *timing)
+{
+    // Step mode: the caller has seen the data ready bit with MLX90640_CheckInterrupt. Unlike
+    // MLX90640_GetFrameDataPartial, this does not write the start bit, so the RAM is read while the sensor is idle and
+    // the next measurement is left to MLX90640_StartMeasurement.
+    uint16_t controlRegister1;
+    uint16_t statusRegister;
+    int error;
+
+    if(timing != NULL)
+    {
+        timing->waitStart = SteadyClockNanos();
+        timing->dataReady = timing->waitStart;
+        timing->readDone = timing->waitStart;
+    }
+    error = ReadFrameRAM(slaveAddr, frameData, readout, subPage);
+    if(error != 0)
+    {
+        printf("frameData read error \n");
+        return error;
+    }
+    error = MLX90640_I2CRead(slaveAddr, 0x8000, 1, &statusRegister);
+    if(error != 0)
+    {
+        return error;
+    }
+    error = MLX90640_I2CRead(slaveAddr, 0x800D, 1, &controlRegister1);
+    frameData[MLX90640_RAM_WORDS] = controlRegister1;
+    // The subpage that was actually measured, so that the caller can check it against the one it started.
+    frameData[MLX90640_RAM_WORDS + 1] = statusRegister & 0x0001;
+    if(timing != NULL)
+    {
+        timing->readDone = SteadyClockNanos();
+    }
+
+    if(error != 0)
+    {
+        return error;
+    }
+    
+    return frameData[MLX90640_RAM_WORDS + 1];
 }
 
 int MLX90640_ExtractParameters(uint16_t *eeData, paramsMLX90640 *mlx90640)
@@ -409,6 +487,30 @@ int MLX90640_SetSubPage(uint8_t slaveAddr, uint8_t subPage)
 
 //------------------------------------------------------------------------------
 
+uint16_t MLX90640_ComposeControlRegister(uint16_t controlRegister, const configMLX90640 *config)
+{
+    uint16_t value;
+    
+    // Keep the subpage mode, data hold and ADC resolution bits, replace all others.
+    value = controlRegister & 0b1110110000000101;
+    value |= (config->stepMode & 0x01) << 1;
+    value |= (config->subPageRepeat & 0x01) << 3;
+    value |= (config->subPage & 0x01) << 4;
+    value |= (config->refreshRate & 0x07) << 7;
+    value |= (config->chessMode & 0x01) << 12;
+    
+    return value;
+}
+
+//------------------------------------------------------------------------------
+
+int MLX90640_SetControlRegister(uint8_t slaveAddr, uint16_t controlRegister)
+{
+    return MLX90640_I2CWrite(slaveAddr, 0x800D, controlRegister);
+}
+
+//------------------------------------------------------------------------------
+
 void MLX90640_CalculateTo(uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float tr, float *result)
 {
     float vdd;
@@ -1478,3 +1580,69 @@ int IsPixelBad(uint16_t pixel,paramsMLX90640 *params)
     
     return 0;     
 }     
+
+//------------------------------------------------------------------------------
+
+int ReadFrameRAM(uint8_t slaveAddr, uint16_t *frameData, const readoutMLX90640 *readout, uint16_t subPage)
+{
+    int error;
+    int rowStart;
+    int rowEnd;
+    int colStart;
+    int colEnd;
+    int rowStep;
+    
+    if(readout == NULL)
+    {
+        return MLX90640_I2CRead(slaveAddr, 0x0400, MLX90640_RAM_WORDS, frameData);
+    }
+    
+    rowStart = readout->rowStart < MLX90640_ROWS ? readout->rowStart : MLX90640_ROWS - 1;
+    rowEnd = readout->rowEnd < MLX90640_ROWS ? readout->rowEnd : MLX90640_ROWS - 1;
+    colStart = readout->colStart < MLX90640_COLUMNS ? readout->colStart : MLX90640_COLUMNS - 1;
+    colEnd = readout->colEnd < MLX90640_COLUMNS ? readout->colEnd : MLX90640_COLUMNS - 1;
+    rowStep = 1;
+    if(readout->subPageRows)
+    {
+        // In interleaved mode a subpage consists of the even (0) or odd (1) rows only.
+        rowStep = 2;
+        if((rowStart & 0x0001) != subPage)
+        {
+            rowStart = rowStart + 1;
+        }
+    }
+    
+    if(rowStart > rowEnd || colStart > colEnd)
+    {
+        // Empty region, only the auxiliary words are read.
+    }
+    else if(rowStep == 1 && colStart == 0 && colEnd == MLX90640_COLUMNS - 1)
+    {
+        error = MLX90640_I2CRead(slaveAddr, 0x0400 + rowStart * MLX90640_COLUMNS, (rowEnd - rowStart + 1) * MLX90640_COLUMNS, frameData + rowStart * MLX90640_COLUMNS);
+        if(error != 0)
+        {
+            return error;
+        }
+    }
+    else
+    {
+        for(int row = rowStart; row <= rowEnd; row = row + rowStep)
+        {
+            error = MLX90640_I2CRead(slaveAddr, 0x0400 + row * MLX90640_COLUMNS + colStart, colEnd - colStart + 1, frameData + row * MLX90640_COLUMNS + colStart);
+            if(error != 0)
+            {
+                return error;
+            }
+        }
+    }
+    
+    // Ta, Vdd, gain and compensation pixel words
+    return MLX90640_I2CRead(slaveAddr, 0x0400 + MLX90640_PIXELS, MLX90640_AUX_WORDS, frameData + MLX90640_PIXELS);
+}
+
+//------------------------------------------------------------------------------
+
+uint64_t SteadyClockNanos(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
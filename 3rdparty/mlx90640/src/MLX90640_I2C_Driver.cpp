@@ -24,6 +24,16 @@ void MLX90640_I2CInit()
     i2c.stop();
 }
 
+void MLX90640_I2CSetBus(int)
+{
+    // This driver supports a single bus only.
+}
+
+void MLX90640_I2CReset()
+{
+    i2c.stop();
+}
+
 int MLX90640_I2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddressRead, uint16_t *data)
 {
     uint8_t sa;                           
@@ -31,20 +31,53 @@
 
 #include <sys/ioctl.h>
 
-int i2c_fd = 0;
-const char *i2c_device = "/dev/i2c-1";
+// One file descriptor per bus, opened on first use. Every thread selects its bus with MLX90640_I2CSetBus, so that
+// sensors on different buses can be read concurrently. Transfers on one bus must not overlap.
+#define I2C_MAX_BUSES 16
+static int i2c_fds[I2C_MAX_BUSES] = {0};
+static thread_local int i2c_bus = 1;
 
 void MLX90640_I2CInit()
 {
     
 }
 
-int MLX90640_I2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddressRead, uint16_t *data)
+void MLX90640_I2CSetBus(int bus)
+{
+    i2c_bus = bus;
+}
+
+void MLX90640_I2CReset()
+{
+    if(i2c_bus < 0 || i2c_bus >= I2C_MAX_BUSES)
+    {
+        return;
+    }
+    if(i2c_fds[i2c_bus] > 0)
+    {
+        close(i2c_fds[i2c_bus]);
+    }
+    i2c_fds[i2c_bus] = 0;
+}
+
+static int I2CDevice()
 {
-    if(!i2c_fd){
-        i2c_fd = open(i2c_device, O_RDWR);
+    if(i2c_bus < 0 || i2c_bus >= I2C_MAX_BUSES)
+    {
+        return -1;
+    }
+    if(i2c_fds[i2c_bus] <= 0)
+    {
+        char device[16];
+        snprintf(device, sizeof(device), "/dev/i2c-%d", i2c_bus);
+        i2c_fds[i2c_bus] = open(device, O_RDWR);
     }
+    return i2c_fds[i2c_bus];
+}
 
+int MLX90640_I2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddressRead, uint16_t *data)
+{
+    int i2c_fd = I2CDevice();
     int result;
     char cmd[2] = {(char)(startAddress >> 8), (char)(startAddress & 0xFF)};
     char buf[1664];
@@ -89,6 +122,7 @@ void MLX90640_I2CFreqSet(int freq)
 int MLX90640_I2CWrite(uint8_t slaveAddr, uint16_t writeAddress, uint16_t data)
 { 
     char cmd[4] = {(char)(writeAddress >> 8), (char)(writeAddress & 0x00FF), (char)(data >> 8), (char)(data & 0x00FF)};
+    int i2c_fd = I2CDevice();
     int result;
 
     struct i2c_msg i2c_messages[1];
@@ -25,6 +25,19 @@ void MLX90640_I2CInit()
     
 }
 
+void MLX90640_I2CSetBus(int)
+{
+    // This driver supports a single bus only.
+}
+
+void MLX90640_I2CReset()
+{
+    if(init){
+        bcm2835_i2c_end();
+        init = 0;
+    }
+}
+
 int MLX90640_I2CRead(uint8_t slaveAddr, uint16_t startAddress, uint16_t nMemAddressRead, uint16_t *data)
 {
     if(!init){
@@ -57,6 +57,16 @@ void MLX90640_I2CInit()
 {   
     I2CStop();
 }
+
+void MLX90640_I2CSetBus(int)
+{
+    // This driver supports a single bus only.
+}
+
+void MLX90640_I2CReset()
+{
+    I2CStop();
+}
     
 int MLX90640_I2CRead(uint8_t slaveAddr, uint16_t startAddress,uint16_t nMemAddressRead, uint16_t *data)
 {
@@ -0,0 +1,186 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+#include "AllocationCounter.h"
+
+#if defined(__GLIBC__) && !defined(THERMALCAM_DISABLE_ALLOCATION_CHECK)
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void on_unexpected_allocation(size_t size);
+}
+
+namespace {
+
+std::atomic<bool> armed(false);
+std::atomic<uint64_t> allocations(0);
+std::atomic<uint64_t> bytes(0);
+std::atomic<size_t> first_size(0);
+// The executable's own TLS needs no allocation to access, unlike the dynamic model.
+__attribute__((tls_model("initial-exec"))) thread_local bool is_ignored = false;
+
+inline void count(size_t size) {
+    if (!armed.load(std::memory_order_relaxed) || is_ignored) {
+        return;
+    }
+    if (allocations.fetch_add(1, std::memory_order_relaxed) == 0) {
+        first_size.store(size, std::memory_order_relaxed);
+    }
+    bytes.fetch_add(size, std::memory_order_relaxed);
+    on_unexpected_allocation(size);
+}
+
+void *allocate(size_t size) {
+    count(size);
+    return __libc_malloc(size == 0 ? 1 : size);
+}
+
+}
+
+extern "C" {
+
+__attribute__((noinline)) void on_unexpected_allocation(size_t size) {
+    // Keeps the call from being optimized away.
+    asm volatile("" : : "r"(size) : "memory");
+}
+
+void *malloc(size_t size) {
+    count(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    count(n * size);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    count(size);
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    count(size);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    count(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    count(size);
+    void *p = __libc_memalign(alignment, size);
+    if (p == nullptr) {
+        return ENOMEM;
+    }
+    *ptr = p;
+    return 0;
+}
+
+}
+
+void *operator new(size_t size) {
+    void *p = allocate(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+    free(ptr);
+}
+
+bool AllocationCounter::available() {
+    return true;
+}
+
+void AllocationCounter::start() {
+    allocations = 0;
+    bytes = 0;
+    first_size = 0;
+    armed = true;
+}
+
+AllocationCounter::Counts AllocationCounter::stop() {
+    armed = false;
+    return {allocations.load(), bytes.load(), first_size.load()};
+}
+
+void AllocationCounter::ignore_thread() {
+    is_ignored = true;
+}
+
+#else
+
+bool AllocationCounter::available() {
+    return false;
+}
+
+void AllocationCounter::start() {
+}
+
+AllocationCounter::Counts AllocationCounter::stop() {
+    return {0, 0, 0};
+}
+
+void AllocationCounter::ignore_thread() {
+}
+
+#endif
@@ -0,0 +1,47 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_ALLOCATIONCOUNTER_H
+#define THERMALCAM_ALLOCATIONCOUNTER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Counts the heap allocations of the process while armed, to prove that the steady state of the frame pipeline does
+// not allocate. malloc and its relatives and the global operator new are replaced by wrappers that count and forward
+// to glibc, so allocations inside SDL and the C++ library are counted as well. Disarmed, the wrappers cost one relaxed
+// atomic load. To find the caller of an unexpected allocation, break on on_unexpected_allocation in a debugger.
+class AllocationCounter {
+
+public:
+    struct Counts {
+        uint64_t allocations;
+        uint64_t bytes;
+        // Size of the first allocation counted, which usually identifies it.
+        size_t first_size;
+    };
+
+    // False when the counter is compiled out, or not supported by the C library.
+    static bool available();
+
+    static void start();
+
+    static Counts stop();
+
+    // Allocations of the calling thread are not counted, for threads outside the frame pipeline such as the encoder.
+    static void ignore_thread();
+};
+
+#endif //THERMALCAM_ALLOCATIONCOUNTER_H
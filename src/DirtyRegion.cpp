@@ -0,0 +1,89 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include "DirtyRegion.h"
+
+DirtyRegion::DirtyRegion() : keys{}, rects{}, has_key{}, dirty{0, 0, 0, 0}, width(0), height(0), n_presented(0),
+                             n_partial(0), n_skipped(0), redrawn_pixels(0) {
+}
+
+void DirtyRegion::resize(const int w, const int h) {
+    width = w;
+    height = h;
+    invalidate();
+}
+
+void DirtyRegion::update(const Layer layer, const uint64_t key, const SDL_Rect &rect) {
+    if (has_key[layer] && keys[layer] == key && rects[layer].x == rect.x && rects[layer].y == rect.y &&
+        rects[layer].w == rect.w && rects[layer].h == rect.h) {
+        return;
+    }
+    if (has_key[layer]) {
+        add(rects[layer]);
+    }
+    add(rect);
+    keys[layer] = key;
+    rects[layer] = rect;
+    has_key[layer] = true;
+}
+
+uint64_t DirtyRegion::text_key(const char *text) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const char *c = text; *c != '\0'; c++) {
+        hash = (hash ^ static_cast<uint8_t>(*c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+void DirtyRegion::invalidate() {
+    dirty = {0, 0, width, height};
+}
+
+void DirtyRegion::add(const SDL_Rect &rect) {
+    const int x0 = std::max(rect.x, 0);
+    const int y0 = std::max(rect.y, 0);
+    const int x1 = std::min(rect.x + rect.w, width);
+    const int y1 = std::min(rect.y + rect.h, height);
+    if (x1 <= x0 || y1 <= y0) {
+        return;
+    }
+    if (!is_dirty()) {
+        dirty = {x0, y0, x1 - x0, y1 - y0};
+        return;
+    }
+    const int dx1 = std::max(dirty.x + dirty.w, x1);
+    const int dy1 = std::max(dirty.y + dirty.h, y1);
+    dirty.x = std::min(dirty.x, x0);
+    dirty.y = std::min(dirty.y, y0);
+    dirty.w = dx1 - dirty.x;
+    dirty.h = dy1 - dirty.y;
+}
+
+void DirtyRegion::on_present(const bool is_partial) {
+    n_presented++;
+    n_partial += is_partial;
+    redrawn_pixels += is_partial ? static_cast<uint64_t>(dirty.w) * dirty.h : static_cast<uint64_t>(width) * height;
+    dirty = {0, 0, 0, 0};
+}
+
+void DirtyRegion::write(FILE *file) const {
+    const uint64_t frames = n_presented + n_skipped;
+    fprintf(file, "frames presented %llu (partial %llu)  skipped %llu (%.1f %%)  redrawn area %.1f %%\n",
+            static_cast<unsigned long long>(n_presented), static_cast<unsigned long long>(n_partial),
+            static_cast<unsigned long long>(n_skipped), frames > 0 ? 100.0 * n_skipped / frames : 0.0,
+            n_presented > 0 && width > 0 && height > 0 ?
+            100.0 * redrawn_pixels / (static_cast<double>(n_presented) * width * height) : 0.0);
+}
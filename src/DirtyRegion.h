@@ -0,0 +1,88 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_DIRTYREGION_H
+#define THERMALCAM_DIRTYREGION_H
+
+#include <cstdint>
+#include <cstdio>
+#include <SDL2/SDL.h>
+
+// The layers of the screen whose content is tracked between frames.
+enum Layer {
+    LAYER_IMAGE,
+    LAYER_VALUE,
+    LAYER_LABEL,
+    LAYER_SLIDER,
+    LAYER_ANIMATION,
+    LAYER_OVERLAY,
+    N_LAYERS
+};
+
+// Tracks which part of the screen changed since the last present. Every frame each layer reports a key that
+// identifies what it would draw, and the rectangle it covers. A layer whose key changed dirties both the rectangle it
+// covered in the last presented frame and the one it covers now. Without a dirty layer the present is skipped.
+class DirtyRegion {
+
+public:
+    DirtyRegion();
+
+    // Sets the size of the screen and marks all of it dirty.
+    void resize(int width, int height);
+
+    void update(Layer layer, uint64_t key, const SDL_Rect &rect);
+
+    // Key of a layer that shows text: a hash (FNV-1a) of the whole text.
+    static uint64_t text_key(const char *text);
+
+    // Marks the whole screen dirty, e.g. after a change of rotation or aspect ratio.
+    void invalidate();
+
+    bool is_dirty() const { return dirty.w > 0 && dirty.h > 0; }
+
+    bool is_full() const { return dirty.w >= width && dirty.h >= height; }
+
+    // Bounding box of the dirty area, clipped to the screen.
+    const SDL_Rect &rect() const { return dirty; }
+
+    // Called after a present; is_partial when only rect() was redrawn.
+    void on_present(bool is_partial);
+
+    void on_skip() { n_skipped++; }
+
+    uint64_t presented() const { return n_presented; }
+
+    uint64_t skipped() const { return n_skipped; }
+
+    void write(FILE *file) const;
+
+private:
+    void add(const SDL_Rect &rect);
+
+    // Key and rectangle of every layer as last presented.
+    uint64_t keys[N_LAYERS];
+    SDL_Rect rects[N_LAYERS];
+    bool has_key[N_LAYERS];
+    SDL_Rect dirty;
+    int width;
+    int height;
+    uint64_t n_presented;
+    uint64_t n_partial;
+    uint64_t n_skipped;
+    // Sum of the redrawn area, in pixels.
+    uint64_t redrawn_pixels;
+};
+
+#endif //THERMALCAM_DIRTYREGION_H
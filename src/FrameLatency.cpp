@@ -0,0 +1,72 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "FrameLatency.h"
+
+FrameLatency::FrameLatency() : last_frame({0, 0, 0}), last_presented(0), repeated(0), dropped(0),
+                               presents_unchanged(0), not_presented(0) {
+}
+
+void FrameLatency::on_frame(const FrameStamp &stamp, const uint64_t period_nanos) {
+    if (last_frame.sequence != 0) {
+        if (stamp.sub_page == last_frame.sub_page) {
+            repeated++;
+        }
+        // More than one and a half period between data ready means that the sensor overwrote subpages that were
+        // never read.
+        if (period_nanos > 0 && stamp.data_ready > last_frame.data_ready) {
+            const uint64_t interval = stamp.data_ready - last_frame.data_ready;
+            const uint64_t missed = (interval + period_nanos / 2) / period_nanos;
+            if (missed > 1) {
+                dropped += missed - 1;
+            }
+        }
+    }
+    last_frame = stamp;
+}
+
+void FrameLatency::on_present(const FrameStamp &image_stamp, const FrameStamp &value_stamp, const bool shows_value,
+                              const uint64_t present_nanos) {
+    if (image_stamp.sequence == 0) {
+        return;
+    }
+    if (image_stamp.sequence == last_presented) {
+        presents_unchanged++;
+        return;
+    }
+    if (last_presented != 0 && image_stamp.sequence > last_presented + 1) {
+        not_presented += image_stamp.sequence - last_presented - 1;
+    }
+    last_presented = image_stamp.sequence;
+    image[image_stamp.sub_page & 1].record(present_nanos - image_stamp.data_ready);
+    if (shows_value && value_stamp.sequence != 0) {
+        value.record(present_nanos - value_stamp.data_ready);
+    }
+}
+
+void FrameLatency::write(FILE *file) const {
+    fprintf(file, "%-16s %10s %10s %10s %10s\n", "latency", "count", "p50 [ms]", "p99 [ms]", "max [ms]");
+    const char *names[] = {"image subpage 0", "image subpage 1", "value"};
+    const LatencyHistogram *histograms[] = {&image[0], &image[1], &value};
+    for (int i = 0; i < 3; i++) {
+        const LatencyHistogram &h = *histograms[i];
+        fprintf(file, "%-16s %10llu %10.3f %10.3f %10.3f\n", names[i], static_cast<unsigned long long>(h.count()),
+                h.percentile(0.50) * 1e-6, h.percentile(0.99) * 1e-6, h.max() * 1e-6);
+    }
+    fprintf(file, "subpages repeated        %10llu\n", static_cast<unsigned long long>(repeated));
+    fprintf(file, "subpages dropped         %10llu\n", static_cast<unsigned long long>(dropped));
+    fprintf(file, "frames not presented     %10llu\n", static_cast<unsigned long long>(not_presented));
+    fprintf(file, "presents without change  %10llu\n", static_cast<unsigned long long>(presents_unchanged));
+}
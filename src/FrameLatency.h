@@ -0,0 +1,73 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_FRAMELATENCY_H
+#define THERMALCAM_FRAMELATENCY_H
+
+#include <cstdint>
+#include <cstdio>
+#include "PerfStats.h"
+
+// Identifies a raw sensor frame and the moment its data ready bit was seen. The stamp is copied along with the data
+// through conversion, filtering and statistics, so that the display knows how old the data is that it shows.
+struct FrameStamp {
+    uint64_t sequence;
+    uint16_t sub_page;
+    uint64_t data_ready;
+};
+
+
+// Photon-to-glass latency of the displayed image and value, and the continuity of the subpage sequence.
+class FrameLatency {
+
+public:
+    FrameLatency();
+
+    // Called for every acquired subpage, with the expected time between two subpages.
+    void on_frame(const FrameStamp &stamp, uint64_t period_nanos);
+
+    // Called right after the frame showing image and value was presented.
+    void on_present(const FrameStamp &image, const FrameStamp &value, bool shows_value, uint64_t present_nanos);
+
+    const LatencyHistogram &image_latency(int sub_page) const { return image[sub_page & 1]; }
+
+    const LatencyHistogram &value_latency() const { return value; }
+
+    // Same subpage received twice in a row.
+    uint64_t sub_pages_repeated() const { return repeated; }
+
+    // Subpages that the sensor produced, but were never read.
+    uint64_t sub_pages_dropped() const { return dropped; }
+
+    // Presents that showed the same image as the present before.
+    uint64_t presents_repeated() const { return presents_unchanged; }
+
+    // Subpages that were read, but replaced before they were presented.
+    uint64_t frames_not_presented() const { return not_presented; }
+
+    void write(FILE *file) const;
+
+private:
+    LatencyHistogram image[2];
+    LatencyHistogram value;
+    FrameStamp last_frame;
+    uint64_t last_presented;
+    uint64_t repeated;
+    uint64_t dropped;
+    uint64_t presents_unchanged;
+    uint64_t not_presented;
+};
+
+#endif //THERMALCAM_FRAMELATENCY_H
@@ -0,0 +1,175 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_FRAMEPOOL_H
+#define THERMALCAM_FRAMEPOOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+// Fixed set of preallocated frame slots of type T, handed out as reference counted Refs. A producer acquires a free
+// slot, fills it once and publishes the Ref; any number of consumers on any thread can then hold copies of the Ref and
+// read the frame while the producer fills the next slot. The slot returns to the pool when the last Ref is gone.
+//
+// Every slot starts on a cache line, with its reference count on a line of its own, so readers of different frames do
+// not share cache lines. Acquiring and releasing are lock-free and never allocate. The pool has at most 64 slots and
+// must outlive all of its Refs.
+template<typename T>
+class FramePool {
+
+public:
+    class Ref {
+
+    public:
+        Ref() : pool(nullptr), slot(-1) {
+        }
+
+        Ref(const Ref &other) : pool(other.pool), slot(other.slot) {
+            if (pool != nullptr) {
+                pool->header(slot)->refs.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        Ref(Ref &&other) noexcept : pool(other.pool), slot(other.slot) {
+            other.pool = nullptr;
+            other.slot = -1;
+        }
+
+        ~Ref() {
+            reset();
+        }
+
+        Ref &operator=(Ref other) noexcept {
+            std::swap(pool, other.pool);
+            std::swap(slot, other.slot);
+            return *this;
+        }
+
+        void reset() {
+            if (pool != nullptr) {
+                pool->release(slot);
+                pool = nullptr;
+                slot = -1;
+            }
+        }
+
+        T *get() const { return pool != nullptr ? pool->data(slot) : nullptr; }
+
+        T *operator->() const { return get(); }
+
+        T &operator*() const { return *get(); }
+
+        explicit operator bool() const { return pool != nullptr; }
+
+        // Number of Refs to the frame, 0 for an empty Ref.
+        int use_count() const {
+            return pool != nullptr ? pool->header(slot)->refs.load(std::memory_order_relaxed) : 0;
+        }
+
+    private:
+        friend class FramePool;
+
+        Ref(FramePool *owner, int index) : pool(owner), slot(index) {
+        }
+
+        FramePool *pool;
+        int slot;
+    };
+
+    explicit FramePool(int slots) : n_slots(slots > 64 ? 64 : slots), exhausted_count(0) {
+        stride = (sizeof(Header) + sizeof(T) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+        void *block = nullptr;
+        if (posix_memalign(&block, CACHE_LINE, stride * n_slots) != 0) {
+            throw std::bad_alloc();
+        }
+        memory = static_cast<uint8_t *>(block);
+        for (int i = 0; i < n_slots; i++) {
+            new(header(i)) Header();
+            new(data(i)) T();
+        }
+        free_mask = n_slots == 64 ? ~0ull : (1ull << n_slots) - 1;
+    }
+
+    FramePool(const FramePool &) = delete;
+
+    FramePool &operator=(const FramePool &) = delete;
+
+    virtual ~FramePool() {
+        for (int i = 0; i < n_slots; i++) {
+            data(i)->~T();
+            header(i)->~Header();
+        }
+        free(memory);
+    }
+
+    // Returns a free slot with one reference, or an empty Ref when all slots are held.
+    Ref acquire() {
+        uint64_t mask = free_mask.load(std::memory_order_acquire);
+        while (mask != 0) {
+            if (free_mask.compare_exchange_weak(mask, mask & (mask - 1), std::memory_order_acquire)) {
+                const int slot = __builtin_ctzll(mask);
+                header(slot)->refs.store(1, std::memory_order_relaxed);
+                return Ref(this, slot);
+            }
+        }
+        exhausted_count.fetch_add(1, std::memory_order_relaxed);
+        return Ref();
+    }
+
+    int size() const { return n_slots; }
+
+    int available() const { return __builtin_popcountll(free_mask.load(std::memory_order_relaxed)); }
+
+    // Number of acquires that found no free slot.
+    uint64_t exhausted() const { return exhausted_count.load(std::memory_order_relaxed); }
+
+    void write(FILE *file, const char *name) const {
+        fprintf(file, "%s pool  slots %d  free %d  exhausted %llu\n", name, n_slots, available(),
+                static_cast<unsigned long long>(exhausted()));
+    }
+
+private:
+    static const size_t CACHE_LINE = 64;
+
+    struct Header {
+        std::atomic<int> refs;
+        char padding[CACHE_LINE - sizeof(std::atomic<int>)];
+
+        Header() : refs(0), padding() {
+        }
+    };
+
+    Header *header(int slot) const { return reinterpret_cast<Header *>(memory + slot * stride); }
+
+    T *data(int slot) const { return reinterpret_cast<T *>(memory + slot * stride + sizeof(Header)); }
+
+    void release(int slot) {
+        if (header(slot)->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            free_mask.fetch_or(1ull << slot, std::memory_order_release);
+        }
+    }
+
+    int n_slots;
+    size_t stride;
+    uint8_t *memory;
+    std::atomic<uint64_t> free_mask;
+    std::atomic<uint64_t> exhausted_count;
+};
+
+#endif //THERMALCAM_FRAMEPOOL_H
@@ -0,0 +1,73 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <cstring>
+#include "FrameRecording.h"
+
+FrameRecorder::FrameRecorder() : file(nullptr) {
+}
+
+FrameRecorder::~FrameRecorder() {
+    close();
+}
+
+bool FrameRecorder::open(const std::string &path, const uint16_t *eeprom) {
+    close();
+    file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    if (fwrite(RECORDING_MAGIC, 1, 8, file) != 8 ||
+        fwrite(eeprom, sizeof(uint16_t), RECORDING_EEPROM_WORDS, file) != RECORDING_EEPROM_WORDS) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool FrameRecorder::write(const uint16_t *frame) {
+    if (file == nullptr) {
+        return false;
+    }
+    return fwrite(frame, sizeof(uint16_t), RECORDING_FRAME_WORDS, file) == RECORDING_FRAME_WORDS;
+}
+
+void FrameRecorder::close() {
+    if (file != nullptr) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+bool FrameReplay::open(const std::string &path) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    char magic[8];
+    ee.resize(RECORDING_EEPROM_WORDS);
+    frames.clear();
+    if (fread(magic, 1, 8, file) != 8 || memcmp(magic, RECORDING_MAGIC, 8) != 0 ||
+        fread(ee.data(), sizeof(uint16_t), RECORDING_EEPROM_WORDS, file) != RECORDING_EEPROM_WORDS) {
+        fclose(file);
+        return false;
+    }
+    uint16_t buffer[RECORDING_FRAME_WORDS];
+    while (fread(buffer, sizeof(uint16_t), RECORDING_FRAME_WORDS, file) == RECORDING_FRAME_WORDS) {
+        frames.insert(frames.end(), buffer, buffer + RECORDING_FRAME_WORDS);
+    }
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,71 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_FRAMERECORDING_H
+#define THERMALCAM_FRAMERECORDING_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "SensorModel.h"
+
+// Recording file layout (native byte order):
+//   char     magic[8]      "MLXREC01"
+//   uint16_t eeprom[SensorModel::EEPROM_WORDS]   EEPROM dump of the sensor
+//   uint16_t frame[SensorModel::FRAME_WORDS]     raw frame data, repeated until end of file
+#define RECORDING_MAGIC "MLXREC01"
+#define RECORDING_EEPROM_WORDS SensorModel::EEPROM_WORDS
+#define RECORDING_FRAME_WORDS SensorModel::FRAME_WORDS
+
+
+class FrameRecorder {
+
+public:
+    FrameRecorder();
+
+    virtual ~FrameRecorder();
+
+    bool open(const std::string &path, const uint16_t *eeprom);
+
+    bool write(const uint16_t *frame);
+
+    void close();
+
+    bool is_open() const { return file != nullptr; }
+
+private:
+    FILE *file;
+};
+
+
+class FrameReplay {
+
+public:
+    bool open(const std::string &path);
+
+    const uint16_t *eeprom() const { return ee.data(); }
+
+    size_t size() const { return frames.size() / RECORDING_FRAME_WORDS; }
+
+    const uint16_t *frame(size_t i) const { return frames.data() + i * RECORDING_FRAME_WORDS; }
+
+private:
+    std::vector<uint16_t> ee;
+    std::vector<uint16_t> frames;
+};
+
+
+#endif //THERMALCAM_FRAMERECORDING_H
@@ -0,0 +1,79 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <thread>
+#include "FrameScheduler.h"
+
+const char *task_name(const Task task) {
+    switch (task) {
+        case TASK_SENSOR:
+            return "sensor";
+        case TASK_PROCESSING:
+            return "processing";
+        case TASK_DISPLAY:
+            return "display";
+        default:
+            return "unknown";
+    }
+}
+
+FrameScheduler::FrameScheduler() {
+    const clock::time_point now = clock::now();
+    for (int i = 0; i < N_TASKS; i++) {
+        periods[i] = std::chrono::milliseconds(100);
+        deadlines[i] = now;
+        is_pending[i] = true;
+        missed_deadlines[i] = 0;
+        completed[i] = 0;
+    }
+}
+
+void FrameScheduler::set_period(const Task task, const clock::duration period) {
+    // Keep the phase, only the distance to the next deadline changes.
+    deadlines[task] += period - periods[task];
+    periods[task] = period;
+}
+
+void FrameScheduler::wait() const {
+    clock::time_point next = clock::time_point::max();
+    for (int i = 0; i < N_TASKS; i++) {
+        if (is_pending[i] && deadlines[i] < next) {
+            next = deadlines[i];
+        }
+    }
+    if (next != clock::time_point::max()) {
+        std::this_thread::sleep_until(next);
+    }
+}
+
+void FrameScheduler::complete(const Task task) {
+    const clock::time_point now = clock::now();
+    completed[task]++;
+    deadlines[task] += periods[task];
+    if (deadlines[task] <= now) {
+        const auto behind = (now - deadlines[task]) / periods[task] + 1;
+        missed_deadlines[task] += static_cast<uint64_t>(behind);
+        deadlines[task] += behind * periods[task];
+    }
+}
+
+void FrameScheduler::write(FILE *file) const {
+    fprintf(file, "%-16s %10s %10s %12s\n", "task", "runs", "missed", "period [ms]");
+    for (int i = 0; i < N_TASKS; i++) {
+        fprintf(file, "%-16s %10llu %10llu %12.3f\n", task_name(static_cast<Task>(i)),
+                static_cast<unsigned long long>(completed[i]), static_cast<unsigned long long>(missed_deadlines[i]),
+                std::chrono::duration<double, std::milli>(periods[i]).count());
+    }
+}
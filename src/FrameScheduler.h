@@ -0,0 +1,76 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_FRAMESCHEDULER_H
+#define THERMALCAM_FRAMESCHEDULER_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+enum Task {
+    TASK_SENSOR,
+    TASK_PROCESSING,
+    TASK_DISPLAY,
+    N_TASKS
+};
+
+const char *task_name(Task task);
+
+
+// Runs sensor, processing and display at their own cadence on absolute steady clock deadlines. Time spent in a task,
+// including a vsync wait in the display task, is absorbed by the next deadline instead of being added to it, and
+// wall clock changes have no effect. A task that falls behind skips the periods it missed instead of bursting.
+class FrameScheduler {
+
+public:
+    typedef std::chrono::steady_clock clock;
+
+    FrameScheduler();
+
+    void set_period(Task task, clock::duration period);
+
+    clock::duration period(Task task) const { return periods[task]; }
+
+    // Sleeps until the earliest deadline of the pending tasks. Returns immediately when one of them is already due.
+    void wait() const;
+
+    bool due(Task task) const { return clock::now() >= deadlines[task]; }
+
+    // Marks the task as done and moves its deadline one period ahead, counting the periods it fell behind.
+    void complete(Task task);
+
+    // A task without work, e.g. processing while no new frame arrived, keeps its deadline but does not wake up wait().
+    // Otherwise its passed deadline would make the loop spin until the work arrives.
+    void set_pending(Task task, bool pending) { is_pending[task] = pending; }
+
+    // Moves the next deadline of the task to the given time, e.g. to follow the actual sensor clock.
+    void resync(Task task, clock::time_point deadline) { deadlines[task] = deadline; }
+
+    uint64_t missed(Task task) const { return missed_deadlines[task]; }
+
+    uint64_t runs(Task task) const { return completed[task]; }
+
+    void write(FILE *file) const;
+
+private:
+    clock::duration periods[N_TASKS];
+    clock::time_point deadlines[N_TASKS];
+    bool is_pending[N_TASKS];
+    uint64_t missed_deadlines[N_TASKS];
+    uint64_t completed[N_TASKS];
+};
+
+#endif //THERMALCAM_FRAMESCHEDULER_H
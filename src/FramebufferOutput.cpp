@@ -0,0 +1,221 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/fb.h>
+#include <linux/kd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "FramebufferOutput.h"
+
+FramebufferOutput::FramebufferOutput() : fd(-1), console_fd(-1), is_device(false), memory(nullptr), size(0),
+                                         screen_width(0), screen_height(0), bytes_per_pixel(0), line_length(0),
+                                         red_offset(0), red_length(0), green_offset(0), green_length(0),
+                                         blue_offset(0), blue_length(0), n_pages(0), page(0), stale{0, 0, 0, 0},
+                                         n_presents(0), n_flips(0), n_bytes(0) {
+}
+
+FramebufferOutput::~FramebufferOutput() {
+    close();
+}
+
+bool FramebufferOutput::open(const std::string &path, const int width, const int height) {
+    close();
+    struct stat st = {};
+    is_device = stat(path.c_str(), &st) == 0 && S_ISCHR(st.st_mode);
+    fd = ::open(path.c_str(), is_device ? O_RDWR | O_CLOEXEC : O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (is_device) {
+        fb_var_screeninfo var = {};
+        fb_fix_screeninfo fix = {};
+        if (ioctl(fd, FBIOGET_VSCREENINFO, &var) != 0) {
+            close();
+            return false;
+        }
+        // Ask for a second page to flip to. Without it, frames are written to the visible page.
+        if (var.yres_virtual < 2 * var.yres) {
+            var.yres_virtual = 2 * var.yres;
+            var.yoffset = 0;
+            ioctl(fd, FBIOPUT_VSCREENINFO, &var);
+        }
+        if (ioctl(fd, FBIOGET_VSCREENINFO, &var) != 0 || ioctl(fd, FBIOGET_FSCREENINFO, &fix) != 0) {
+            close();
+            return false;
+        }
+        screen_width = static_cast<int>(var.xres);
+        screen_height = static_cast<int>(var.yres);
+        bytes_per_pixel = static_cast<int>(var.bits_per_pixel / 8);
+        line_length = static_cast<int>(fix.line_length);
+        red_offset = static_cast<int>(var.red.offset);
+        red_length = static_cast<int>(var.red.length);
+        green_offset = static_cast<int>(var.green.offset);
+        green_length = static_cast<int>(var.green.length);
+        blue_offset = static_cast<int>(var.blue.offset);
+        blue_length = static_cast<int>(var.blue.length);
+        n_pages = var.yres_virtual >= 2 * var.yres && fix.smem_len >= 2 * fix.line_length * var.yres ? 2 : 1;
+        page = var.yoffset >= var.yres ? 1 : 0;
+        if (bytes_per_pixel < 2 || bytes_per_pixel > 4 || red_length > 8 || green_length > 8 || blue_length > 8) {
+            close();
+            return false;
+        }
+    } else {
+        screen_width = width;
+        screen_height = height;
+        bytes_per_pixel = 4;
+        line_length = width * 4;
+        red_offset = 16;
+        green_offset = 8;
+        blue_offset = 0;
+        red_length = green_length = blue_length = 8;
+        n_pages = 1;
+        page = 0;
+    }
+    size = static_cast<size_t>(line_length) * screen_height * n_pages;
+    if (!is_device && ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        close();
+        return false;
+    }
+    void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        close();
+        return false;
+    }
+    memory = static_cast<uint8_t *>(mapped);
+    // Both pages start out unknown.
+    stale[0] = 0;
+    stale[1] = 0;
+    stale[2] = screen_width;
+    stale[3] = screen_height;
+    if (is_device) {
+        set_console_graphics(true);
+    }
+    return true;
+}
+
+void FramebufferOutput::close() {
+    if (memory != nullptr) {
+        munmap(memory, size);
+        memory = nullptr;
+    }
+    if (fd >= 0) {
+        if (is_device && page != 0) {
+            // Leave the console on the first page.
+            fb_var_screeninfo var = {};
+            if (ioctl(fd, FBIOGET_VSCREENINFO, &var) == 0) {
+                var.yoffset = 0;
+                ioctl(fd, FBIOPAN_DISPLAY, &var);
+            }
+            page = 0;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    set_console_graphics(false);
+}
+
+void FramebufferOutput::present(const uint32_t *pixels, const int pitch) {
+    present(pixels, pitch, 0, 0, screen_width, screen_height);
+}
+
+void FramebufferOutput::present(const uint32_t *pixels, const int pitch, const int x, const int y, const int w,
+                                const int h) {
+    if (memory == nullptr) {
+        return;
+    }
+    n_presents++;
+    const int target = n_pages > 1 ? 1 - page : page;
+    int x0 = std::max(x, 0);
+    int y0 = std::max(y, 0);
+    int x1 = std::min(x + w, screen_width);
+    int y1 = std::min(y + h, screen_height);
+    if (n_pages > 1) {
+        const int region[4] = {x0, y0, x1, y1};
+        if (stale[2] > stale[0] && stale[3] > stale[1]) {
+            x0 = std::min(x0, stale[0]);
+            y0 = std::min(y0, stale[1]);
+            x1 = std::max(x1, stale[2]);
+            y1 = std::max(y1, stale[3]);
+        }
+        std::copy(region, region + 4, stale);
+    }
+    uint8_t *out = memory + static_cast<size_t>(target) * line_length * screen_height;
+    const bool is_native = bytes_per_pixel == 4 && red_offset == 16 && green_offset == 8 && blue_offset == 0 &&
+                           red_length == 8 && green_length == 8 && blue_length == 8;
+    for (int row_y = y0; row_y < y1; row_y++) {
+        const uint32_t *in = reinterpret_cast<const uint32_t *>(reinterpret_cast<const uint8_t *>(pixels) +
+                                                                row_y * pitch);
+        uint8_t *row = out + row_y * line_length;
+        n_bytes += static_cast<uint64_t>(x1 - x0) * bytes_per_pixel;
+        if (is_native) {
+            memcpy(row + 4 * x0, in + x0, static_cast<size_t>(x1 - x0) * 4);
+            continue;
+        }
+        for (int x = x0; x < x1; x++) {
+            const uint32_t p = in[x];
+            const uint32_t value = ((p >> 16u & 0xffu) >> (8 - red_length)) << red_offset |
+                                   ((p >> 8u & 0xffu) >> (8 - green_length)) << green_offset |
+                                   ((p & 0xffu) >> (8 - blue_length)) << blue_offset;
+            if (bytes_per_pixel == 2) {
+                const uint16_t v = static_cast<uint16_t>(value);
+                memcpy(row + 2 * x, &v, 2);
+            } else if (bytes_per_pixel == 3) {
+                row[3 * x] = static_cast<uint8_t>(value);
+                row[3 * x + 1] = static_cast<uint8_t>(value >> 8u);
+                row[3 * x + 2] = static_cast<uint8_t>(value >> 16u);
+            } else {
+                memcpy(row + 4 * x, &value, 4);
+            }
+        }
+    }
+    if (n_pages > 1) {
+        // Pan to the new page, and wait until the display scans it out before the old page is overwritten.
+        fb_var_screeninfo var = {};
+        if (ioctl(fd, FBIOGET_VSCREENINFO, &var) == 0) {
+            var.yoffset = static_cast<uint32_t>(target * screen_height);
+            if (ioctl(fd, FBIOPAN_DISPLAY, &var) == 0) {
+                uint32_t crtc = 0;
+                ioctl(fd, FBIO_WAITFORVSYNC, &crtc);
+                page = target;
+                n_flips++;
+            }
+        }
+    }
+}
+
+void FramebufferOutput::write(FILE *file) const {
+    fprintf(file, "framebuffer %dx%d  %d bpp  %d pages  presents %llu  flips %llu  written %.1f MB\n", screen_width,
+            screen_height, bytes_per_pixel * 8, n_pages, static_cast<unsigned long long>(n_presents),
+            static_cast<unsigned long long>(n_flips), n_bytes * 1e-6);
+}
+
+void FramebufferOutput::set_console_graphics(const bool graphics) {
+    if (graphics && console_fd < 0) {
+        console_fd = ::open("/dev/tty0", O_RDWR | O_CLOEXEC);
+        if (console_fd >= 0 && ioctl(console_fd, KDSETMODE, KD_GRAPHICS) != 0) {
+            ::close(console_fd);
+            console_fd = -1;
+        }
+    } else if (!graphics && console_fd >= 0) {
+        ioctl(console_fd, KDSETMODE, KD_TEXT);
+        ::close(console_fd);
+        console_fd = -1;
+    }
+}
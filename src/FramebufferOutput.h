@@ -0,0 +1,85 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_FRAMEBUFFEROUTPUT_H
+#define THERMALCAM_FRAMEBUFFEROUTPUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Shows composed frames on a Linux framebuffer device (/dev/fb0) without X11. The framebuffer is memory mapped. When
+// the virtual screen holds two pages, every frame is written to the hidden page and then panned in, so a frame is
+// never shown half written. A regular file stands in for the device: it is mapped as a single 32 bpp page, so the
+// last frame can be compared against a reference image.
+class FramebufferOutput {
+
+public:
+    FramebufferOutput();
+
+    virtual ~FramebufferOutput();
+
+    // Opens a framebuffer device, or creates a width x height stand-in when path is a regular file.
+    bool open(const std::string &path, int width, int height);
+
+    void close();
+
+    bool is_open() const { return memory != nullptr; }
+
+    int width() const { return screen_width; }
+
+    int height() const { return screen_height; }
+
+    // Converts the ARGB8888 image (width() x height(), pitch in bytes) to the pixel format of the framebuffer, writes
+    // it to the back page and shows it.
+    void present(const uint32_t *pixels, int pitch);
+
+    // Like present(), but only the w x h rectangle at (x, y) changed since the last present. With two pages the back
+    // page also gets the rectangle of the previous present, which it has not seen yet.
+    void present(const uint32_t *pixels, int pitch, int x, int y, int w, int h);
+
+    void write(FILE *file) const;
+
+private:
+    // Puts the console in graphics mode, so that the cursor and kernel messages do not draw over the image.
+    void set_console_graphics(bool graphics);
+
+    int fd;
+    int console_fd;
+    bool is_device;
+    uint8_t *memory;
+    size_t size;
+    int screen_width;
+    int screen_height;
+    int bytes_per_pixel;
+    // Bytes per line, and the offset and length in bits of the color channels within a pixel.
+    int line_length;
+    int red_offset;
+    int red_length;
+    int green_offset;
+    int green_length;
+    int blue_offset;
+    int blue_length;
+    int n_pages;
+    int page;
+    // Rectangle of the previous present, as x0, y0, x1, y1.
+    int stale[4];
+    uint64_t n_presents;
+    uint64_t n_flips;
+    uint64_t n_bytes;
+};
+
+#endif //THERMALCAM_FRAMEBUFFEROUTPUT_H
@@ -0,0 +1,375 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "constants.h"
+#include "KernelVerifier.h"
+#include "PerfStats.h"
+
+namespace {
+
+// Calibration parameters in the range of a typical MLX90640 (datasheet example values), with per pixel spread.
+void make_synthetic_params(paramsMLX90640 *params, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> spread(-1.0f, 1.0f);
+    params->kVdd = -3168;
+    params->vdd25 = -13056;
+    params->KvPTAT = 0.0022f;
+    params->KtPTAT = 42.0f;
+    params->vPTAT25 = 12273;
+    params->alphaPTAT = 9.0f;
+    params->gainEE = 5580;
+    params->tgc = 1.0f;
+    params->cpKv = 0.375f;
+    params->cpKta = 0.0044f;
+    params->resolutionEE = 2;
+    params->calibrationModeEE = 128;
+    params->KsTa = -0.002f;
+    for (int i = 0; i < 4; i++) {
+        params->ksTo[i] = -0.0002f;
+    }
+    params->ct[0] = -40;
+    params->ct[1] = 0;
+    params->ct[2] = 160;
+    params->ct[3] = 320;
+    for (int i = 0; i < SensorModel::PIXELS; i++) {
+        params->alpha[i] = 1.2e-7f * (1.0f + 0.1f * spread(rng));
+        params->offset[i] = static_cast<int16_t>(-70 + 20 * spread(rng));
+        params->kta[i] = 0.005f * (1.0f + 0.2f * spread(rng));
+        params->kv[i] = 0.4f * (1.0f + 0.2f * spread(rng));
+    }
+    params->cpAlpha[0] = 4.07e-9f;
+    params->cpAlpha[1] = 3.9e-9f;
+    params->cpOffset[0] = -69;
+    params->cpOffset[1] = -65;
+    params->ilChessC[0] = 0.0625f;
+    params->ilChessC[1] = 2.0f;
+    params->ilChessC[2] = 0.625f;
+    for (int i = 0; i < 5; i++) {
+        params->brokenPixels[i] = 0xFFFF;
+        params->outlierPixels[i] = 0xFFFF;
+    }
+}
+
+uint16_t to_word(float value) {
+    value = fmaxf(-32768.0f, fminf(32767.0f, roundf(value)));
+    return static_cast<uint16_t>(static_cast<int16_t>(value));
+}
+
+float from_word(uint16_t word) {
+    return static_cast<int16_t>(word);
+}
+
+// Builds the raw RAM content of one subpage by inverting the Melexis To equations, such that the pixels of the
+// subpage read a temperature ramp from to_min to to_max at ambient temperature ta. The exact temperatures that
+// the raw words represent are written to target.
+void make_synthetic_frame(const paramsMLX90640 *params, float ta, float vdd, float to_min, float to_max, bool chess,
+                          int sub_page, float emissivity, float tr_offset, uint16_t *frame, float *target) {
+    const uint16_t resolution_ram = 2;
+    const uint16_t mode = chess ? 0x80 : 0x00;
+    frame[SensorModel::CONTROL_WORD] = static_cast<uint16_t>((resolution_ram << 10) | (chess ? 0x1000 : 0x0000) |
+                                                             (0b101 << 7) | 0x0001);
+    frame[SensorModel::SUB_PAGE_WORD] = static_cast<uint16_t>(sub_page);
+
+    // Supply voltage and ambient temperature words.
+    frame[SensorModel::AUX_OFFSET + 42] = to_word(params->vdd25 + params->kVdd * (vdd - 3.3f));
+    const float ptat = 1700.0f;
+    const float ptat_art = ((ta - 25.0f) * params->KtPTAT + params->vPTAT25) * (1.0f + params->KvPTAT * (vdd - 3.3f));
+    frame[SensorModel::AUX_OFFSET + 32] = to_word(ptat);
+    frame[SensorModel::AUX_OFFSET] = to_word(ptat * 262144.0f / ptat_art - ptat * params->alphaPTAT);
+    // Continue with the values that the quantized words actually represent.
+    vdd = MLX90640_GetVdd(frame, params);
+    ta = MLX90640_GetTa(frame, params);
+    const float tr = ta - tr_offset;
+
+    const float gain_word = params->gainEE * 0.985f;
+    frame[SensorModel::AUX_OFFSET + 10] = to_word(gain_word);
+    const float gain = params->gainEE / from_word(frame[SensorModel::AUX_OFFSET + 10]);
+    frame[SensorModel::AUX_OFFSET + 8] = to_word(-20.0f);
+    frame[SensorModel::AUX_OFFSET + 40] = to_word(-18.0f);
+    float ir_data_cp[2];
+    ir_data_cp[0] = from_word(frame[SensorModel::AUX_OFFSET + 8]) * gain -
+                    params->cpOffset[0] * (1 + params->cpKta * (ta - 25)) * (1 + params->cpKv * (vdd - 3.3f));
+    float cp_offset_1 = params->cpOffset[1] + (mode == params->calibrationModeEE ? 0.0f : params->ilChessC[0]);
+    ir_data_cp[1] = from_word(frame[SensorModel::AUX_OFFSET + 40]) * gain -
+                    cp_offset_1 * (1 + params->cpKta * (ta - 25)) * (1 + params->cpKv * (vdd - 3.3f));
+
+    const double ta4 = pow(ta + 273.15, 4);
+    const double tr4 = pow(tr + 273.15, 4);
+    const double ta_tr = tr4 - (tr4 - ta4) / emissivity;
+    float alpha_corr_r[4];
+    alpha_corr_r[0] = 1 / (1 + params->ksTo[0] * 40);
+    alpha_corr_r[1] = 1;
+    alpha_corr_r[2] = (1 + params->ksTo[2] * params->ct[2]);
+    alpha_corr_r[3] = alpha_corr_r[2] * (1 + params->ksTo[3] * (params->ct[3] - params->ct[2]));
+
+    for (int pixel = 0; pixel < SensorModel::PIXELS; pixel++) {
+        int il_pattern = pixel / SensorModel::COLUMNS - (pixel / (2 * SensorModel::COLUMNS)) * 2;
+        int chess_pattern = il_pattern ^ (pixel % 2);
+        int conversion_pattern = ((pixel + 2) / 4 - (pixel + 3) / 4 + (pixel + 1) / 4 - pixel / 4) *
+                                 (1 - 2 * il_pattern);
+        int pattern = chess ? chess_pattern : il_pattern;
+        if (pattern != sub_page) {
+            continue;
+        }
+        // Diagonal ramp over the sensor, so that every row and column sees the full range.
+        const int row = pixel / SensorModel::COLUMNS;
+        const int col = pixel % SensorModel::COLUMNS;
+        const float to = to_min + (to_max - to_min) * static_cast<float>(row + col) /
+                                  (SensorModel::ROWS - 1 + SensorModel::COLUMNS - 1);
+        int range = to < params->ct[1] ? 0 : to < params->ct[2] ? 1 : to < params->ct[3] ? 2 : 3;
+        float alpha_compensated = (params->alpha[pixel] - params->tgc * params->cpAlpha[sub_page]) *
+                                  (1 + params->KsTa * (ta - 25));
+        float sensitivity = alpha_compensated * alpha_corr_r[range] * (1 + params->ksTo[range] * (to - params->ct[range]));
+        double ir_data = sensitivity * (pow(to + 273.15, 4) - ta_tr);
+        ir_data += params->tgc * ir_data_cp[sub_page];
+        ir_data *= emissivity;
+        if (mode != params->calibrationModeEE) {
+            ir_data -= params->ilChessC[2] * (2 * il_pattern - 1) - params->ilChessC[1] * conversion_pattern;
+        }
+        ir_data += params->offset[pixel] * (1 + params->kta[pixel] * (ta - 25)) * (1 + params->kv[pixel] * (vdd - 3.3f));
+        frame[pixel] = to_word(static_cast<float>(ir_data / gain));
+        target[pixel] = to;
+    }
+}
+
+}
+
+KernelVerifier::KernelVerifier(const float tolerance) : tolerance(tolerance) {
+    reset(ground_truth, "reference vs synthetic target");
+    reset(reference, "MLX90640_CalculateTo");
+}
+
+void KernelVerifier::add_variant(const std::string &name, CalculateToFn calculate_to) {
+    variants.emplace_back(name, calculate_to);
+    errors.emplace_back();
+    reset(errors.back(), name);
+}
+
+void KernelVerifier::reset(KernelError &error, const std::string &name) {
+    error.name = name;
+    for (int i = 0; i < SensorModel::PIXELS; i++) {
+        error.max_error[i] = 0.0f;
+        error.sum_squared[i] = 0.0;
+    }
+    error.n_frames = 0;
+    error.n_mismatches = 0;
+    for (int chess = 0; chess < 2; chess++) {
+        error.nanos[chess] = 0;
+        error.n_calls[chess] = 0;
+    }
+}
+
+void KernelVerifier::accumulate(KernelError &error, const float *expected, const float *actual, const float limit) {
+    for (int i = 0; i < SensorModel::PIXELS; i++) {
+        float e;
+        if (std::isnan(expected[i]) && std::isnan(actual[i])) {
+            e = 0.0f;
+        } else if (std::isnan(expected[i]) || std::isnan(actual[i])) {
+            e = INFINITY;
+        } else {
+            e = fabsf(expected[i] - actual[i]);
+        }
+        if (e > error.max_error[i]) {
+            error.max_error[i] = e;
+        }
+        error.sum_squared[i] += static_cast<double>(e) * e;
+        if (!(e <= limit)) {
+            error.n_mismatches++;
+        }
+    }
+    error.n_frames++;
+}
+
+void KernelVerifier::run_frame(uint16_t *frame, const paramsMLX90640 *params, const float emissivity,
+                               float *expected, std::vector<std::vector<float>> &results) {
+    const int chess = (frame[SensorModel::CONTROL_WORD] & 0x1000) != 0;
+    const float tr = MLX90640_GetTa(frame, params) - TA_SHIFT;
+    uint64_t start = now_nanos();
+    MLX90640_CalculateTo(frame, params, emissivity, tr, expected);
+    uint64_t end = now_nanos();
+    reference.nanos[chess] += end - start;
+    reference.n_calls[chess]++;
+    for (size_t v = 0; v < variants.size(); v++) {
+        start = now_nanos();
+        variants[v].second(frame, params, emissivity, tr, results[v].data());
+        end = now_nanos();
+        errors[v].nanos[chess] += end - start;
+        errors[v].n_calls[chess]++;
+        accumulate(errors[v], expected, results[v].data(), tolerance);
+    }
+}
+
+void KernelVerifier::verify_synthetic() {
+    const float ambient[] = {-20.0f, 0.0f, 25.0f, 45.0f, 65.0f, 85.0f};
+    const float supply[] = {3.25f, 3.3f, 3.35f};
+    const float spans[][2] = {{-40.0f, 0.0f}, {0.0f, 60.0f}, {60.0f, 160.0f}, {160.0f, 300.0f}};
+    const float emissivities[] = {1.0f, 0.95f};
+    paramsMLX90640 params;
+    make_synthetic_params(&params, 90640);
+
+    uint16_t frame[SensorModel::FRAME_WORDS];
+    float target[SensorModel::PIXELS];
+    float reference[SensorModel::PIXELS];
+    std::vector<std::vector<float>> results(variants.size(), std::vector<float>(SensorModel::PIXELS));
+    int n_case = 0;
+    for (float ta : ambient) {
+        for (auto span : spans) {
+            for (bool chess : {false, true}) {
+                for (float emissivity : emissivities) {
+                    const float vdd = supply[n_case++ % 3];
+                    for (int i = 0; i < SensorModel::PIXELS; i++) {
+                        reference[i] = 0.0f;
+                        target[i] = 0.0f;
+                    }
+                    for (auto &result : results) {
+                        std::fill(result.begin(), result.end(), 0.0f);
+                    }
+                    for (int sub_page = 0; sub_page < 2; sub_page++) {
+                        make_synthetic_frame(&params, ta, vdd, span[0], span[1], chess, sub_page, emissivity,
+                                             TA_SHIFT, frame, target);
+                        run_frame(frame, &params, emissivity, reference, results);
+                    }
+                    accumulate(ground_truth, target, reference, SYNTHETIC_TOLERANCE);
+                }
+            }
+        }
+    }
+    printf("Synthetic: %d frame pairs, Ta %.0f..%.0f degC, To %.0f..%.0f degC, chess and interleaved mode.\n",
+           n_case, ambient[0], ambient[5], spans[0][0], spans[3][1]);
+}
+
+bool KernelVerifier::verify_recording(const FrameReplay &replay) {
+    paramsMLX90640 params;
+    std::vector<uint16_t> ee(replay.eeprom(), replay.eeprom() + SensorModel::EEPROM_WORDS);
+    int error = MLX90640_ExtractParameters(ee.data(), &params);
+    if (error == -7) {
+        fprintf(stderr, "Recording has invalid EEPROM data (%d).\n", error);
+        return false;
+    }
+    uint16_t frame[SensorModel::FRAME_WORDS];
+    float expected[SensorModel::PIXELS] = {};
+    std::vector<std::vector<float>> results(variants.size(), std::vector<float>(SensorModel::PIXELS, 0.0f));
+    // Temporal noise from the differences between successive values of a pixel, which hardly depend on slow changes
+    // of the scene. It shows the noise of the reading pattern the recording was made with.
+    float previous[SensorModel::PIXELS];
+    bool has_previous[SensorModel::PIXELS] = {};
+    double sum_squared = 0.0;
+    size_t n_differences = 0;
+    int chess = 0;
+    for (float emissivity : {1.0f, 0.95f}) {
+        for (size_t i = 0; i < replay.size(); i++) {
+            std::copy(replay.frame(i), replay.frame(i) + SensorModel::FRAME_WORDS, frame);
+            run_frame(frame, &params, emissivity, expected, results);
+            if (emissivity != 1.0f) {
+                continue;
+            }
+            chess = (frame[SensorModel::CONTROL_WORD] & 0x1000) != 0;
+            for (int pixel = 0; pixel < SensorModel::PIXELS; pixel++) {
+                const int il_pattern = (pixel / SensorModel::COLUMNS) & 1;
+                const int pattern = chess ? il_pattern ^ (pixel & 1) : il_pattern;
+                if (pattern != frame[SensorModel::SUB_PAGE_WORD] || std::isnan(expected[pixel])) {
+                    continue;
+                }
+                if (has_previous[pixel]) {
+                    const double d = expected[pixel] - previous[pixel];
+                    sum_squared += d * d;
+                    n_differences++;
+                }
+                previous[pixel] = expected[pixel];
+                has_previous[pixel] = true;
+            }
+        }
+    }
+    printf("Recording: %zu frames, %s pattern, temporal noise %.3f degC rms.\n", replay.size(),
+           chess ? "chess" : "interleaved", n_differences > 0 ? sqrt(sum_squared / n_differences / 2) : 0.0);
+    return true;
+}
+
+bool KernelVerifier::report(const KernelError &error, const float limit) const {
+    if (error.n_frames == 0) {
+        return true;
+    }
+    int worst_max = 0;
+    int worst_rms = 0;
+    double sum_squared = 0.0;
+    int n_failed = 0;
+    for (int i = 0; i < SensorModel::PIXELS; i++) {
+        if (error.max_error[i] > error.max_error[worst_max]) {
+            worst_max = i;
+        }
+        if (error.sum_squared[i] > error.sum_squared[worst_rms]) {
+            worst_rms = i;
+        }
+        sum_squared += error.sum_squared[i];
+        if (!(error.max_error[i] <= limit)) {
+            n_failed++;
+        }
+    }
+    const double rms = sqrt(sum_squared / (static_cast<double>(SensorModel::PIXELS) * error.n_frames));
+    const double worst_pixel_rms = sqrt(error.sum_squared[worst_rms] / error.n_frames);
+    printf("%-40s %s  max %.5f (pixel %d,%d)  rms %.5f  worst pixel rms %.5f (pixel %d,%d)  mismatches %zu\n",
+           error.name.c_str(), n_failed == 0 ? "PASS" : "FAIL", error.max_error[worst_max],
+           worst_max / SensorModel::COLUMNS, worst_max % SensorModel::COLUMNS, rms, worst_pixel_rms,
+           worst_rms / SensorModel::COLUMNS, worst_rms % SensorModel::COLUMNS, error.n_mismatches);
+    if (n_failed > 0) {
+        printf("    %d pixels above tolerance %.5f degC\n", n_failed, limit);
+    }
+    return n_failed == 0;
+}
+
+void KernelVerifier::report_throughput(const KernelError &error) {
+    const char *names[] = {"interleaved", "chess"};
+    printf("%-40s", error.name.c_str());
+    for (int chess = 0; chess < 2; chess++) {
+        if (error.n_calls[chess] > 0) {
+            printf("  %s %.1f us", names[chess], error.nanos[chess] * 1e-3 / error.n_calls[chess]);
+        }
+    }
+    printf("  per subpage\n");
+}
+
+bool KernelVerifier::report() const {
+    bool passed = report(ground_truth, SYNTHETIC_TOLERANCE);
+    for (const auto &error : errors) {
+        passed = report(error, tolerance) && passed;
+    }
+    if (errors.empty()) {
+        printf("No optimized kernels registered, only the reference was checked.\n");
+    }
+    report_throughput(reference);
+    for (const auto &error : errors) {
+        report_throughput(error);
+    }
+    return passed;
+}
+
+int run_kernel_verification(const float tolerance, const std::vector<std::string> &recordings) {
+    KernelVerifier verifier(tolerance);
+    verifier.add_variant("specialized per reading pattern", calculate_to);
+    verifier.verify_synthetic();
+    for (const auto &path : recordings) {
+        FrameReplay replay;
+        if (!replay.open(path) || !verifier.verify_recording(replay)) {
+            fprintf(stderr, "Unable to verify recording %s\n", path.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+    return verifier.report() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,81 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_KERNELVERIFIER_H
+#define THERMALCAM_KERNELVERIFIER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <MLX90640_API.h>
+#include "FrameRecording.h"
+#include "TemperatureKernels.h"
+
+// Per pixel error statistics of one kernel against its reference.
+struct KernelError {
+    std::string name;
+    float max_error[SensorModel::PIXELS];
+    double sum_squared[SensorModel::PIXELS];
+    size_t n_frames;
+    // Values that deviate more than the accepted limit.
+    size_t n_mismatches;
+    // Run time, per reading pattern: interleaved (0) and chess (1).
+    uint64_t nanos[2];
+    size_t n_calls[2];
+};
+
+
+// Runs the untouched Melexis reference and every optimized kernel on the same frames and compares the results.
+class KernelVerifier {
+
+public:
+    explicit KernelVerifier(float tolerance);
+
+    void add_variant(const std::string &name, CalculateToFn calculate_to);
+
+    void verify_synthetic();
+
+    bool verify_recording(const FrameReplay &replay);
+
+    bool report() const;
+
+private:
+    // Accepted deviation of an optimized kernel from the reference.
+    const float tolerance;
+    // Accepted deviation of the reference from the synthetic ground truth.
+    const float SYNTHETIC_TOLERANCE = 0.25f;
+
+    std::vector<std::pair<std::string, CalculateToFn>> variants;
+    std::vector<KernelError> errors;
+    KernelError ground_truth;
+    // Run time of the reference.
+    KernelError reference;
+
+    void run_frame(uint16_t *frame, const paramsMLX90640 *params, float emissivity, float *expected,
+                   std::vector<std::vector<float>> &results);
+
+    static void reset(KernelError &error, const std::string &name);
+
+    static void accumulate(KernelError &error, const float *expected, const float *actual, float limit);
+
+    bool report(const KernelError &error, float limit) const;
+
+    static void report_throughput(const KernelError &error);
+};
+
+// Registers all optimized kernels, runs them on synthetic and recorded frames and returns the process exit code.
+int run_kernel_verification(float tolerance, const std::vector<std::string> &recordings);
+
+#endif //THERMALCAM_KERNELVERIFIER_H
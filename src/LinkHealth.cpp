@@ -0,0 +1,157 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include "LinkHealth.h"
+
+LinkHealth::LinkHealth() : last_sub_page(-1), last_data_ready(0), has_failed(false), retry_time(0),
+                                             backoff(MIN_BACKOFF_NANOS), dropped_in_row(0), failed_since(0),
+                                             failures(0), attempts(0), recovered(0), outage_nanos(0),
+                                             longest_outage_nanos(0) {
+    faults.fill(0);
+}
+
+FrameFault LinkHealth::validate(const uint16_t *frame, const paramsMLX90640 &params,
+                                             const readoutMLX90640 *readout, const uint16_t control_register,
+                                             const int sub_page, const uint64_t data_ready) {
+    // The subpage select bits change in step mode, all other bits must read back as written.
+    if (((frame[SensorModel::CONTROL_WORD] ^ control_register) & 0xFF8F) != 0) {
+        return FRAME_CONTROL_REGISTER;
+    }
+    const int measured = frame[SensorModel::SUB_PAGE_WORD];
+    if (measured > 1 || (sub_page >= 0 && measured != sub_page)) {
+        return FRAME_SUB_PAGE;
+    }
+    if (sub_page < 0) {
+        if ((control_register & 0x0008) != 0) {
+            // Subpage repeat: only the selected subpage is measured.
+            if (measured != ((control_register >> 4) & 1)) {
+                return FRAME_SUB_PAGE;
+            }
+        } else {
+            // Refresh rate code c is 2^(c - 1) subpages per second. After a longer gap a subpage may have been
+            // missed, and the same one may come again.
+            const uint64_t period = 2000000000ull >> ((control_register >> 7) & 0x7);
+            if (measured == last_sub_page && data_ready - last_data_ready < period + period / 2) {
+                return FRAME_SUB_PAGE;
+            }
+        }
+    }
+    int row_start = 0;
+    int row_end = SensorModel::ROWS - 1;
+    int row_step = 1;
+    int col_start = 0;
+    int col_end = SensorModel::COLUMNS - 1;
+    if (readout != nullptr) {
+        row_start = readout->rowStart;
+        row_end = std::min<int>(readout->rowEnd, SensorModel::ROWS - 1);
+        col_start = readout->colStart;
+        col_end = std::min<int>(readout->colEnd, SensorModel::COLUMNS - 1);
+        if (readout->subPageRows) {
+            row_step = 2;
+            row_start += (row_start ^ frame[SensorModel::SUB_PAGE_WORD]) & 1;
+        }
+    }
+    // The inner loop is branch free, so that the compiler vectorizes it. Noise makes a real frame hit these two
+    // values only rarely.
+    int stuck = 0;
+    int words = 0;
+    for (int row = row_start; row <= row_end; row += row_step) {
+        const uint16_t *pixel = frame + row * SensorModel::COLUMNS;
+        for (int col = col_start; col <= col_end; col++) {
+            stuck += (pixel[col] == 0x0000) | (pixel[col] == 0xFFFF);
+        }
+        words += col_end - col_start + 1;
+    }
+    if (words > 0 && 2 * stuck > words) {
+        return FRAME_STUCK_BUS;
+    }
+    uint16_t *aux = const_cast<uint16_t *>(frame);
+    const float vdd = MLX90640_GetVdd(aux, &params);
+    const float ta = MLX90640_GetTa(aux, &params);
+    const float gain = static_cast<float>(params.gainEE) / static_cast<int16_t>(frame[SensorModel::AUX_OFFSET + 10]);
+    // Written so that NaN fails as well.
+    if (!(vdd >= MIN_VDD && vdd <= MAX_VDD && ta >= MIN_TA && ta <= MAX_TA && gain >= 0.5f && gain <= 2.0f)) {
+        return FRAME_AUX_RANGE;
+    }
+    last_sub_page = measured;
+    last_data_ready = data_ready;
+    return FRAME_OK;
+}
+
+bool LinkHealth::on_frame(const FrameFault fault, const uint64_t now) {
+    faults[fault]++;
+    if (fault == FRAME_OK) {
+        dropped_in_row = 0;
+        return true;
+    }
+    dropped_in_row++;
+    if (fault == FRAME_BUS_ERROR || fault == FRAME_TIMEOUT || fault == FRAME_CONTROL_REGISTER ||
+        dropped_in_row >= MAX_DROPPED_FRAMES) {
+        fail(now);
+    }
+    return false;
+}
+
+void LinkHealth::on_fault(const FrameFault fault, const uint64_t now) {
+    faults[fault]++;
+    fail(now);
+}
+
+void LinkHealth::fail(const uint64_t now) {
+    if (!has_failed) {
+        has_failed = true;
+        failed_since = now;
+        backoff = MIN_BACKOFF_NANOS;
+        failures++;
+    }
+    retry_time = now + backoff;
+}
+
+void LinkHealth::on_recovery(const bool is_recovered, const uint64_t now) {
+    attempts++;
+    if (is_recovered) {
+        has_failed = false;
+        last_sub_page = -1;
+        dropped_in_row = 0;
+        recovered++;
+        outage_nanos += now - failed_since;
+        longest_outage_nanos = std::max(longest_outage_nanos, now - failed_since);
+    } else {
+        backoff = std::min(2 * backoff, MAX_BACKOFF_NANOS);
+        retry_time = now + backoff;
+    }
+}
+
+uint64_t LinkHealth::dropped() const {
+    uint64_t n = 0;
+    for (int i = FRAME_OK + 1; i < N_FRAME_FAULTS; i++) {
+        n += faults[i];
+    }
+    return n;
+}
+
+void LinkHealth::write(FILE *file) const {
+    static const char *names[] = {"good frames", "bus errors", "timeouts", "control register", "subpage",
+                                  "stuck bus", "aux range"};
+    for (int i = 0; i < N_FRAME_FAULTS; i++) {
+        fprintf(file, "%-24s %10llu\n", names[i], static_cast<unsigned long long>(faults[i]));
+    }
+    fprintf(file, "failures                 %10llu\n", static_cast<unsigned long long>(failures));
+    fprintf(file, "recovery attempts        %10llu\n", static_cast<unsigned long long>(attempts));
+    fprintf(file, "recoveries               %10llu\n", static_cast<unsigned long long>(recovered));
+    fprintf(file, "outage  total %.3f  longest %.3f s%s\n", outage_nanos * 1e-9, longest_outage_nanos * 1e-9,
+            has_failed ? "  (failed at exit)" : "");
+}
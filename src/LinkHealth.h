@@ -0,0 +1,109 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_LINKHEALTH_H
+#define THERMALCAM_LINKHEALTH_H
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <MLX90640_API.h>
+#include "SensorModel.h"
+
+// Why a read of the sensor failed, or why its frame was dropped.
+enum FrameFault : uint8_t {
+    FRAME_OK = 0,
+    // An I2C transfer failed.
+    FRAME_BUS_ERROR,
+    // No new data for much longer than a refresh period.
+    FRAME_TIMEOUT,
+    // The control register differs from the value that was written, e.g. after a brown-out reset of the sensor.
+    FRAME_CONTROL_REGISTER,
+    // The subpage number is not 0 or 1, differs from the triggered or repeated subpage, or did not alternate while the
+    // sensor runs freely.
+    FRAME_SUB_PAGE,
+    // Most pixel words read 0x0000 or 0xFFFF, the pattern of a bus that is held low or high.
+    FRAME_STUCK_BUS,
+    // Supply voltage, ambient temperature or gain outside of the range the sensor can measure.
+    FRAME_AUX_RANGE,
+    N_FRAME_FAULTS
+};
+
+
+// Validates the raw frames of one sensor and decides when its bus needs to be recovered. Frames that fail validation
+// are dropped, so the last good frame stays on screen. After a bus error, a timeout, a reset of the sensor or
+// MAX_DROPPED_FRAMES corrupt frames in a row, the sensor is marked failed. A failed sensor is not accessed until its
+// next recovery attempt, and the time between attempts doubles up to MAX_BACKOFF_NANOS, so a broken sensor costs
+// neither bus time nor display frames.
+class LinkHealth {
+
+public:
+    LinkHealth();
+
+    // Checks the words of a raw frame that were read with readout (nullptr for the full frame) against the control
+    // register that was written. sub_page is the subpage of a triggered measurement, or -1 for a free-running sensor.
+    // data_ready [ns] is when the frame became available; a free-running sensor has to alternate between the
+    // subpages of frames that follow each other within a refresh period and a half.
+    FrameFault validate(const uint16_t *frame, const paramsMLX90640 &params, const readoutMLX90640 *readout,
+                        uint16_t control_register, int sub_page, uint64_t data_ready);
+
+    // Records the outcome of a frame read at time now [ns]. Returns true when the frame can be used.
+    bool on_frame(FrameFault fault, uint64_t now);
+
+    // Records a failure outside of a frame read, e.g. while polling for new data.
+    void on_fault(FrameFault fault, uint64_t now);
+
+    bool is_failed() const { return has_failed; }
+
+    bool is_retry_due(uint64_t now) const { return now >= retry_time; }
+
+    // Records a recovery attempt. When it failed, the next attempt is backed off.
+    void on_recovery(bool is_recovered, uint64_t now);
+
+    uint64_t dropped() const;
+
+    uint64_t recoveries() const { return recovered; }
+
+    void write(FILE *file) const;
+
+private:
+    const uint64_t MIN_BACKOFF_NANOS = 10000000;
+    const uint64_t MAX_BACKOFF_NANOS = 2000000000;
+    const int MAX_DROPPED_FRAMES = 3;
+    // Physical ranges of the auxiliary data.
+    const float MIN_VDD = 2.9f;
+    const float MAX_VDD = 3.7f;
+    const float MIN_TA = -45.0f;
+    const float MAX_TA = 130.0f;
+
+    void fail(uint64_t now);
+
+    // Subpage and data ready time [ns] of the last valid frame, -1 before the first one.
+    int last_sub_page;
+    uint64_t last_data_ready;
+    bool has_failed;
+    uint64_t retry_time;
+    uint64_t backoff;
+    int dropped_in_row;
+    uint64_t failed_since;
+    std::array<uint64_t, N_FRAME_FAULTS> faults;
+    uint64_t failures;
+    uint64_t attempts;
+    uint64_t recovered;
+    uint64_t outage_nanos;
+    uint64_t longest_outage_nanos;
+};
+
+#endif //THERMALCAM_LINKHEALTH_H
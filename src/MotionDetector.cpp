@@ -0,0 +1,43 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "MotionDetector.h"
+
+MotionDetector::MotionDetector() {
+    reset();
+}
+
+void MotionDetector::reset() {
+    previous[0].reset();
+    previous[1].reset();
+}
+
+bool MotionDetector::update(const FrameRef &frame) {
+    const uint16_t *words = frame->words;
+    const int sub_page = words[SensorModel::SUB_PAGE_WORD] & 1;
+    FrameRef &last = previous[sub_page];
+    int changed = 0;
+    if (last) {
+        const uint16_t *last_words = last->words;
+        // Branch free, so that the compiler vectorizes the loop.
+        for (int i = 0; i < SensorModel::PIXELS; i++) {
+            const int difference = static_cast<int16_t>(words[i]) - static_cast<int16_t>(last_words[i]);
+            changed += (difference > PIXEL_THRESHOLD) | (difference < -PIXEL_THRESHOLD);
+        }
+    }
+    const bool is_first = !last;
+    last = frame;
+    return !is_first && changed >= MIN_CHANGED_PIXELS;
+}
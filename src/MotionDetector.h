@@ -0,0 +1,46 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_MOTIONDETECTOR_H
+#define THERMALCAM_MOTIONDETECTOR_H
+
+#include <cstdint>
+#include "FramePool.h"
+#include "SensorModel.h"
+
+// Detects changes in the scene directly on the raw pixel words, without To conversion. Every frame is compared with
+// the previous frame of the same subpage, so that the subpage offsets do not show up as motion. The detector holds a
+// Ref to the previous frames instead of a copy of them.
+class MotionDetector {
+
+public:
+    typedef FramePool<RawFrame>::Ref FrameRef;
+
+    MotionDetector();
+
+    // Returns true when enough pixels changed since the previous frame of the same subpage.
+    bool update(const FrameRef &frame);
+
+    void reset();
+
+private:
+    // Raw difference that counts as a changed pixel, about 3 degrees Celsius at the default gain.
+    const int PIXEL_THRESHOLD = 40;
+    // Number of changed pixels that counts as motion.
+    const int MIN_CHANGED_PIXELS = 8;
+    FrameRef previous[2];
+};
+
+#endif //THERMALCAM_MOTIONDETECTOR_H
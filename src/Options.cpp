@@ -0,0 +1,132 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include "Options.h"
+
+bool parse_options(int argc, char *argv[], Options &options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--verify") {
+            options.verify = true;
+        } else if (arg == "--tolerance" && has_value) {
+            options.tolerance = strtof(argv[++i], nullptr);
+        } else if (arg == "--replay" && has_value) {
+            options.recordings.emplace_back(argv[++i]);
+        } else if (arg == "--sensor" && has_value) {
+            SensorAddress sensor = {MLX_I2C_BUS, MLX_I2C_ADDR};
+            if (sscanf(argv[++i], "%d:%i", &sensor.bus, &sensor.address) != 2 || sensor.bus < 0 ||
+                sensor.address < 0x08 || sensor.address > 0x77) {
+                fprintf(stderr, "Invalid sensor, expected <bus>:<address>: %s\n", argv[i]);
+                return false;
+            }
+            options.sensors.push_back(sensor);
+        } else if (arg == "--fps" && has_value) {
+            options.fps = atoi(argv[++i]);
+        } else if (arg == "--adaptive-rate") {
+            options.adaptive_rate = true;
+        } else if (arg == "--power-save") {
+            options.power_save = true;
+        } else if (arg == "--interleaved") {
+            options.interleaved = true;
+        } else if (arg == "--triggered") {
+            options.triggered = true;
+        } else if (arg == "--partial-readout") {
+            options.partial_readout = true;
+        } else if (arg == "--roi" && has_value) {
+            int *r = options.roi;
+            if (sscanf(argv[++i], "%d,%d,%d,%d", &r[0], &r[1], &r[2], &r[3]) != 4 ||
+                r[0] < 0 || r[0] > r[2] || r[2] >= SensorModel::ROWS || r[1] < 0 || r[1] > r[3] ||
+                r[3] >= SensorModel::COLUMNS) {
+                fprintf(stderr, "Invalid region of interest: %s\n", argv[i]);
+                return false;
+            }
+        } else if (arg == "--upscale" && has_value) {
+            if (!parse_upscale_quality(argv[++i], options.upscale)) {
+                fprintf(stderr, "Invalid upscale filter, expected gpu, bilinear, bicubic or lanczos: %s\n", argv[i]);
+                return false;
+            }
+        } else if (arg == "--super-resolution" && has_value) {
+            options.super_resolution = atoi(argv[++i]);
+            if (options.super_resolution != 2 && options.super_resolution != 4) {
+                fprintf(stderr, "Invalid super-resolution factor, expected 2 or 4: %s\n", argv[i]);
+                return false;
+            }
+        } else if (arg == "--record" && has_value) {
+            options.record_path = argv[++i];
+        } else if (arg == "--headless" && has_value) {
+            options.headless_frames = atoi(argv[++i]);
+            if (options.headless_frames < 1) {
+                fprintf(stderr, "Invalid number of headless frames: %s\n", argv[i]);
+                return false;
+            }
+        } else if (arg == "--check-allocations" && has_value) {
+            options.check_allocations = atoi(argv[++i]);
+            if (options.check_allocations < 1) {
+                fprintf(stderr, "Invalid number of frames to check: %s\n", argv[i]);
+                return false;
+            }
+        } else if (arg == "--dump-frames" && has_value) {
+            options.dump_path = argv[++i];
+        } else if (arg == "--record-video" && has_value) {
+            options.video_path = argv[++i];
+        } else if (arg == "--framebuffer" && has_value) {
+            options.framebuffer_path = argv[++i];
+        } else if (arg == "--shared-frames" && has_value) {
+            options.shared_frames_name = argv[++i];
+            if (options.shared_frames_name.size() < 2 || options.shared_frames_name[0] != '/' ||
+                options.shared_frames_name.find('/', 1) != std::string::npos) {
+                fprintf(stderr, "Invalid shared memory name, expected /<name>: %s\n", argv[i]);
+                return false;
+            }
+        } else if (arg == "--perf-log" && has_value) {
+            options.perf_log_path = argv[++i];
+        } else if (arg == "--trace" && has_value) {
+            options.trace_path = argv[++i];
+        } else {
+            fprintf(stderr, "Unknown or incomplete option: %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+void print_usage(const char *program) {
+    printf("Usage: %s [options]\n", program);
+    printf("  --sensor <bus:addr>    Add a sensor on /dev/i2c-<bus> at <addr>, e.g. 1:0x33 (may be repeated).\n");
+    printf("  --fps <hz>             Sensor refresh rate: 1, 2, 4, 8, 16, 32 or 64 (default %d).\n", FPS);
+    printf("  --adaptive-rate        Raise the refresh rate while measuring, lower it when idle.\n");
+    printf("  --power-save           Idle at 2 Hz without To conversion until motion is detected.\n");
+    printf("  --interleaved          Use the interleaved instead of the chess reading pattern.\n");
+    printf("  --triggered            Start every subpage measurement when the pipeline is ready.\n");
+    printf("  --partial-readout      Read only the rows of the measured subpage (interleaved mode).\n");
+    printf("  --roi <r0,c0,r1,c1>    Read only sensor rows r0..r1 and columns c0..c1.\n");
+    printf("  --upscale <filter>     gpu, bilinear, bicubic or lanczos (default bicubic).\n");
+    printf("  --super-resolution <n> Accumulate the subpages on an n times finer grid (2 or 4).\n");
+    printf("  --record <file>        Write all raw sensor frames to <file>.\n");
+    printf("  --headless <frames>    Render <frames> frames offscreen as fast as possible and report the cost.\n");
+    printf("  --check-allocations <frames> Run headless and fail if any of <frames> frames allocates.\n");
+    printf("  --dump-frames <dir>    Write every rendered frame to <dir> as a BMP.\n");
+    printf("  --record-video <file>  Encode the rendered frames to <file> (.mp4, .mkv or .avi) in the background.\n");
+    printf("  --framebuffer <dev>    Draw on a framebuffer device, e.g. /dev/fb0, without X11 (or into a file).\n");
+    printf("  --shared-frames <name> Publish every frame to the shared memory object <name>, e.g. /thermalcam.\n");
+    printf("  --perf-log <file>      Write per stage latency statistics to <file> on exit.\n");
+    printf("  --trace <file>         Write trace captures ('t' key or SIGUSR1) to <file>.\n");
+    printf("  --verify               Compare the optimized kernels against the Melexis reference and exit.\n");
+    printf("  --tolerance <degC>     Maximum absolute error for --verify (default 0.01).\n");
+    printf("  --replay <file>        Replay a recording instead of reading the sensor, or use it for --verify.\n");
+}
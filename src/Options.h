@@ -0,0 +1,86 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_OPTIONS_H
+#define THERMALCAM_OPTIONS_H
+
+#include <string>
+#include <vector>
+#include "constants.h"
+#include "Upscaler.h"
+
+// Position of a sensor: Linux I2C bus number and 7 bit slave address.
+struct SensorAddress {
+    int bus;
+    int address;
+};
+
+
+// Command line options of the application.
+struct Options {
+    // Run the kernel accuracy check instead of the camera application.
+    bool verify = false;
+    // Maximum absolute error in degrees Celsius that --verify accepts.
+    float tolerance = 0.01f;
+    // Recordings that --verify uses next to the synthetic frames. Without --verify, the first recording replaces the
+    // sensor.
+    std::vector<std::string> recordings;
+    // Sensors of the array, placed from left to right. Empty means a single sensor at the default address.
+    std::vector<SensorAddress> sensors;
+    // Sensor refresh rate in Hz.
+    int fps = FPS;
+    // Adapt the refresh rate to the scene and the CPU and bus headroom.
+    bool adaptive_rate = false;
+    // Drop to a low refresh rate and detect motion on the raw frames while nobody is measured.
+    bool power_save = false;
+    // Use the interleaved reading pattern instead of the chess pattern.
+    bool interleaved = false;
+    // Start every subpage measurement from the host (step mode) instead of letting the sensor free-run.
+    bool triggered = false;
+    // Read only the RAM words that changed: the rows of the measured subpage in interleaved mode.
+    bool partial_readout = false;
+    // Region of interest in sensor rows and columns (first row, first column, last row, last column). Pixels outside
+    // this window are not read from the sensor.
+    int roi[4] = {0, 0, SensorModel::ROWS - 1, SensorModel::COLUMNS - 1};
+    // Filter that scales the sensor image to the display.
+    UpscaleQuality upscale = UPSCALE_BICUBIC;
+    // Resolution factor (2 or 4) of the multi-frame super-resolution, 0 to show the sensor resolution.
+    int super_resolution = 0;
+    // Write every raw sensor frame to this file.
+    std::string record_path;
+    // Render this many frames offscreen with the software renderer, as fast as possible, report the cost and exit.
+    // The frames come from the first recording, or from a test pattern. 0 runs the camera on the display.
+    int headless_frames = 0;
+    // Run headless and count the heap allocations of this many frames after a warm-up. Any allocation fails the run.
+    int check_allocations = 0;
+    // Every rendered frame is written to this directory as a BMP.
+    std::string dump_path;
+    // The rendered frames are encoded to this .mp4, .mkv or .avi file.
+    std::string video_path;
+    // Show the frames on this framebuffer device instead of an SDL window. A regular file stands in for a device.
+    std::string framebuffer_path;
+    // Publish the raw and To frames and the measurement to this POSIX shared memory object, e.g. /thermalcam.
+    std::string shared_frames_name;
+    // Per stage latency statistics are written to this file on exit.
+    std::string perf_log_path = "/tmp/ThermalCamera_perf.txt";
+    // Trace captures are written to this file.
+    std::string trace_path = "/tmp/ThermalCamera_trace.json";
+};
+
+bool parse_options(int argc, char *argv[], Options &options);
+
+void print_usage(const char *program);
+
+#endif //THERMALCAM_OPTIONS_H
@@ -0,0 +1,155 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <chrono>
+#include "PerfStats.h"
+#include "TraceRecorder.h"
+
+const char *stage_name(const Stage stage) {
+    switch (stage) {
+        case STAGE_I2C_WAIT:
+            return "i2c wait";
+        case STAGE_I2C_READ:
+            return "i2c read";
+        case STAGE_TO_CONVERSION:
+            return "to conversion";
+        case STAGE_BAD_PIXELS:
+            return "bad pixels";
+        case STAGE_SUPER_RESOLUTION:
+            return "super-resolution";
+        case STAGE_STATISTICS:
+            return "statistics";
+        case STAGE_COLORMAP:
+            return "colormap";
+        case STAGE_TEXTURE_UPLOAD:
+            return "texture upload";
+        case STAGE_UI:
+            return "ui";
+        case STAGE_PRESENT:
+            return "present";
+        case STAGE_RENDER:
+            return "render";
+        case STAGE_FRAME:
+            return "frame";
+        default:
+            return "unknown";
+    }
+}
+
+uint64_t now_nanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+LatencyHistogram::LatencyHistogram() : total(0), max_value(0) {
+    for (auto &bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+int LatencyHistogram::bucket_index(const uint64_t nanos) {
+    if (nanos < SUB_BUCKETS) {
+        return static_cast<int>(nanos);
+    }
+    int exponent = 63 - __builtin_clzll(nanos);
+    if (exponent > MAX_EXPONENT) {
+        return N_BUCKETS - 1;
+    }
+    const int shift = exponent - SUB_BUCKET_BITS;
+    const int sub_bucket = static_cast<int>(nanos >> shift) - SUB_BUCKETS;
+    return SUB_BUCKETS + shift * SUB_BUCKETS + sub_bucket;
+}
+
+uint64_t LatencyHistogram::bucket_value(const int index) {
+    if (index < SUB_BUCKETS) {
+        return static_cast<uint64_t>(index);
+    }
+    const int shift = (index - SUB_BUCKETS) / SUB_BUCKETS;
+    const int sub_bucket = (index - SUB_BUCKETS) % SUB_BUCKETS;
+    return static_cast<uint64_t>(SUB_BUCKETS + sub_bucket) << shift;
+}
+
+void LatencyHistogram::record(const uint64_t nanos) {
+    buckets[bucket_index(nanos)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    uint64_t current = max_value.load(std::memory_order_relaxed);
+    while (nanos > current && !max_value.compare_exchange_weak(current, nanos, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::percentile(const double fraction) const {
+    const uint64_t n = count();
+    if (n == 0) {
+        return 0;
+    }
+    const auto rank = static_cast<uint64_t>(fraction * static_cast<double>(n - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < N_BUCKETS; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // Report the upper edge of the bucket, but never more than the real maximum.
+            uint64_t value = i + 1 < N_BUCKETS ? bucket_value(i + 1) - 1 : bucket_value(i);
+            return value < max() ? value : max();
+        }
+    }
+    return max();
+}
+
+RateCounter::RateCounter() : events(0), last_events(0), last_nanos(now_nanos()), last_rate(0.0f) {
+}
+
+float RateCounter::rate() {
+    const uint64_t nanos = now_nanos();
+    const uint64_t n = count();
+    // Average over at least half a second to keep the number readable.
+    if (nanos - last_nanos >= 500000000ull) {
+        last_rate = static_cast<float>(n - last_events) * 1e9f / static_cast<float>(nanos - last_nanos);
+        last_events = n;
+        last_nanos = nanos;
+    }
+    return last_rate;
+}
+
+void PerfStats::record(const Stage stage, const uint64_t begin, const uint64_t end) {
+    histograms[stage].record(end - begin);
+#ifndef THERMALCAM_DISABLE_TRACE
+    tracer().record(stage_name(stage), begin, end);
+#endif
+}
+
+void PerfStats::write(FILE *file) const {
+    fprintf(file, "%-16s %10s %10s %10s %10s\n", "stage", "count", "p50 [ms]", "p99 [ms]", "max [ms]");
+    for (int i = 0; i < N_STAGES; i++) {
+        const LatencyHistogram &h = histograms[i];
+        fprintf(file, "%-16s %10llu %10.3f %10.3f %10.3f\n", stage_name(static_cast<Stage>(i)),
+                static_cast<unsigned long long>(h.count()), h.percentile(0.50) * 1e-6, h.percentile(0.99) * 1e-6,
+                h.max() * 1e-6);
+    }
+    fprintf(file, "sensor frames    %10llu\n", static_cast<unsigned long long>(sensor_rate.count()));
+    fprintf(file, "display frames   %10llu\n", static_cast<unsigned long long>(display_rate.count()));
+}
+
+bool PerfStats::dump(const char *path, const std::function<void(FILE *)> &append) const {
+    FILE *file = fopen(path, "w");
+    if (file == nullptr) {
+        return false;
+    }
+    write(file);
+    if (append) {
+        append(file);
+    }
+    fclose(file);
+    return true;
+}
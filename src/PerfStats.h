@@ -0,0 +1,136 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_PERFSTATS_H
+#define THERMALCAM_PERFSTATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+
+// Pipeline stages that are timed every frame.
+enum Stage {
+    STAGE_I2C_WAIT,
+    STAGE_I2C_READ,
+    STAGE_TO_CONVERSION,
+    STAGE_BAD_PIXELS,
+    STAGE_SUPER_RESOLUTION,
+    STAGE_STATISTICS,
+    STAGE_COLORMAP,
+    STAGE_TEXTURE_UPLOAD,
+    STAGE_UI,
+    STAGE_PRESENT,
+    STAGE_RENDER,
+    STAGE_FRAME,
+    N_STAGES
+};
+
+const char *stage_name(Stage stage);
+
+// Nanoseconds on the monotonic clock.
+uint64_t now_nanos();
+
+
+// Histogram with 16 linear sub-buckets per power of two (about 6% relative resolution) from 1 ns to ~18 minutes.
+// Recording is wait-free, so any thread can record while another thread reads percentiles.
+class LatencyHistogram {
+
+public:
+    LatencyHistogram();
+
+    void record(uint64_t nanos);
+
+    uint64_t percentile(double fraction) const;
+
+    uint64_t max() const { return max_value.load(std::memory_order_relaxed); }
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+
+    static const int SUB_BUCKET_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int MAX_EXPONENT = 40;
+    static const int N_BUCKETS = SUB_BUCKETS + (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    static int bucket_index(uint64_t nanos);
+
+    static uint64_t bucket_value(int index);
+
+private:
+    std::atomic<uint32_t> buckets[N_BUCKETS];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> max_value;
+};
+
+
+// Counts events and reports their rate since the previous call to rate().
+class RateCounter {
+
+public:
+    RateCounter();
+
+    void tick() { events.fetch_add(1, std::memory_order_relaxed); }
+
+    float rate();
+
+    uint64_t count() const { return events.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> events;
+    uint64_t last_events;
+    uint64_t last_nanos;
+    float last_rate;
+};
+
+
+// Latency histograms of all pipeline stages plus the achieved sensor and display rates.
+class PerfStats {
+
+public:
+    void record(Stage stage, uint64_t nanos) { histograms[stage].record(nanos); }
+
+    // Records the span into the histogram of the stage and, during a trace capture, into the trace.
+    void record(Stage stage, uint64_t begin, uint64_t end);
+
+    const LatencyHistogram &histogram(Stage stage) const { return histograms[stage]; }
+
+    RateCounter sensor_rate;
+    RateCounter display_rate;
+
+    // Writes the statistics to path, followed by whatever append writes, e.g. the statistics of other components.
+    bool dump(const char *path, const std::function<void(FILE *)> &append = nullptr) const;
+
+    void write(FILE *file) const;
+
+private:
+    LatencyHistogram histograms[N_STAGES];
+};
+
+
+// Records the time between construction and destruction into one stage.
+class ScopedStage {
+
+public:
+    ScopedStage(PerfStats &stats, Stage stage) : stats(stats), stage(stage), start(now_nanos()) {}
+
+    ~ScopedStage() { stats.record(stage, start, now_nanos()); }
+
+private:
+    PerfStats &stats;
+    const Stage stage;
+    const uint64_t start;
+};
+
+#endif //THERMALCAM_PERFSTATS_H
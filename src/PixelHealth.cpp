@@ -0,0 +1,181 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "PixelHealth.h"
+
+PixelHealth::PixelHealth() : is_chess(true), is_detecting(true),
+                                                     outlier_limit(std::numeric_limits<float>::infinity()),
+                                                     first_check(0), frames(0), new_defects(0) {
+    reasons.fill(DEFECT_NONE);
+    build_tables();
+}
+
+void PixelHealth::init(const uint16_t *broken, const uint16_t *outliers, const size_t list_size,
+                                    const bool chess) {
+    is_chess = chess;
+    for (size_t i = 0; i < list_size && broken[i] < SensorModel::PIXELS; i++) {
+        mark(broken[i], DEFECT_EEPROM);
+    }
+    for (size_t i = 0; i < list_size && outliers[i] < SensorModel::PIXELS; i++) {
+        mark(outliers[i], DEFECT_EEPROM);
+    }
+    build_tables();
+}
+
+void PixelHealth::mark(const int pixel, const DefectReason why) {
+    if (!defect.test(pixel)) {
+        defect.set(pixel);
+        reasons[pixel] = why;
+    }
+}
+
+PixelHealth::Gather PixelHealth::neighbourhood(const int pixel) const {
+    const int row = pixel / SensorModel::COLUMNS;
+    const int column = pixel % SensorModel::COLUMNS;
+    // Neighbours of the same subpage first, the others only when none of those is healthy.
+    static const int diagonal[4][2] = {{-1, -1}, {-1, 1}, {1, -1}, {1, 1}};
+    static const int direct[4][2] = {{0, -1}, {0, 1}, {-1, 0}, {1, 0}};
+    const int (*candidates[2])[2] = {is_chess ? diagonal : direct, is_chess ? direct : diagonal};
+    Gather gather = {static_cast<uint16_t>(pixel), {0, 0, 0, 0}, {0.0f, 0.0f, 0.0f, 0.0f}};
+    int n = 0;
+    for (int set = 0; set < 2 && n == 0; set++) {
+        // Interleaved mode prefers only the two neighbours in the same row.
+        const int n_candidates = !is_chess && set == 0 ? 2 : 4;
+        for (int i = 0; i < n_candidates; i++) {
+            const int r = row + candidates[set][i][0];
+            const int c = column + candidates[set][i][1];
+            const int neighbour = r * SensorModel::COLUMNS + c;
+            if (r >= 0 && r < SensorModel::ROWS && c >= 0 && c < SensorModel::COLUMNS && !defect.test(neighbour)) {
+                gather.neighbours[n++] = static_cast<uint16_t>(neighbour);
+            }
+        }
+    }
+    if (n == 0) {
+        // Nothing healthy around: keep the pixel as it is.
+        gather.neighbours[n++] = static_cast<uint16_t>(pixel);
+    }
+    // Unused slots repeat a valid neighbour with weight zero, so that the gather never branches.
+    for (int i = 0; i < 4; i++) {
+        gather.weights[i] = i < n ? 1.0f / static_cast<float>(n) : 0.0f;
+        gather.neighbours[i] = i < n ? gather.neighbours[i] : gather.neighbours[0];
+    }
+    return gather;
+}
+
+void PixelHealth::build_tables() {
+    residual_gather.resize(SensorModel::PIXELS);
+    corrections.clear();
+    for (int i = 0; i < SensorModel::PIXELS; i++) {
+        residual_gather[i] = neighbourhood(i);
+        if (defect.test(i)) {
+            corrections.push_back(residual_gather[i]);
+        }
+    }
+}
+
+int PixelHealth::update(const float *to) {
+    new_defects = 0;
+    if (!is_detecting) {
+        return 0;
+    }
+    // A sensor that stopped producing frames repeats its last one; those would make every pixel look stuck.
+    if (frames > 0 && std::equal(to, to + SensorModel::PIXELS, last.begin())) {
+        return 0;
+    }
+    std::copy(to, to + SensorModel::PIXELS, last.begin());
+    if (frames == 0) {
+        std::copy(to, to + SensorModel::PIXELS, mean.begin());
+        variance.fill(0.0f);
+        residual_mean.fill(0.0f);
+        residual_variance.fill(0.0f);
+        high_rate.fill(0.0f);
+        low_rate.fill(0.0f);
+    }
+    frames++;
+    for (int i = 0; i < SensorModel::PIXELS; i++) {
+        const Gather &g = residual_gather[i];
+        const float neighbours = to[g.neighbours[0]] * g.weights[0] + to[g.neighbours[1]] * g.weights[1] +
+                                 to[g.neighbours[2]] * g.weights[2] + to[g.neighbours[3]] * g.weights[3];
+        const float delta = to[i] - mean[i];
+        mean[i] += ALPHA * delta;
+        variance[i] += ALPHA * (delta * delta - variance[i]);
+        const float residual = to[i] - neighbours;
+        const float deviation = residual - residual_mean[i];
+        residual_mean[i] += ALPHA * deviation;
+        residual_variance[i] += ALPHA * (deviation * deviation - residual_variance[i]);
+        // Not relative to the mean residual: an object that is sometimes there would shift the mean, and make the
+        // residual look low when it is not there.
+        const float is_high = residual > outlier_limit ? 1.0f : 0.0f;
+        const float is_low = residual < -outlier_limit ? 1.0f : 0.0f;
+        high_rate[i] += ALPHA * (is_high - high_rate[i]);
+        low_rate[i] += ALPHA * (is_low - low_rate[i]);
+    }
+    if (frames >= WARMUP_FRAMES && frames % CHECK_INTERVAL == 0) {
+        classify();
+    }
+    return new_defects;
+}
+
+void PixelHealth::classify() {
+    const auto percentile = static_cast<size_t>(NOISE_FLOOR_PERCENTILE * SensorModel::PIXELS);
+    scratch = residual_variance;
+    std::nth_element(scratch.begin(), scratch.begin() + percentile, scratch.end());
+    const float noise_floor = scratch[percentile];
+    if (noise_floor <= 0.0f) {
+        return;
+    }
+    outlier_limit = NOISE_SIGMAS * std::sqrt(noise_floor);
+    if (first_check == 0) {
+        first_check = frames;
+    }
+    // The outlier rates need the limit for a while before they mean something.
+    const bool has_outlier_rates = frames >= first_check + WARMUP_FRAMES;
+    for (int i = 0; i < SensorModel::PIXELS; i++) {
+        if (defect.test(i)) {
+            continue;
+        }
+        if (variance[i] < STUCK_RATIO * noise_floor) {
+            mark(i, DEFECT_STUCK);
+            new_defects++;
+        } else if (has_outlier_rates && std::min(high_rate[i], low_rate[i]) > NOISY_RATE) {
+            mark(i, DEFECT_NOISY);
+            new_defects++;
+        }
+    }
+    if (new_defects > 0) {
+        build_tables();
+    }
+}
+
+void PixelHealth::correct(float *to) const {
+    for (const Gather &g : corrections) {
+        to[g.pixel] = to[g.neighbours[0]] * g.weights[0] + to[g.neighbours[1]] * g.weights[1] +
+                      to[g.neighbours[2]] * g.weights[2] + to[g.neighbours[3]] * g.weights[3];
+    }
+}
+
+void PixelHealth::write(FILE *file) const {
+    static const char *names[] = {"none", "eeprom", "stuck", "noisy"};
+    fprintf(file, "defect pixels            %10zu\n", defects());
+    for (int i = 0; i < SensorModel::PIXELS; i++) {
+        if (defect.test(i)) {
+            fprintf(file, "  row %2d column %2d  %s\n", i / SensorModel::COLUMNS, i % SensorModel::COLUMNS,
+                    names[reasons[i]]);
+        }
+    }
+}
@@ -0,0 +1,120 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_PIXELHEALTH_H
+#define THERMALCAM_PIXELHEALTH_H
+
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "SensorModel.h"
+
+// Why a pixel is marked as defect.
+enum DefectReason : uint8_t {
+    DEFECT_NONE = 0,
+    // Broken or outlier pixel listed in the EEPROM.
+    DEFECT_EEPROM,
+    // The value does not change, while the other pixels show normal noise.
+    DEFECT_STUCK,
+    // Often far off from its neighbours, much more often than noise explains.
+    DEFECT_NOISY
+};
+
+
+// Finds pixels that broke down in the field and corrects all defect pixels. Per pixel, streaming estimates are kept of
+// the temporal variance, and of the residual: the difference with the mean of the neighbours. The noise floor is a low
+// percentile of the residual variance, so that moving people in a part of the image do not raise it. Every
+// CHECK_INTERVAL frames, pixels that hardly vary compared to the noise floor are marked stuck, and pixels whose
+// residual often deviates by more than NOISE_SIGMAS, both upwards and downwards, are marked noisy. An edge of a warm
+// object that passes by a pixel pushes its residual to one side only, so it does not make the pixel look noisy. The
+// map has no size limit, unlike the 5 broken and 5 outlier pixels of the EEPROM. For every defect, the healthy
+// neighbours and their weights are precomputed, so that correction is a branch free gather over the list of defects.
+class PixelHealth {
+
+public:
+    PixelHealth();
+
+    // Marks the pixels of the 0xFFFF terminated EEPROM lists as defect. In chess mode, the diagonal neighbours are
+    // used for correction, because they belong to the same subpage. In interleaved mode, the neighbours in the same
+    // row are used.
+    void init(const uint16_t *broken, const uint16_t *outliers, size_t list_size, bool chess);
+
+    // Runtime detection needs all pixels to be measured. Disable it when only a region of interest is read.
+    void set_detection(bool enabled) { is_detecting = enabled; }
+
+    // Updates the statistics with a converted frame, before correction. Returns the number of new defects. A frame that
+    // equals the previous one is not a new measurement, and is ignored.
+    int update(const float *to);
+
+    // Replaces every defect pixel by the weighted mean of its healthy neighbours.
+    void correct(float *to) const;
+
+    size_t defects() const { return defect.count(); }
+
+    DefectReason reason(int pixel) const { return reasons[pixel]; }
+
+    void write(FILE *file) const;
+
+private:
+    // Exponential moving average weight, about 256 frames.
+    const float ALPHA = 1.0f / 256.0f;
+    const uint64_t WARMUP_FRAMES = 512;
+    const uint64_t CHECK_INTERVAL = 64;
+    // The noise floor is this percentile of the residual variance of all pixels.
+    const float NOISE_FLOOR_PERCENTILE = 0.25f;
+    // Stuck: temporal variance below this fraction of the noise floor.
+    const float STUCK_RATIO = 0.05f;
+    // Noisy: residual more than NOISE_SIGMAS above zero in more than NOISY_RATE of the frames, and as often below.
+    const float NOISE_SIGMAS = 4.0f;
+    const float NOISY_RATE = 0.1f;
+
+    struct Gather {
+        uint16_t pixel;
+        uint16_t neighbours[4];
+        float weights[4];
+    };
+
+    Gather neighbourhood(int pixel) const;
+
+    void mark(int pixel, DefectReason why);
+
+    void build_tables();
+
+    void classify();
+
+    bool is_chess;
+    bool is_detecting;
+    std::bitset<SensorModel::PIXELS> defect;
+    std::array<DefectReason, SensorModel::PIXELS> reasons;
+    // Healthy neighbours of every pixel, to compute the residual, and of every defect, to correct it.
+    std::vector<Gather> residual_gather;
+    std::vector<Gather> corrections;
+    std::array<float, SensorModel::PIXELS> last;
+    std::array<float, SensorModel::PIXELS> mean;
+    std::array<float, SensorModel::PIXELS> variance;
+    std::array<float, SensorModel::PIXELS> residual_mean;
+    std::array<float, SensorModel::PIXELS> residual_variance;
+    std::array<float, SensorModel::PIXELS> high_rate;
+    std::array<float, SensorModel::PIXELS> low_rate;
+    float outlier_limit;
+    uint64_t first_check;
+    std::array<float, SensorModel::PIXELS> scratch;
+    uint64_t frames;
+    int new_defects;
+};
+
+#endif //THERMALCAM_PIXELHEALTH_H
@@ -0,0 +1,62 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "PowerSave.h"
+
+PowerSave::PowerSave() : is_power_save(false), is_idling(false), active_fps(0), last_activity(0) {
+}
+
+void PowerSave::configure(const bool is_enabled, const size_t n_sensors) {
+    is_power_save = is_enabled;
+    is_idling = false;
+    last_activity = 0;
+    motion_detectors.clear();
+    motion_detectors.resize(is_enabled ? n_sensors : 0);
+}
+
+int PowerSave::update(const SensorArray &sensors, const bool is_measuring, const int current_fps,
+                      const uint64_t data_ready) {
+    if (!is_power_save) {
+        return current_fps;
+    }
+    bool is_motion = false;
+    for (size_t s = 0; s < sensors.size(); s++) {
+        is_motion = motion_detectors[s].update(sensors[s].frame) || is_motion;
+    }
+    if (is_idling) {
+        if (!is_motion) {
+            return current_fps;
+        }
+        // Back to the active rate right away, and convert this frame as usual.
+        is_idling = false;
+        last_activity = data_ready;
+        stats.on_wake(data_ready);
+        return active_fps;
+    }
+    if (is_motion || is_measuring || last_activity == 0) {
+        last_activity = data_ready;
+    } else if (data_ready - last_activity > IDLE_AFTER_NANOS) {
+        active_fps = current_fps;
+        is_idling = true;
+        return IDLE_FPS;
+    }
+    return current_fps;
+}
+
+void PowerSave::write(FILE *file) const {
+    if (is_power_save) {
+        stats.write(file);
+    }
+}
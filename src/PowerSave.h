@@ -0,0 +1,70 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_POWERSAVE_H
+#define THERMALCAM_POWERSAVE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "MotionDetector.h"
+#include "PowerSaveStats.h"
+#include "SensorArray.h"
+
+// Idle power save: when nothing moves and nobody is measured for a while, the sensor drops to a low refresh rate and
+// the frames are only checked for motion on the raw pixel words, without To conversion. The first frame with motion
+// restores the previous rate. Like the RefreshRateController, it only chooses the rate; the caller applies it.
+class PowerSave {
+
+public:
+    PowerSave();
+
+    void configure(bool is_enabled, size_t n_sensors);
+
+    bool is_enabled() const { return is_power_save; }
+
+    // True while the frames need no processing.
+    bool is_idle() const { return is_idling; }
+
+    // Feeds the raw frames of a subpage, measured at data_ready. Returns the refresh rate to use from now on.
+    int update(const SensorArray &sensors, bool is_measuring, int current_fps, uint64_t data_ready);
+
+    // Called when the sensor could not be switched to the rate returned by update(). Idling is retried on the next
+    // frame.
+    void on_rate_failed() { is_idling = false; }
+
+    void on_tick(uint64_t busy_nanos, uint64_t now) { stats.on_tick(is_idling, busy_nanos, now); }
+
+    void on_frame() { stats.on_frame(is_idling); }
+
+    void on_skipped_redraw() { stats.on_skipped_redraw(); }
+
+    void on_present(uint64_t present_nanos) { stats.on_present(present_nanos); }
+
+    void write(FILE *file) const;
+
+private:
+    // Refresh rate while idle, and the time without motion or measurement after which the camera goes idle.
+    const int IDLE_FPS = 2;
+    const uint64_t IDLE_AFTER_NANOS = 10000000000ull;
+    bool is_power_save;
+    bool is_idling;
+    int active_fps;
+    uint64_t last_activity;
+    std::vector<MotionDetector> motion_detectors;
+    PowerSaveStats stats;
+};
+
+#endif //THERMALCAM_POWERSAVE_H
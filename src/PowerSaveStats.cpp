@@ -0,0 +1,62 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "PowerSaveStats.h"
+
+PowerSaveStats::PowerSaveStats() : wall_nanos{0, 0}, busy_nanos{0, 0}, frames{0, 0}, last_tick(0),
+                                   wake_data_ready(0), wakeups(0), redraws_skipped(0) {
+}
+
+void PowerSaveStats::on_tick(const bool is_idle, const uint64_t busy, const uint64_t now) {
+    if (last_tick != 0 && now > last_tick) {
+        wall_nanos[is_idle] += now - last_tick;
+        busy_nanos[is_idle] += busy;
+    }
+    last_tick = now;
+}
+
+void PowerSaveStats::on_frame(const bool is_idle) {
+    frames[is_idle]++;
+}
+
+void PowerSaveStats::on_wake(const uint64_t data_ready) {
+    wakeups++;
+    wake_data_ready = data_ready;
+}
+
+void PowerSaveStats::on_present(const uint64_t present_nanos) {
+    if (wake_data_ready == 0) {
+        return;
+    }
+    if (present_nanos > wake_data_ready) {
+        wake.record(present_nanos - wake_data_ready);
+    }
+    wake_data_ready = 0;
+}
+
+void PowerSaveStats::write(FILE *file) const {
+    fprintf(file, "%-16s %10s %10s %10s %10s\n", "power save", "time [s]", "cpu [%]", "frames", "fps");
+    const char *names[] = {"active", "idle"};
+    for (int i = 0; i < 2; i++) {
+        const double seconds = wall_nanos[i] * 1e-9;
+        fprintf(file, "%-16s %10.1f %10.2f %10llu %10.2f\n", names[i], seconds,
+                wall_nanos[i] > 0 ? 100.0 * busy_nanos[i] / wall_nanos[i] : 0.0,
+                static_cast<unsigned long long>(frames[i]), seconds > 0 ? frames[i] / seconds : 0.0);
+    }
+    fprintf(file, "wake-ups                 %10llu\n", static_cast<unsigned long long>(wakeups));
+    fprintf(file, "wake-up latency  p50 %.3f  p99 %.3f  max %.3f ms\n", wake.percentile(0.50) * 1e-6,
+            wake.percentile(0.99) * 1e-6, wake.max() * 1e-6);
+    fprintf(file, "redraws skipped          %10llu\n", static_cast<unsigned long long>(redraws_skipped));
+}
@@ -0,0 +1,59 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_POWERSAVESTATS_H
+#define THERMALCAM_POWERSAVESTATS_H
+
+#include <cstdint>
+#include <cstdio>
+#include "PerfStats.h"
+
+// Active and idle time, CPU duty cycle and wake-up latency of the idle power save mode. The CPU duty cycle and the
+// number of sensor frames per second are used as a proxy for the power draw, which can not be measured in software.
+class PowerSaveStats {
+
+public:
+    PowerSaveStats();
+
+    // Called once per main loop iteration with the time spent outside the scheduler wait.
+    void on_tick(bool is_idle, uint64_t busy_nanos, uint64_t now);
+
+    // Called for every acquired frame.
+    void on_frame(bool is_idle);
+
+    void on_skipped_redraw() { redraws_skipped++; }
+
+    // Called when motion ends the idle mode, with the data ready time of the frame that showed the motion.
+    void on_wake(uint64_t data_ready);
+
+    // Called after every present; the first present after a wake-up completes the wake-up latency.
+    void on_present(uint64_t present_nanos);
+
+    const LatencyHistogram &wake_latency() const { return wake; }
+
+    void write(FILE *file) const;
+
+private:
+    LatencyHistogram wake;
+    uint64_t wall_nanos[2];
+    uint64_t busy_nanos[2];
+    uint64_t frames[2];
+    uint64_t last_tick;
+    uint64_t wake_data_ready;
+    uint64_t wakeups;
+    uint64_t redraws_skipped;
+};
+
+#endif //THERMALCAM_POWERSAVESTATS_H
@@ -0,0 +1,94 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "Recorders.h"
+
+void Recorders::open(const Options &options, const int width, const int height, const bool is_blocking_dump,
+                     const uint16_t *eeprom, const size_t n_sensors) {
+    if (!options.dump_path.empty() &&
+        !frame_dump.open(options.dump_path, width, height, options.fps, is_blocking_dump)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to dump frames to %s", options.dump_path.c_str());
+    }
+    if (!options.video_path.empty()) {
+        if (video.open(options.video_path, width, height, options.fps)) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Recording video to %s", options.video_path.c_str());
+        } else {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to record video to %s", options.video_path.c_str());
+        }
+    }
+    if (!options.record_path.empty()) {
+        if (raw.open(options.record_path, eeprom)) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Recording raw frames to %s", options.record_path.c_str());
+            if (n_sensors > 1) {
+                SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Only the first sensor is recorded");
+            }
+        } else {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to open recording %s", options.record_path.c_str());
+        }
+    }
+}
+
+void Recorders::close() {
+    frame_dump.close();
+    video.close();
+    raw.close();
+}
+
+void Recorders::write_raw(const uint16_t *frame) {
+    if (raw.is_open()) {
+        raw.write(frame);
+    }
+}
+
+void Recorders::record(SDL_Renderer *renderer, const SDL_Surface *surface, const uint64_t now) {
+    if (!frame_dump.is_open() && !video.is_open()) {
+        return;
+    }
+    // A software target is copied; a window is read back once, into the buffer of the first recorder.
+    const uint32_t *frame = surface != nullptr ? static_cast<const uint32_t *>(surface->pixels) : nullptr;
+    int frame_pitch = surface != nullptr ? surface->pitch : 0;
+    VideoRecorder *recorders[] = {&frame_dump, &video};
+    for (VideoRecorder *recorder : recorders) {
+        if (!recorder->is_open()) {
+            continue;
+        }
+        int slot = -1;
+        bool is_queued;
+        if (frame != nullptr) {
+            is_queued = recorder->push(frame, frame_pitch, now);
+        } else {
+            slot = recorder->acquire();
+            is_queued = slot >= 0;
+        }
+        if (!is_queued && recorder->failed()) {
+            // The writer thread logged the error and stopped. Join it now; the recorder stays closed.
+            recorder->close();
+        }
+        if (slot < 0) {
+            continue;
+        }
+        SDL_RenderReadPixels(renderer, nullptr, SDL_PIXELFORMAT_ARGB8888, recorder->pixels(slot), recorder->pitch());
+        recorder->submit(slot, now);
+        // The writer thread only reads the buffer, so the next recorder can copy from it.
+        frame = recorder->pixels(slot);
+        frame_pitch = recorder->pitch();
+    }
+}
+
+void Recorders::write(FILE *file) const {
+    if (video.is_open()) {
+        video.write(file);
+    }
+}
@@ -0,0 +1,52 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_RECORDERS_H
+#define THERMALCAM_RECORDERS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <SDL2/SDL.h>
+#include "FrameRecording.h"
+#include "Options.h"
+#include "VideoRecorder.h"
+
+// The optional recordings of a run: the raw frames of the first sensor, and the rendered frames as a directory of
+// BMPs and as a video. The rendered frames are written on background threads.
+class Recorders {
+
+public:
+    // Opens the recordings requested in options, for width x height frames. The errors are logged. The blocking dump
+    // waits for its writer instead of dropping frames.
+    void open(const Options &options, int width, int height, bool is_blocking_dump, const uint16_t *eeprom,
+              size_t n_sensors);
+
+    void close();
+
+    void write_raw(const uint16_t *frame);
+
+    // Hands the composed frame to the frame recorders: the pixels of surface, or when it is null, the target of
+    // renderer read back once. The read back of a window has to happen before the present.
+    void record(SDL_Renderer *renderer, const SDL_Surface *surface, uint64_t now);
+
+    void write(FILE *file) const;
+
+private:
+    FrameRecorder raw;
+    VideoRecorder frame_dump;
+    VideoRecorder video;
+};
+
+#endif //THERMALCAM_RECORDERS_H
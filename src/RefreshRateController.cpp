@@ -0,0 +1,57 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "RefreshRateController.h"
+
+RefreshRateController::RefreshRateController(const int min_fps, const int max_fps, const bool is_enabled) :
+        min_fps(min_fps), max_fps(max_fps), is_adaptive(is_enabled), cpu_nanos_avg(0.0f), bus_nanos_avg(0.0f),
+        last_bus_nanos(0), last_change(0) {
+}
+
+uint8_t RefreshRateController::rate_code(const int fps) {
+    // Control register values 0b001 .. 0b111 select 1 .. 64 Hz.
+    uint8_t code = 1;
+    for (int rate = 1; rate <= 64; rate *= 2, code++) {
+        if (rate == fps) {
+            return code;
+        }
+    }
+    return 0;
+}
+
+void RefreshRateController::on_frame(const uint64_t cpu_nanos, const uint64_t bus_nanos) {
+    cpu_nanos_avg += ALPHA * (static_cast<float>(cpu_nanos) - cpu_nanos_avg);
+    bus_nanos_avg += ALPHA * (static_cast<float>(bus_nanos) - bus_nanos_avg);
+}
+
+int RefreshRateController::update(const int current_fps, const bool is_measuring, const uint64_t now_nanos) {
+    if (!is_adaptive || now_nanos - last_change < HOLD_NANOS) {
+        return current_fps;
+    }
+    int fps = current_fps;
+    const bool overloaded = cpu_load(current_fps) > OVERLOAD || bus_load(current_fps) > OVERLOAD;
+    if (overloaded || (!is_measuring && current_fps > min_fps)) {
+        fps = current_fps / 2 >= min_fps ? current_fps / 2 : min_fps;
+    } else if (is_measuring && current_fps < max_fps) {
+        const int next = current_fps * 2;
+        if (cpu_load(next) < HEADROOM && bus_load(next) < HEADROOM) {
+            fps = next;
+        }
+    }
+    if (fps != current_fps) {
+        last_change = now_nanos;
+    }
+    return fps;
+}
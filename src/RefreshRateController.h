@@ -0,0 +1,69 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_REFRESHRATECONTROLLER_H
+#define THERMALCAM_REFRESHRATECONTROLLER_H
+
+#include <cstdint>
+
+// Chooses the sensor refresh rate: the maximum rate while someone is measured, as long as the CPU and the I2C bus
+// have headroom for it, and the minimum rate when nobody is in front of the sensor. The rate changes by a factor of
+// two at a time, and holds for a while after every change to avoid oscillation. A disabled controller keeps the rate.
+class RefreshRateController {
+
+public:
+    RefreshRateController(int min_fps, int max_fps, bool is_enabled = true);
+
+    bool is_enabled() const { return is_adaptive; }
+
+    // Control register value that selects fps, or 0 when the sensor does not support the rate.
+    static uint8_t rate_code(int fps);
+
+    // Feeds the CPU time (processing and rendering, without the wait for the present) and bus time (RAM transfer)
+    // spent on one subpage.
+    void on_frame(uint64_t cpu_nanos, uint64_t bus_nanos);
+
+    // Feeds the bus time when the subpage is read, and the CPU time once it is processed and rendered.
+    void on_read(uint64_t bus_nanos) { last_bus_nanos = bus_nanos; }
+
+    void on_processed(uint64_t cpu_nanos) { on_frame(cpu_nanos, last_bus_nanos); }
+
+    // Returns the refresh rate to use from now on.
+    int update(int current_fps, bool is_measuring, uint64_t now_nanos);
+
+    // Fraction of the subpage period that the CPU and the bus would be busy at the given rate.
+    float cpu_load(int fps) const { return cpu_nanos_avg * 1e-9f * fps; }
+
+    float bus_load(int fps) const { return bus_nanos_avg * 1e-9f * fps; }
+
+private:
+    const int min_fps;
+    const int max_fps;
+    const bool is_adaptive;
+    // Maximum load after raising the rate.
+    const float HEADROOM = 0.7f;
+    // Load above which the rate is lowered, even while measuring.
+    const float OVERLOAD = 0.95f;
+    // Smoothing factor of the load averages.
+    const float ALPHA = 0.1f;
+    // Minimum time between two changes.
+    const uint64_t HOLD_NANOS = 1000000000ull;
+    float cpu_nanos_avg;
+    float bus_nanos_avg;
+    uint64_t last_bus_nanos;
+    uint64_t last_change;
+};
+
+#endif //THERMALCAM_REFRESHRATECONTROLLER_H
@@ -0,0 +1,283 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <MLX90640_I2C_Driver.h>
+#include "PerfStats.h"
+#include "SensorArray.h"
+#include "TemperatureKernels.h"
+#include "TraceRecorder.h"
+
+SensorArray::SensorArray() {
+    MLX90640_SetDataReadyTimeout(READ_TIMEOUT_MICROS);
+}
+
+void SensorArray::add(const int bus, const uint8_t address) {
+    sensors.emplace_back(new Sensor());
+    Sensor &sensor = *sensors.back();
+    sensor.bus = bus;
+    sensor.address = address;
+    sensor.control_register = 0;
+    sensor.result = -1;
+    sensor.is_waiting = true;
+    sensor.is_data_ready = false;
+    sensor.wait_start = 0;
+    sensor.data_ready = 0;
+    sensor.is_valid = false;
+    sensor.has_new_frame = false;
+    sensor.tr = 0.0f;
+    sensor.frame = sensor.raw_frames.acquire();
+    sensor.to = sensor.to_frames.acquire();
+    sensor.new_defects = 0;
+    size_t b = 0;
+    while (b < buses.size() && sensors[buses[b].front()]->bus != bus) {
+        b++;
+    }
+    if (b == buses.size()) {
+        buses.emplace_back();
+    }
+    buses[b].push_back(sensors.size() - 1);
+    // Acquisition needs one thread per bus, conversion one per core. The calling thread is one of them.
+    const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    pool.reset(new WorkerPool(std::max(buses.size(), std::min(cores, sensors.size())) - 1));
+}
+
+template<typename Fn>
+void SensorArray::for_each_bus(const char *name, Fn fn) {
+    pool->run(buses.size(), [this, name, &fn](size_t b) {
+        MLX90640_I2CSetBus(sensors[buses[b].front()]->bus);
+        for (size_t i : buses[b]) {
+            TRACE_SCOPE(name);
+            fn(*sensors[i]);
+        }
+    }, "i2c bus");
+}
+
+bool SensorArray::init() {
+    for_each_bus("dump eeprom", [](Sensor &sensor) {
+        sensor.result = MLX90640_DumpEE(sensor.address, sensor.eeprom);
+    });
+    for (auto &sensor : sensors) {
+        if (sensor->result != 0) {
+            return false;
+        }
+    }
+    return init_from_eeprom();
+}
+
+bool SensorArray::init_from_eeprom() {
+    bool is_valid = true;
+    for (auto &sensor : sensors) {
+        // Only a missing or corrupt EEPROM (-7) is fatal, the other codes are warnings about the calibration data.
+        is_valid = is_valid && MLX90640_ExtractParameters(sensor->eeprom, &sensor->params) != -7;
+        sensor->control_register = sensor->eeprom[0x0C];
+    }
+    return is_valid;
+}
+
+void SensorArray::init_pixel_health(const bool chess, const bool detect) {
+    for (auto &sensor : sensors) {
+        sensor->health.init(sensor->params.brokenPixels, sensor->params.outlierPixels, 5, chess);
+        sensor->health.set_detection(detect);
+    }
+}
+
+bool SensorArray::configure(const configMLX90640 &config) {
+    for_each_bus("configure", [&config](Sensor &sensor) {
+        const uint16_t value = MLX90640_ComposeControlRegister(sensor.control_register, &config);
+        if (sensor.link.is_failed()) {
+            // Written by the recovery.
+            sensor.control_register = value;
+            sensor.result = 0;
+            return;
+        }
+        sensor.result = MLX90640_SetControlRegister(sensor.address, value);
+        if (sensor.result == 0) {
+            sensor.control_register = value;
+        }
+    });
+    return std::all_of(sensors.begin(), sensors.end(), [](const std::unique_ptr<Sensor> &sensor) {
+        return sensor->result == 0;
+    });
+}
+
+void SensorArray::start_measurement(const uint8_t sub_page) {
+    for_each_bus("start measurement", [sub_page](Sensor &sensor) {
+        if (sensor.link.is_failed()) {
+            return;
+        }
+        MLX90640_StartMeasurement(sensor.address, sub_page);
+        sensor.control_register = static_cast<uint16_t>((sensor.control_register & 0xFFEF) | (sub_page << 4));
+        sensor.is_waiting = true;
+        sensor.wait_start = 0;
+    });
+}
+
+void SensorArray::recover(Sensor &sensor, const bool triggered) {
+    MLX90640_I2CReset();
+    uint16_t control_register;
+    sensor.result = MLX90640_I2CRead(sensor.address, 0x800D, 1, &control_register);
+    if (sensor.result == 0 && control_register != sensor.control_register) {
+        sensor.result = MLX90640_SetControlRegister(sensor.address, sensor.control_register);
+    }
+    const bool is_recovered = sensor.result == 0;
+    sensor.link.on_recovery(is_recovered, now_nanos());
+    // A triggered sensor waits for the next start of a measurement.
+    sensor.is_waiting = is_recovered && !triggered;
+    sensor.is_data_ready = false;
+    sensor.wait_start = 0;
+}
+
+bool SensorArray::poll(const bool triggered) {
+    const uint64_t timeout = DATA_TIMEOUT_NANOS;
+    for_each_bus("poll", [triggered, timeout](Sensor &sensor) {
+        const uint64_t now = now_nanos();
+        if (sensor.link.is_failed()) {
+            if (sensor.link.is_retry_due(now)) {
+                recover(sensor, triggered);
+            }
+            return;
+        }
+        if (!sensor.is_waiting || sensor.is_data_ready) {
+            return;
+        }
+        if (sensor.wait_start == 0) {
+            sensor.wait_start = now;
+        }
+        sensor.result = MLX90640_CheckInterrupt(sensor.address);
+        if (sensor.result < 0) {
+            sensor.link.on_fault(FRAME_BUS_ERROR, now);
+        } else if (sensor.result == 1) {
+            sensor.is_data_ready = true;
+            sensor.data_ready = now;
+        } else if (now - sensor.wait_start > timeout) {
+            sensor.link.on_fault(FRAME_TIMEOUT, now);
+        }
+    });
+    return std::all_of(sensors.begin(), sensors.end(), [](const std::unique_ptr<Sensor> &sensor) {
+        return sensor->link.is_failed() || !sensor->is_waiting || sensor->is_data_ready;
+    });
+}
+
+bool SensorArray::acquire(const readoutMLX90640 *readout, const bool triggered, const uint8_t sub_page) {
+    for_each_bus("read frame", [readout, triggered, sub_page](Sensor &sensor) {
+        sensor.is_valid = false;
+        if (sensor.link.is_failed() || !sensor.is_data_ready) {
+            return;
+        }
+        if (triggered) {
+            sensor.result = MLX90640_GetTriggeredData(sensor.address, sensor.read_buffer, readout, sub_page,
+                                                      &sensor.timing);
+        } else {
+            sensor.result = MLX90640_GetFrameDataPartial(sensor.address, sensor.read_buffer, readout, &sensor.timing);
+        }
+        sensor.timing.waitStart = sensor.wait_start;
+        sensor.timing.dataReady = sensor.data_ready;
+        sensor.is_waiting = !triggered;
+        sensor.is_data_ready = false;
+        sensor.wait_start = 0;
+        FrameFault fault;
+        if (sensor.result < 0) {
+            fault = sensor.result == -9 ? FRAME_TIMEOUT : FRAME_BUS_ERROR;
+        } else {
+            fault = sensor.link.validate(sensor.read_buffer, sensor.params, readout, sensor.control_register,
+                                         triggered ? sub_page : -1, sensor.timing.dataReady);
+        }
+        sensor.is_valid = sensor.link.on_frame(fault, sensor.timing.readDone);
+        if (sensor.is_valid) {
+            // Without a free slot the frame is dropped, the consumers keep the old ones.
+            FramePool<RawFrame>::Ref next = sensor.raw_frames.acquire();
+            sensor.is_valid = static_cast<bool>(next);
+            if (sensor.is_valid) {
+                memcpy(next->words, sensor.read_buffer, sizeof(next->words));
+                sensor.frame = std::move(next);
+                sensor.has_new_frame = true;
+            }
+        }
+        // A partial readout only refreshes part of the buffer, so it has to start from the last valid frame again.
+        if (!sensor.is_valid) {
+            memcpy(sensor.read_buffer, sensor.frame->words, sizeof(sensor.read_buffer));
+        }
+    });
+    return std::any_of(sensors.begin(), sensors.end(), [](const std::unique_ptr<Sensor> &sensor) {
+        return sensor->is_valid;
+    });
+}
+
+size_t SensorArray::failed() const {
+    return static_cast<size_t>(std::count_if(sensors.begin(), sensors.end(), [](const std::unique_ptr<Sensor> &sensor) {
+        return sensor->link.is_failed();
+    }));
+}
+
+timingMLX90640 SensorArray::timing() const {
+    timingMLX90640 timing;
+    timing.waitStart = UINT64_MAX;
+    timing.dataReady = 0;
+    timing.readDone = 0;
+    for (const auto &sensor : sensors) {
+        if (sensor->is_valid) {
+            timing.waitStart = std::min(timing.waitStart, sensor->timing.waitStart);
+            timing.dataReady = std::max(timing.dataReady, sensor->timing.dataReady);
+            timing.readDone = std::max(timing.readDone, sensor->timing.readDone);
+        }
+    }
+    if (timing.readDone == 0) {
+        timing.waitStart = timing.dataReady = timing.readDone = now_nanos();
+    }
+    return timing;
+}
+
+void SensorArray::calculate_to(const float emissivity, const float ta_shift, const readoutMLX90640 &region) {
+    pool->run(sensors.size(), [this, emissivity, ta_shift, &region](size_t i) {
+        Sensor &sensor = *sensors[i];
+        // A failed or stalled sensor keeps its last frame. Converting it again would feed the same values to the
+        // defect detection over and over, until every pixel looks stuck.
+        if (!sensor.is_valid || !sensor.has_new_frame) {
+            return;
+        }
+        sensor.converted = sensor.to_frames.acquire();
+        if (!sensor.converted) {
+            return;
+        }
+        // Only the pixels of the measured subpage in the region are converted, the others keep their previous value.
+        memcpy(sensor.converted->values, sensor.to->values, sizeof(sensor.converted->values));
+        sensor.tr = MLX90640_GetTa(sensor.frame->words, &sensor.params) - ta_shift;
+        ::calculate_to(sensor.frame->words, &sensor.params, emissivity, sensor.tr, region, sensor.converted->values);
+        sensor.has_new_frame = false;
+    }, "convert sensor");
+}
+
+int SensorArray::correct_bad_pixels() {
+    pool->run(sensors.size(), [this](size_t i) {
+        Sensor &sensor = *sensors[i];
+        sensor.new_defects = 0;
+        // Skipped sensors and those without a free slot have no new frame, and the published one is never written
+        // again.
+        if (!sensor.converted) {
+            return;
+        }
+        sensor.new_defects = sensor.health.update(sensor.converted->values);
+        sensor.health.correct(sensor.converted->values);
+        sensor.to = std::move(sensor.converted);
+    }, "correct sensor");
+    int new_defects = 0;
+    for (auto &sensor : sensors) {
+        new_defects += sensor->new_defects;
+    }
+    return new_defects;
+}
@@ -0,0 +1,148 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_SENSORARRAY_H
+#define THERMALCAM_SENSORARRAY_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <MLX90640_API.h>
+#include "FramePool.h"
+#include "LinkHealth.h"
+#include "PixelHealth.h"
+#include "SensorModel.h"
+#include "WorkerPool.h"
+
+// One sensor of the array, with its own calibration and buffers.
+struct Sensor {
+    // Slots per frame pool: the current frame, the one being produced, and frames held by consumers such as the
+    // previous frame of each subpage in the motion detector.
+    static const int POOL_SLOTS = 8;
+
+    // Linux I2C bus number (/dev/i2c-<bus>) and 7 bit slave address.
+    int bus;
+    uint8_t address;
+    uint16_t eeprom[SensorModel::EEPROM_WORDS];
+    paramsMLX90640 params;
+    // Control register value that was last written.
+    uint16_t control_register;
+    // Every new raw and To frame gets a slot of its own. A published frame is never written again, so consumers can
+    // keep a reference to it without copying.
+    FramePool<RawFrame> raw_frames{POOL_SLOTS};
+    FramePool<ToFrame> to_frames{POOL_SLOTS};
+    // Last valid raw frame, its read timing and the result of the last bus access.
+    FramePool<RawFrame>::Ref frame;
+    timingMLX90640 timing;
+    int result;
+    // Frame as it is read. It is copied to frame only when it passes validation.
+    uint16_t read_buffer[SensorModel::FRAME_WORDS];
+    // Polling state: new data is expected since wait_start [ns], and was seen at data_ready [ns].
+    bool is_waiting;
+    bool is_data_ready;
+    uint64_t wait_start;
+    uint64_t data_ready;
+    // True when the last acquire() delivered a valid frame.
+    bool is_valid;
+    // True while frame holds a frame that calculate_to() has not converted yet.
+    bool has_new_frame;
+    // Frame validation, bus recovery and their counters.
+    LinkHealth link;
+    // Reflected temperature and converted temperatures of the last frame.
+    float tr;
+    FramePool<ToFrame>::Ref to;
+    // Frame converted by calculate_to(). It is published to to after the defect pixels are corrected in it.
+    FramePool<ToFrame>::Ref converted;
+    // Defect map and correction of the pixels, and the number of defects found in the last frame.
+    PixelHealth health;
+    int new_defects;
+};
+
+
+// Set of sensors on one or more I2C buses. Buses are accessed concurrently, the sensors on one bus one after another.
+// Conversion runs one sensor per core.
+class SensorArray {
+
+public:
+    SensorArray();
+
+    void add(int bus, uint8_t address);
+
+    size_t size() const { return sensors.size(); }
+
+    Sensor &operator[](size_t i) { return *sensors[i]; }
+
+    const Sensor &operator[](size_t i) const { return *sensors[i]; }
+
+    // Dumps the EEPROM and extracts the parameters of all sensors. The control register base value is the power-on
+    // value from the EEPROM.
+    bool init();
+
+    // Extracts the parameters from the EEPROM that was filled in by the caller, without accessing the bus.
+    bool init_from_eeprom();
+
+    // Loads the EEPROM defect lists into the pixel health monitors, optionally with runtime defect detection.
+    void init_pixel_health(bool chess, bool detect);
+
+    // Composes config on top of the control register of every sensor and writes it in a single transaction.
+    bool configure(const configMLX90640 &config);
+
+    // Starts the measurement of sub_page on all working sensors in step mode.
+    void start_measurement(uint8_t sub_page);
+
+    // Polls the data ready bit of the sensors that have no new data yet, without blocking. True when all working
+    // sensors have new data. A sensor without new data for DATA_TIMEOUT_NANOS is marked failed, and failed sensors
+    // are recovered here when their next attempt is due.
+    bool poll(bool triggered);
+
+    // Reads the new frame of every sensor that has one: the next free-running frame, or the result of the triggered
+    // measurement of sub_page when triggered is set. A sensor whose frame is corrupt keeps its last valid frame.
+    // Returns false when no sensor delivered a valid frame.
+    bool acquire(const readoutMLX90640 *readout, bool triggered, uint8_t sub_page);
+
+    // Number of sensors that are failed and waiting for recovery.
+    size_t failed() const;
+
+    // Earliest wait start, and latest data ready and read done of the valid frames of the last acquire().
+    timingMLX90640 timing() const;
+
+    // Converts the region of the new frames of the valid sensors to temperatures, tr = Ta - ta_shift, into new slots
+    // that are not published yet. The other sensors keep their last temperatures, as do the pixels outside region.
+    void calculate_to(float emissivity, float ta_shift, const readoutMLX90640 &region);
+
+    // Updates the defect maps, corrects the defect pixels in the frames converted by calculate_to() and publishes
+    // them. Returns the number of new defects.
+    int correct_bad_pixels();
+
+private:
+    const uint64_t DATA_TIMEOUT_NANOS = 2000000000;
+    // The data ready bit is polled before a frame is read, so reading never has to wait long.
+    const uint32_t READ_TIMEOUT_MICROS = 20000;
+
+    // Reopens the bus, checks that the sensor responds and writes the control register again if it was reset.
+    static void recover(Sensor &sensor, bool triggered);
+
+    // Runs fn for every sensor, concurrently per bus and in order within a bus. Every bus and every call of fn is
+    // traced, the latter as a span called name.
+    template<typename Fn>
+    void for_each_bus(const char *name, Fn fn);
+
+    std::vector<std::unique_ptr<Sensor>> sensors;
+    // Sensor indices per bus.
+    std::vector<std::vector<size_t>> buses;
+    std::unique_ptr<WorkerPool> pool;
+};
+
+#endif //THERMALCAM_SENSORARRAY_H
@@ -0,0 +1,48 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_SENSORMODEL_H
+#define THERMALCAM_SENSORMODEL_H
+
+#include <cstdint>
+#include <MLX90640_API.h>
+
+// Geometry and frame layout of the sensor, in one place. The sizes come from the Melexis API, which reads the RAM
+// and the EEPROM with them.
+struct SensorModel {
+    static constexpr int COLUMNS = MLX90640_COLUMNS;
+    static constexpr int ROWS = MLX90640_ROWS;
+    static constexpr int PIXELS = MLX90640_PIXELS;
+    // Frame layout: pixels, auxiliary data (Ta, Vdd, gain, compensation pixels), then the control register and the
+    // subpage number.
+    static constexpr int AUX_OFFSET = PIXELS;
+    static constexpr int CONTROL_WORD = MLX90640_RAM_WORDS;
+    static constexpr int SUB_PAGE_WORD = CONTROL_WORD + 1;
+    static constexpr int FRAME_WORDS = MLX90640_FRAME_WORDS;
+    static constexpr int EEPROM_WORDS = MLX90640_EEPROM_WORDS;
+};
+
+static_assert(SensorModel::SUB_PAGE_WORD + 1 == SensorModel::FRAME_WORDS, "The frame ends with the subpage number");
+
+// Raw frame as read from the sensor RAM, and the temperatures converted from it.
+struct RawFrame {
+    uint16_t words[SensorModel::FRAME_WORDS];
+};
+
+struct ToFrame {
+    float values[SensorModel::PIXELS];
+};
+
+#endif //THERMALCAM_SENSORMODEL_H
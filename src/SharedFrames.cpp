@@ -0,0 +1,217 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "SharedFrames.h"
+
+namespace {
+
+size_t round_up(size_t size) {
+    return (size + 63) & ~static_cast<size_t>(63);
+}
+
+uint64_t monotonic_nanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+}
+
+SharedFramePublisher::SharedFramePublisher() : header(nullptr), size(0), next(0), begin_nanos(0), publish_nanos(0) {
+}
+
+SharedFramePublisher::~SharedFramePublisher() {
+    close();
+}
+
+bool SharedFramePublisher::open(const std::string &name, const int n_sensors, const int n_slots,
+                                const float emissivity, const float ta_shift) {
+    close();
+    if (n_sensors < 1 || n_slots < 1) {
+        return false;
+    }
+    const size_t calibration_offset = round_up(sizeof(SharedFramesHeader));
+    const size_t slots_offset = round_up(calibration_offset + n_sensors * sizeof(SharedSensorCalibration));
+    const size_t slot_size = round_up(sizeof(SharedFrameSlot) + n_sensors * sizeof(SharedSensorFrame));
+    const size_t total = slots_offset + n_slots * slot_size;
+    // Readers of the previous object keep their mapping, and see that it is no longer live.
+    shm_unlink(name.c_str());
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(total)) != 0) {
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    // Populated up front, so that publishing never faults in a page.
+    void *memory = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return false;
+    }
+    header = static_cast<SharedFramesHeader *>(memory);
+    size = total;
+    this->name = name;
+    header->version = SHARED_FRAMES_VERSION;
+    header->n_sensors = static_cast<uint32_t>(n_sensors);
+    header->n_slots = static_cast<uint32_t>(n_slots);
+    header->slot_size = static_cast<uint32_t>(slot_size);
+    header->calibration_offset = static_cast<uint32_t>(calibration_offset);
+    header->slots_offset = static_cast<uint32_t>(slots_offset);
+    header->columns = SensorModel::COLUMNS;
+    header->rows = SensorModel::ROWS;
+    header->frame_words = SensorModel::FRAME_WORDS;
+    header->eeprom_words = SensorModel::EEPROM_WORDS;
+    header->emissivity = emissivity;
+    header->ta_shift = ta_shift;
+    header->published.store(0, std::memory_order_relaxed);
+    header->is_live.store(1, std::memory_order_relaxed);
+    header->magic.store(SHARED_FRAMES_MAGIC, std::memory_order_release);
+    next = 0;
+    publish_nanos = 0;
+    return true;
+}
+
+void SharedFramePublisher::close() {
+    if (header == nullptr) {
+        return;
+    }
+    header->is_live.store(0, std::memory_order_release);
+    munmap(header, size);
+    shm_unlink(name.c_str());
+    header = nullptr;
+    size = 0;
+}
+
+SharedSensorCalibration &SharedFramePublisher::calibration(const int sensor) {
+    auto *base = reinterpret_cast<uint8_t *>(header) + header->calibration_offset;
+    return reinterpret_cast<SharedSensorCalibration *>(base)[sensor];
+}
+
+SharedFrameSlot *SharedFramePublisher::begin() {
+    begin_nanos = monotonic_nanos();
+    auto *slot = reinterpret_cast<SharedFrameSlot *>(reinterpret_cast<uint8_t *>(header) + header->slots_offset +
+                                                     (next % header->n_slots) * header->slot_size);
+    slot->sequence.store(2 * next + 1, std::memory_order_relaxed);
+    // Readers that see any of the new data also see the odd sequence.
+    std::atomic_thread_fence(std::memory_order_release);
+    return slot;
+}
+
+void SharedFramePublisher::commit(SharedFrameSlot *slot) {
+    slot->sequence.store(2 * next + 2, std::memory_order_release);
+    next++;
+    header->published.store(next, std::memory_order_release);
+    publish_nanos += monotonic_nanos() - begin_nanos;
+}
+
+void SharedFramePublisher::write(FILE *out) const {
+    if (header == nullptr) {
+        return;
+    }
+    fprintf(out, "Shared frames: %llu published to %s, %.1f us per frame, %zu kB\n",
+            static_cast<unsigned long long>(next), name.c_str(), next > 0 ? publish_nanos * 1e-3 / next : 0.0,
+            size / 1024);
+}
+
+SharedFrameReader::SharedFrameReader() : header(nullptr), size(0) {
+}
+
+SharedFrameReader::~SharedFrameReader() {
+    close();
+}
+
+bool SharedFrameReader::open(const std::string &name) {
+    close();
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st = {};
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SharedFramesHeader)) {
+        ::close(fd);
+        return false;
+    }
+    void *memory = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    header = static_cast<const SharedFramesHeader *>(memory);
+    size = static_cast<size_t>(st.st_size);
+    const SharedFramesHeader &h = *header;
+    const bool is_valid = h.magic.load(std::memory_order_acquire) == SHARED_FRAMES_MAGIC &&
+                          h.version == SHARED_FRAMES_VERSION && h.columns == SensorModel::COLUMNS &&
+                          h.rows == SensorModel::ROWS && h.frame_words == SensorModel::FRAME_WORDS &&
+                          h.eeprom_words == SensorModel::EEPROM_WORDS && h.n_slots > 0 &&
+                          h.slot_size >= sizeof(SharedFrameSlot) + h.n_sensors * sizeof(SharedSensorFrame) &&
+                          h.calibration_offset + h.n_sensors * sizeof(SharedSensorCalibration) <= h.slots_offset &&
+                          h.slots_offset + static_cast<size_t>(h.n_slots) * h.slot_size <= size;
+    if (!is_valid) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void SharedFrameReader::close() {
+    if (header == nullptr) {
+        return;
+    }
+    munmap(const_cast<SharedFramesHeader *>(header), size);
+    header = nullptr;
+    size = 0;
+}
+
+const SharedSensorCalibration &SharedFrameReader::calibration(const int sensor) const {
+    const auto *base = reinterpret_cast<const uint8_t *>(header) + header->calibration_offset;
+    return reinterpret_cast<const SharedSensorCalibration *>(base)[sensor];
+}
+
+const SharedFrameSlot *SharedFrameReader::slot(const uint64_t n) const {
+    return reinterpret_cast<const SharedFrameSlot *>(reinterpret_cast<const uint8_t *>(header) +
+                                                     header->slots_offset + (n % header->n_slots) * header->slot_size);
+}
+
+const SharedFrameSlot *SharedFrameReader::begin_read(const uint64_t n) const {
+    const SharedFrameSlot *s = slot(n);
+    if (s->sequence.load(std::memory_order_acquire) != 2 * n + 2) {
+        return nullptr;
+    }
+    return s;
+}
+
+bool SharedFrameReader::end_read(const SharedFrameSlot *slot, const uint64_t n) const {
+    // The data loads complete before the sequence is checked again.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot->sequence.load(std::memory_order_relaxed) == 2 * n + 2;
+}
+
+bool SharedFrameReader::copy(const uint64_t n, void *buffer) const {
+    const SharedFrameSlot *s = begin_read(n);
+    if (s == nullptr) {
+        return false;
+    }
+    memcpy(buffer, s, header->slot_size);
+    return end_read(s, n);
+}
@@ -0,0 +1,188 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_SHAREDFRAMES_H
+#define THERMALCAM_SHAREDFRAMES_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "SensorModel.h"
+
+// Shared memory layout (POSIX shm object, native byte order, all offsets in bytes from the start):
+//   SharedFramesHeader                              layout, conversion parameters and the number of published frames
+//   SharedSensorCalibration[n_sensors]              at calibration_offset, EEPROM dump of every sensor
+//   slot[n_slots]                                   at slots_offset, slot_size bytes apart, each:
+//     SharedFrameSlot                               sequence number, time stamps and measurement result
+//     SharedSensorFrame[n_sensors]                  raw frame, reflected temperature and To of every sensor
+// Frame n is written to slot n % n_slots. Every slot is a seqlock: its sequence is 2 n + 1 while frame n is written
+// and 2 n + 2 when it is complete. A reader reads a slot in place and afterwards checks that the sequence did not
+// change; if it did, the writer lapped the reader and what it read is discarded. The writer never waits for readers.
+#define SHARED_FRAMES_MAGIC 0x46534354u
+#define SHARED_FRAMES_VERSION 1
+
+// Flags of a frame.
+#define SHARED_FRAME_MEASURING 1u
+#define SHARED_FRAME_TEST_PATTERN 2u
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "The seqlock needs lock-free 64 bit atomics, which are address free");
+
+struct SharedFramesHeader {
+    // Set to SHARED_FRAMES_MAGIC when the header is complete.
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    // 1 while the camera publishes, 0 after it closed the object. A restarted camera creates a new object, so
+    // readers of a closed object open the name again.
+    std::atomic<uint32_t> is_live;
+    uint32_t n_sensors;
+    uint32_t n_slots;
+    uint32_t slot_size;
+    uint32_t calibration_offset;
+    uint32_t slots_offset;
+    // Geometry of a sensor: pixels per row and rows as the sensor reads them out, raw frame and EEPROM size in words.
+    uint32_t columns;
+    uint32_t rows;
+    uint32_t frame_words;
+    uint32_t eeprom_words;
+    // Parameters of the To conversion, tr = Ta - ta_shift.
+    float emissivity;
+    float ta_shift;
+    // Number of frames published, the latest is published - 1. On its own cache line, the writer updates it.
+    alignas(64) std::atomic<uint64_t> published;
+};
+
+struct SharedSensorCalibration {
+    // Linux I2C bus number and 7 bit address of the sensor.
+    int32_t bus;
+    int32_t address;
+    uint16_t eeprom[SensorModel::EEPROM_WORDS];
+};
+
+struct alignas(64) SharedFrameSlot {
+    std::atomic<uint64_t> sequence;
+    // Frame number of the camera and the moment its data ready bit was seen, and when it was published, in
+    // nanoseconds of CLOCK_MONOTONIC.
+    uint64_t frame;
+    uint64_t data_ready;
+    uint64_t published_nanos;
+    uint32_t sub_page;
+    uint32_t refresh_rate;
+    uint32_t flags;
+    // Number of pixels in the skin temperature range, their mean, and the smoothed mean that is shown. The means are
+    // -1 when out of range.
+    uint32_t measured_pixels;
+    float mean_temp;
+    float mean_temp_lpf;
+};
+
+struct SharedSensorFrame {
+    // Reflected temperature of the conversion, and whether the sensor delivered this frame.
+    float tr;
+    uint32_t is_valid;
+    uint16_t raw[SensorModel::FRAME_WORDS];
+    float to[SensorModel::PIXELS];
+};
+
+
+// Publishes the frames of the camera into a shared memory ring. Publishing copies the frame into the next slot,
+// without locks or system calls.
+class SharedFramePublisher {
+
+public:
+    SharedFramePublisher();
+
+    virtual ~SharedFramePublisher();
+
+    // Creates the shared memory object name, e.g. "/thermalcam", replacing one that is left over. The calibration
+    // has to be filled in before the first frame is published.
+    bool open(const std::string &name, int n_sensors, int n_slots, float emissivity, float ta_shift);
+
+    void close();
+
+    bool is_open() const { return header != nullptr; }
+
+    SharedSensorCalibration &calibration(int sensor);
+
+    // Returns the slot of the next frame, to be filled in and then committed. The sequence is managed here.
+    SharedFrameSlot *begin();
+
+    static SharedSensorFrame *sensor_frame(SharedFrameSlot *slot, int sensor) {
+        return reinterpret_cast<SharedSensorFrame *>(slot + 1) + sensor;
+    }
+
+    void commit(SharedFrameSlot *slot);
+
+    // Writes the number of published frames and the time per frame.
+    void write(FILE *out) const;
+
+private:
+    SharedFramesHeader *header;
+    size_t size;
+    std::string name;
+    uint64_t next;
+    uint64_t begin_nanos;
+    uint64_t publish_nanos;
+};
+
+
+// Maps the shared memory ring of a camera read-only. The frames are read in place, without copies, and any number of
+// readers can follow the ring without affecting the camera or each other.
+class SharedFrameReader {
+
+public:
+    SharedFrameReader();
+
+    virtual ~SharedFrameReader();
+
+    // Opens the object and checks its layout. False when it does not exist (yet) or does not match this build.
+    bool open(const std::string &name);
+
+    void close();
+
+    bool is_open() const { return header != nullptr; }
+
+    // False when the camera closed the object.
+    bool is_live() const { return header->is_live.load(std::memory_order_acquire) != 0; }
+
+    const SharedFramesHeader &layout() const { return *header; }
+
+    const SharedSensorCalibration &calibration(int sensor) const;
+
+    // Number of frames published so far. Frames before published() - n_slots are overwritten.
+    uint64_t published() const { return header->published.load(std::memory_order_acquire); }
+
+    // Returns the slot of frame n to read in place, or nullptr when it is not published yet or already overwritten.
+    // Everything read from it is only valid if end_read() returns true afterwards.
+    const SharedFrameSlot *begin_read(uint64_t n) const;
+
+    bool end_read(const SharedFrameSlot *slot, uint64_t n) const;
+
+    static const SharedSensorFrame *sensor_frame(const SharedFrameSlot *slot, int sensor) {
+        return reinterpret_cast<const SharedSensorFrame *>(slot + 1) + sensor;
+    }
+
+    // Copies frame n to buffer, which holds layout().slot_size bytes. False when it is not available or was
+    // overwritten while copying.
+    bool copy(uint64_t n, void *buffer) const;
+
+private:
+    const SharedFrameSlot *slot(uint64_t n) const;
+
+    const SharedFramesHeader *header;
+    size_t size;
+};
+
+#endif //THERMALCAM_SHAREDFRAMES_H
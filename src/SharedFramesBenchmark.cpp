@@ -0,0 +1,262 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+// Throughput of the shared memory frame ring: one writer publishes synthetic frames while reader processes follow
+// the ring, like the logging and analytics processes next to the camera. With --attach, follows a running camera.
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "SharedFrames.h"
+
+namespace {
+
+uint64_t monotonic_nanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+struct ReadStats {
+    uint64_t frames = 0;
+    // Frames overwritten before they were read, and frames overwritten while they were read.
+    uint64_t lost = 0;
+    uint64_t torn = 0;
+    uint64_t latency_sum = 0;
+    uint64_t latency_max = 0;
+    float mean_temp = -1.0f;
+    // Keeps the reads of the To values from being optimized away.
+    double to_sum = 0.0;
+};
+
+// Reads frame n in place: the mean To of all sensors, as a consumer would use it, and the time since publishing.
+bool read_frame(const SharedFrameReader &reader, const uint64_t n, ReadStats &stats) {
+    const SharedFrameSlot *slot = reader.begin_read(n);
+    if (slot == nullptr) {
+        stats.lost++;
+        return false;
+    }
+    const int n_sensors = static_cast<int>(reader.layout().n_sensors);
+    float sum = 0.0f;
+    for (int s = 0; s < n_sensors; s++) {
+        const float *to = SharedFrameReader::sensor_frame(slot, s)->to;
+        for (int i = 0; i < SensorModel::PIXELS; i++) {
+            sum += to[i];
+        }
+    }
+    const uint64_t published_nanos = slot->published_nanos;
+    const float mean_temp = slot->mean_temp_lpf;
+    if (!reader.end_read(slot, n)) {
+        stats.torn++;
+        return false;
+    }
+    const uint64_t latency = monotonic_nanos() - published_nanos;
+    stats.frames++;
+    stats.latency_sum += latency;
+    stats.latency_max = std::max(stats.latency_max, latency);
+    stats.mean_temp = mean_temp;
+    stats.to_sum += sum;
+    return true;
+}
+
+// Follows the ring until the writer closes it or the time is up. Frames that fall out of the ring are skipped.
+ReadStats follow(const SharedFrameReader &reader, const uint64_t deadline, const bool is_polling) {
+    ReadStats stats;
+    uint64_t n = reader.published();
+    while (monotonic_nanos() < deadline) {
+        const uint64_t published = reader.published();
+        if (n == published) {
+            if (!reader.is_live()) {
+                break;
+            }
+            if (is_polling) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            continue;
+        }
+        const uint64_t oldest = published > reader.layout().n_slots ? published - reader.layout().n_slots : 0;
+        if (n < oldest) {
+            stats.lost += oldest - n;
+            n = oldest;
+        }
+        read_frame(reader, n, stats);
+        n++;
+    }
+    return stats;
+}
+
+void print_stats(const char *who, const ReadStats &stats, const double seconds, const size_t frame_bytes) {
+    printf("%s: %llu frames, %.0f frames/s, %.1f MB/s, %llu lost, %llu torn, latency mean %.1f us max %.1f us\n", who,
+           static_cast<unsigned long long>(stats.frames), stats.frames / seconds,
+           stats.frames * frame_bytes / seconds * 1e-6, static_cast<unsigned long long>(stats.lost),
+           static_cast<unsigned long long>(stats.torn),
+           stats.frames > 0 ? stats.latency_sum * 1e-3 / stats.frames : 0.0, stats.latency_max * 1e-3);
+}
+
+int attach(const std::string &name, const double seconds) {
+    SharedFrameReader reader;
+    if (!reader.open(name)) {
+        fprintf(stderr, "Unable to open %s\n", name.c_str());
+        return EXIT_FAILURE;
+    }
+    printf("%s: %u sensors, %u slots of %u bytes, emissivity %.2f, %llu frames published\n", name.c_str(),
+           reader.layout().n_sensors, reader.layout().n_slots, reader.layout().slot_size, reader.layout().emissivity,
+           static_cast<unsigned long long>(reader.published()));
+    const uint64_t begin = monotonic_nanos();
+    const ReadStats stats = follow(reader, begin + static_cast<uint64_t>(seconds * 1e9), false);
+    const double elapsed = (monotonic_nanos() - begin) * 1e-9;
+    print_stats("reader", stats, elapsed, reader.layout().slot_size);
+    if (stats.mean_temp > 0.0f) {
+        printf("Last skin temperature: %.1f C\n", stats.mean_temp);
+    }
+    return EXIT_SUCCESS;
+}
+
+int benchmark(const int n_readers, const double seconds, const int n_sensors, const int n_slots, const int rate) {
+    const std::string name = "/ThermalCamera_benchmark_" + std::to_string(getpid());
+    SharedFramePublisher publisher;
+    if (!publisher.open(name, n_sensors, n_slots, 0.99f, 6.0f)) {
+        fprintf(stderr, "Unable to create %s\n", name.c_str());
+        return EXIT_FAILURE;
+    }
+    for (int s = 0; s < n_sensors; s++) {
+        SharedSensorCalibration &calibration = publisher.calibration(s);
+        calibration.bus = 1;
+        calibration.address = 0x33 + s;
+        memset(calibration.eeprom, 0, sizeof(calibration.eeprom));
+    }
+    const uint64_t begin = monotonic_nanos();
+    const uint64_t deadline = begin + static_cast<uint64_t>(seconds * 1e9);
+    std::vector<pid_t> readers;
+    for (int r = 0; r < n_readers; r++) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            SharedFrameReader reader;
+            if (!reader.open(name)) {
+                fprintf(stderr, "Reader %d: unable to open %s\n", r, name.c_str());
+                _exit(EXIT_FAILURE);
+            }
+            const ReadStats stats = follow(reader, deadline + 1000000000ull, true);
+            const std::string who = "reader " + std::to_string(r);
+            print_stats(who.c_str(), stats, (monotonic_nanos() - begin) * 1e-9, reader.layout().slot_size);
+            fflush(stdout);
+            _exit(EXIT_SUCCESS);
+        }
+        if (pid > 0) {
+            readers.push_back(pid);
+        }
+    }
+    // The camera copies its frames from the frame pools; the same copy is measured here.
+    std::vector<SharedSensorFrame> source(n_sensors);
+    for (SharedSensorFrame &frame : source) {
+        frame.tr = 23.0f;
+        frame.is_valid = 1;
+        for (int i = 0; i < SensorModel::FRAME_WORDS; i++) {
+            frame.raw[i] = static_cast<uint16_t>(i);
+        }
+        std::fill(frame.to, frame.to + SensorModel::PIXELS, 30.0f);
+    }
+    const uint64_t period = rate > 0 ? 1000000000ull / rate : 0;
+    uint64_t frames = 0;
+    uint64_t now = monotonic_nanos();
+    while (now < deadline) {
+        SharedFrameSlot *slot = publisher.begin();
+        slot->frame = frames;
+        slot->data_ready = now;
+        slot->sub_page = static_cast<uint32_t>(frames & 1u);
+        slot->refresh_rate = static_cast<uint32_t>(rate);
+        slot->flags = SHARED_FRAME_TEST_PATTERN;
+        slot->measured_pixels = SensorModel::PIXELS;
+        slot->mean_temp = 30.0f;
+        slot->mean_temp_lpf = 30.0f;
+        for (int s = 0; s < n_sensors; s++) {
+            memcpy(SharedFramePublisher::sensor_frame(slot, s), &source[s], sizeof(SharedSensorFrame));
+        }
+        slot->published_nanos = monotonic_nanos();
+        publisher.commit(slot);
+        frames++;
+        if (period > 0) {
+            std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+                    std::chrono::nanoseconds(begin + frames * period)));
+        }
+        now = monotonic_nanos();
+    }
+    const double elapsed = (now - begin) * 1e-9;
+    const size_t frame_bytes = sizeof(SharedFrameSlot) + n_sensors * sizeof(SharedSensorFrame);
+    printf("writer: %llu frames, %.0f frames/s, %.1f MB/s, %d readers\n", static_cast<unsigned long long>(frames),
+           frames / elapsed, frames * frame_bytes / elapsed * 1e-6, n_readers);
+    publisher.write(stdout);
+    fflush(stdout);
+    publisher.close();
+    for (const pid_t pid : readers) {
+        waitpid(pid, nullptr, 0);
+    }
+    return EXIT_SUCCESS;
+}
+
+void print_usage(const char *program) {
+    printf("Usage: %s [options]\n", program);
+    printf("  --readers <n>    Reader processes (default 2).\n");
+    printf("  --seconds <s>    Duration (default 5).\n");
+    printf("  --sensors <n>    Sensors per frame (default 1).\n");
+    printf("  --slots <n>      Slots of the ring (default 16).\n");
+    printf("  --rate <hz>      Publish at <hz> frames/s instead of as fast as possible.\n");
+    printf("  --attach <name>  Follow the ring of a running camera, e.g. /thermalcam, instead.\n");
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    int n_readers = 2;
+    double seconds = 5.0;
+    int n_sensors = 1;
+    int n_slots = 16;
+    int rate = 0;
+    std::string attach_name;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--readers" && has_value) {
+            n_readers = atoi(argv[++i]);
+        } else if (arg == "--seconds" && has_value) {
+            seconds = atof(argv[++i]);
+        } else if (arg == "--sensors" && has_value) {
+            n_sensors = atoi(argv[++i]);
+        } else if (arg == "--slots" && has_value) {
+            n_slots = atoi(argv[++i]);
+        } else if (arg == "--rate" && has_value) {
+            rate = atoi(argv[++i]);
+        } else if (arg == "--attach" && has_value) {
+            attach_name = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (n_readers < 0 || seconds <= 0.0 || n_sensors < 1 || n_slots < 1 || rate < 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!attach_name.empty()) {
+        return attach(attach_name, seconds);
+    }
+    return benchmark(n_readers, seconds, n_sensors, n_slots, rate);
+}
@@ -0,0 +1,244 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include "SpriteAtlas.h"
+
+SpriteAtlas::SpriteAtlas() : white(-1), texture(nullptr), texture_width(0), texture_height(0) {
+}
+
+SpriteAtlas::~SpriteAtlas() {
+    clean();
+}
+
+int SpriteAtlas::add(SDL_Surface *surface) {
+    if (surface == nullptr || surface->w > ATLAS_WIDTH - 2 * BORDER) {
+        return -1;
+    }
+    SDL_Surface *copy = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+    if (copy == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_ConvertSurfaceFormat() Failed: %s\n", SDL_GetError());
+        return -1;
+    }
+    surfaces.push_back(copy);
+    rects.push_back({0, 0, copy->w, copy->h});
+    return static_cast<int>(surfaces.size()) - 1;
+}
+
+bool SpriteAtlas::add_font(TTF_Font *font) {
+    if (font == nullptr) {
+        return false;
+    }
+    Font entry = {font, TTF_FontHeight(font), {}, {}};
+    std::fill(entry.glyphs, entry.glyphs + 256, -1);
+    const SDL_Color white_color = {255, 255, 255, 255};
+    for (int c = 32; c < 256; c++) {
+        // Printable ASCII and the degree sign of the temperature label.
+        if (c > 126 && c != 0xB0) {
+            continue;
+        }
+        // SDL_ttf reads the text of TTF_RenderText_* as Latin-1.
+        const char text[2] = {static_cast<char>(c), '\0'};
+        int width, height;
+        if (TTF_SizeText(font, text, &width, &height) != 0) {
+            continue;
+        }
+        entry.advances[c] = width;
+        SDL_Surface *glyph = TTF_RenderText_Blended(font, text, white_color);
+        if (glyph != nullptr) {
+            entry.glyphs[c] = add(glyph);
+            SDL_FreeSurface(glyph);
+        }
+    }
+    fonts.push_back(entry);
+    return true;
+}
+
+bool SpriteAtlas::build(SDL_Renderer *renderer) {
+    SDL_Surface *pixel = SDL_CreateRGBSurfaceWithFormat(0, 1, 1, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (pixel == nullptr) {
+        return false;
+    }
+    *static_cast<uint32_t *>(pixel->pixels) = 0xFFFFFFFF;
+    white = add(pixel);
+    SDL_FreeSurface(pixel);
+
+    // Shelf packing, tallest sprites first.
+    std::vector<int> order(surfaces.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return rects[a].h > rects[b].h; });
+    int x = 0;
+    int y = 0;
+    int shelf_height = 0;
+    for (const int i : order) {
+        const int w = rects[i].w + 2 * BORDER;
+        const int h = rects[i].h + 2 * BORDER;
+        if (x + w > ATLAS_WIDTH) {
+            x = 0;
+            y += shelf_height;
+            shelf_height = 0;
+        }
+        rects[i].x = x + BORDER;
+        rects[i].y = y + BORDER;
+        x += w;
+        shelf_height = std::max(shelf_height, h);
+    }
+    texture_width = ATLAS_WIDTH;
+    texture_height = y + shelf_height;
+
+    SDL_Surface *atlas = SDL_CreateRGBSurfaceWithFormat(0, texture_width, texture_height, 32,
+                                                        SDL_PIXELFORMAT_ARGB8888);
+    if (atlas == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_CreateRGBSurface() Failed: %s\n", SDL_GetError());
+        return false;
+    }
+    memset(atlas->pixels, 0, atlas->pitch * atlas->h);
+    for (size_t i = 0; i < surfaces.size(); i++) {
+        const SDL_Surface *src = surfaces[i];
+        const SDL_Rect &r = rects[i];
+        auto *dst = static_cast<uint8_t *>(atlas->pixels);
+        for (int row = -BORDER; row < r.h + BORDER; row++) {
+            const int src_row = std::min(std::max(row, 0), r.h - 1);
+            const auto *in = reinterpret_cast<const uint32_t *>(static_cast<const uint8_t *>(src->pixels) +
+                                                                src_row * src->pitch);
+            auto *out = reinterpret_cast<uint32_t *>(dst + (r.y + row) * atlas->pitch) + r.x;
+            memcpy(out, in, r.w * sizeof(uint32_t));
+            for (int b = 1; b <= BORDER; b++) {
+                out[-b] = in[0];
+                out[r.w - 1 + b] = in[r.w - 1];
+            }
+        }
+    }
+    texture = SDL_CreateTextureFromSurface(renderer, atlas);
+    SDL_FreeSurface(atlas);
+    if (texture == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_CreateTexture() Failed: %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Sprite atlas: %zu sprites in %dx%d", surfaces.size(), texture_width,
+                texture_height);
+    for (SDL_Surface *surface : surfaces) {
+        SDL_FreeSurface(surface);
+    }
+    surfaces.clear();
+    quads.reserve(RESERVED_QUADS);
+    vertices.reserve(RESERVED_QUADS * 4);
+    indices.reserve(RESERVED_QUADS * 6);
+    return true;
+}
+
+void SpriteAtlas::clean() {
+    for (SDL_Surface *surface : surfaces) {
+        SDL_FreeSurface(surface);
+    }
+    surfaces.clear();
+    if (texture != nullptr) {
+        SDL_DestroyTexture(texture);
+        texture = nullptr;
+    }
+    quads.clear();
+}
+
+void SpriteAtlas::draw(const int sprite, const SDL_Rect &target, const SDL_Color color) {
+    if (texture == nullptr || sprite < 0 || sprite >= static_cast<int>(rects.size())) {
+        return;
+    }
+    quads.push_back({rects[sprite], target, color});
+}
+
+void SpriteAtlas::fill(const SDL_Rect &target, const SDL_Color color) {
+    draw(white, target, color);
+}
+
+const SpriteAtlas::Font *SpriteAtlas::find(TTF_Font *font) const {
+    for (const Font &entry : fonts) {
+        if (entry.font == font) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+void SpriteAtlas::draw_text(TTF_Font *font, const char *text, SDL_Point position, const SDL_Color color) {
+    const Font *entry = find(font);
+    if (entry == nullptr) {
+        return;
+    }
+    for (const char *ch = text; *ch != '\0'; ch++) {
+        const auto c = static_cast<uint8_t>(*ch);
+        const int sprite = entry->glyphs[c];
+        if (sprite >= 0) {
+            draw(sprite, {position.x, position.y, rects[sprite].w, rects[sprite].h}, color);
+        }
+        position.x += entry->advances[c];
+    }
+}
+
+SDL_Point SpriteAtlas::text_size(TTF_Font *font, const char *text) const {
+    const Font *entry = find(font);
+    if (entry == nullptr) {
+        return {0, 0};
+    }
+    int width = 0;
+    for (const char *ch = text; *ch != '\0'; ch++) {
+        width += entry->advances[static_cast<uint8_t>(*ch)];
+    }
+    return {width, entry->height};
+}
+
+void SpriteAtlas::flush(SDL_Renderer *renderer) {
+    if (quads.empty()) {
+        return;
+    }
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    vertices.clear();
+    indices.clear();
+    vertices.reserve(quads.size() * 4);
+    indices.reserve(quads.size() * 6);
+    const float sx = 1.0f / static_cast<float>(texture_width);
+    const float sy = 1.0f / static_cast<float>(texture_height);
+    for (const Quad &q : quads) {
+        const float x0 = static_cast<float>(q.target.x);
+        const float y0 = static_cast<float>(q.target.y);
+        const float x1 = static_cast<float>(q.target.x + q.target.w);
+        const float y1 = static_cast<float>(q.target.y + q.target.h);
+        const float u0 = static_cast<float>(q.source.x) * sx;
+        const float v0 = static_cast<float>(q.source.y) * sy;
+        const float u1 = static_cast<float>(q.source.x + q.source.w) * sx;
+        const float v1 = static_cast<float>(q.source.y + q.source.h) * sy;
+        const int base = static_cast<int>(vertices.size());
+        vertices.push_back({{x0, y0}, q.color, {u0, v0}});
+        vertices.push_back({{x1, y0}, q.color, {u1, v0}});
+        vertices.push_back({{x0, y1}, q.color, {u0, v1}});
+        vertices.push_back({{x1, y1}, q.color, {u1, v1}});
+        const int quad_indices[6] = {base, base + 1, base + 2, base + 2, base + 1, base + 3};
+        indices.insert(indices.end(), quad_indices, quad_indices + 6);
+    }
+    SDL_RenderGeometry(renderer, texture, vertices.data(), static_cast<int>(vertices.size()), indices.data(),
+                       static_cast<int>(indices.size()));
+#else
+    for (const Quad &q : quads) {
+        SDL_SetTextureColorMod(texture, q.color.r, q.color.g, q.color.b);
+        SDL_SetTextureAlphaMod(texture, q.color.a);
+        SDL_RenderCopy(renderer, texture, &q.source, &q.target);
+    }
+    SDL_SetTextureColorMod(texture, 255, 255, 255);
+    SDL_SetTextureAlphaMod(texture, 255);
+#endif
+    quads.clear();
+}
@@ -0,0 +1,101 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_SPRITEATLAS_H
+#define THERMALCAM_SPRITEATLAS_H
+
+#include <vector>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+
+// The static UI art and the glyphs of the fonts, packed into one texture at startup. Sprites, text and filled
+// rectangles are queued during a frame and drawn with a single SDL_RenderGeometry call, so the UI costs one texture
+// bind and one draw call. SDL before 2.0.18 has no SDL_RenderGeometry; there every quad is copied from the atlas.
+class SpriteAtlas {
+
+public:
+    SpriteAtlas();
+
+    virtual ~SpriteAtlas();
+
+    // Adds a copy of surface and returns its sprite id. Sprites are added before build().
+    int add(SDL_Surface *surface);
+
+    // Adds the glyphs of the printable Latin-1 characters of font, rendered in white.
+    bool add_font(TTF_Font *font);
+
+    // Packs all sprites into one texture of renderer.
+    bool build(SDL_Renderer *renderer);
+
+    void clean();
+
+    // Queues a sprite stretched over target, tinted with color.
+    void draw(int sprite, const SDL_Rect &target, SDL_Color color = {255, 255, 255, 255});
+
+    void fill(const SDL_Rect &target, SDL_Color color);
+
+    // Queues text with its top left corner at position. Characters without a glyph are skipped.
+    void draw_text(TTF_Font *font, const char *text, SDL_Point position, SDL_Color color);
+
+    // Width and height of text in pixels.
+    SDL_Point text_size(TTF_Font *font, const char *text) const;
+
+    // Draws the queued quads in order and empties the queue.
+    void flush(SDL_Renderer *renderer);
+
+    int width() const { return texture_width; }
+
+    int height() const { return texture_height; }
+
+private:
+    // Width of the atlas. Sprites are placed on shelves, with a border of one pixel that repeats their edge so that
+    // linear filtering does not pick up the neighbouring sprite.
+    const int ATLAS_WIDTH = 1024;
+    const int BORDER = 1;
+    // Quads reserved at build(), enough for the UI and the performance overlay, so that queuing a frame does not
+    // allocate.
+    const size_t RESERVED_QUADS = 2048;
+
+    struct Quad {
+        SDL_Rect source;
+        SDL_Rect target;
+        SDL_Color color;
+    };
+
+    struct Font {
+        TTF_Font *font;
+        int height;
+        // Sprite id per Latin-1 character, -1 without a glyph, and the horizontal advance in pixels.
+        int glyphs[256];
+        int advances[256];
+    };
+
+    const Font *find(TTF_Font *font) const;
+
+    // ARGB8888 copies of the sprites until build(), and their place in the atlas.
+    std::vector<SDL_Surface *> surfaces;
+    std::vector<SDL_Rect> rects;
+    std::vector<Font> fonts;
+    // 1 x 1 white sprite for the filled rectangles.
+    int white;
+    SDL_Texture *texture;
+    int texture_width;
+    int texture_height;
+    std::vector<Quad> quads;
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
+};
+
+#endif //THERMALCAM_SPRITEATLAS_H
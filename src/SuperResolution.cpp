@@ -0,0 +1,322 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "SuperResolution.h"
+
+SuperResolution::SuperResolution() : current_factor(0), width(0), height(0), is_empty(true), shift{0.0f, 0.0f},
+                                     n_resets(0), current(0) {
+}
+
+void SuperResolution::configure(const int factor, const int width, const int height) {
+    current_factor = factor > 1 ? factor : 0;
+    this->width = width;
+    this->height = height;
+    reset();
+    if (!is_enabled()) {
+        return;
+    }
+    const size_t n_pixels = static_cast<size_t>(width * height);
+    const size_t n_points = static_cast<size_t>(out_width() * out_height());
+    for (int i = 0; i < 2; i++) {
+        sums[i].assign(n_points, 0.0f);
+        weights[i].assign(n_points, 0.0f);
+        box_in[i].resize(n_points);
+        coefficients[i].resize(n_points);
+        box_out[i].resize(n_points);
+    }
+    predicted.resize(n_pixels);
+    measured.resize(n_pixels);
+    mask.resize(n_pixels);
+    lower.resize(n_pixels);
+    upper.resize(n_pixels);
+    accumulated.resize(n_points);
+    mean.resize(n_points);
+    output.assign(n_points, 0.0f);
+}
+
+void SuperResolution::reset() {
+    is_empty = true;
+    shift[0] = 0.0f;
+    shift[1] = 0.0f;
+}
+
+bool SuperResolution::estimate_shift(const float *image, const uint8_t *sub_pages, const int sub_page) {
+    shift[0] = 0.0f;
+    shift[1] = 0.0f;
+    if (is_empty) {
+        return true;
+    }
+    // The samples are pixel values, which already include the area of the pixel. What a pixel would measure of the
+    // accumulated image is therefore the value at its center, between the 2 x 2 middle grid points of the pixel.
+    const int f = current_factor;
+    const int grid_width = out_width();
+    const float *s = sums[current].data();
+    const float *w = weights[current].data();
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            float sum = 0.0f;
+            bool is_covered = true;
+            for (int y = i * f + f / 2 - 1; y <= i * f + f / 2; y++) {
+                for (int x = j * f + f / 2 - 1; x <= j * f + f / 2; x++) {
+                    is_covered = is_covered && w[y * grid_width + x] > 0.0f;
+                    sum += w[y * grid_width + x] > 0.0f ? s[y * grid_width + x] / w[y * grid_width + x] : 0.0f;
+                }
+            }
+            predicted[i * width + j] = is_covered ? 0.25f * sum : NAN;
+        }
+    }
+    // Gauss-Newton on the measured pixels: image(p) = predicted(p + d), linearized around the current estimate.
+    float dx = 0.0f;
+    float dy = 0.0f;
+    for (int iteration = 0; iteration < 3; iteration++) {
+        double sxx = 0.0, sxy = 0.0, syy = 0.0, bx = 0.0, by = 0.0;
+        int n = 0;
+        for (int i = 1; i < height - 1; i++) {
+            for (int j = 1; j < width - 1; j++) {
+                const float value = image[i * width + j];
+                const float px = j + dx;
+                const float py = i + dy;
+                const int x0 = static_cast<int>(floorf(px));
+                const int y0 = static_cast<int>(floorf(py));
+                if (sub_pages[i * width + j] != sub_page || !std::isfinite(value) || x0 < 0 || y0 < 0 ||
+                    x0 >= width - 1 || y0 >= height - 1) {
+                    continue;
+                }
+                const float *p = predicted.data() + y0 * width + x0;
+                const float tx = px - x0;
+                const float ty = py - y0;
+                const float sample = (1 - ty) * ((1 - tx) * p[0] + tx * p[1]) +
+                                     ty * ((1 - tx) * p[width] + tx * p[width + 1]);
+                const float *c = predicted.data() + i * width + j;
+                const float gx = 0.5f * (c[1] - c[-1]);
+                const float gy = 0.5f * (c[width] - c[-width]);
+                const float r = value - sample;
+                if (!std::isfinite(r) || !std::isfinite(gx) || !std::isfinite(gy)) {
+                    continue;
+                }
+                sxx += gx * gx;
+                sxy += gx * gy;
+                syy += gy * gy;
+                bx += gx * r;
+                by += gy * r;
+                n++;
+            }
+        }
+        // Without texture in both directions the shift can not be measured, assume that nothing moved.
+        const double trace = sxx + syy;
+        const double det = sxx * syy - sxy * sxy;
+        if (n == 0 || trace < n * MIN_GRADIENT * MIN_GRADIENT || det < 0.01 * trace * trace) {
+            break;
+        }
+        const float step_x = static_cast<float>((syy * bx - sxy * by) / det);
+        const float step_y = static_cast<float>((sxx * by - sxy * bx) / det);
+        dx += step_x;
+        dy += step_y;
+        if (fabsf(dx) > MAX_SHIFT || fabsf(dy) > MAX_SHIFT) {
+            return false;
+        }
+        if (fabsf(step_x) < 0.01f && fabsf(step_y) < 0.01f) {
+            break;
+        }
+    }
+    shift[0] = dx;
+    shift[1] = dy;
+    return true;
+}
+
+void SuperResolution::build_taps(const float offset, const int size, Taps &taps) const {
+    const int f = current_factor;
+    taps.index.resize(static_cast<size_t>(2 * size * f));
+    taps.weight.resize(taps.index.size());
+    taps.nearest.resize(static_cast<size_t>(size * f));
+    for (int x = 0; x < size * f; x++) {
+        // Position of the grid point in sensor pixels of the current subpage.
+        const float u = (x + 0.5f) / f - 0.5f + offset;
+        const int first = static_cast<int>(floorf(u));
+        for (int k = 0; k < 2; k++) {
+            const int j = first + k;
+            const float d = u - j;
+            const bool is_inside = j >= 0 && j < size;
+            taps.index[2 * x + k] = std::min(std::max(j, 0), size - 1);
+            taps.weight[2 * x + k] = is_inside ? expf(-d * d / (2.0f * SAMPLE_SIGMA * SAMPLE_SIGMA)) : 0.0f;
+        }
+        taps.nearest[x] = std::min(std::max(static_cast<int>(lroundf(u)), 0), size - 1);
+    }
+}
+
+void SuperResolution::box_row(const float *in, float *out, const int size, const int radius) {
+    float sum = 0.0f;
+    for (int x = 0; x < std::min(radius, size); x++) {
+        sum += in[x];
+    }
+    for (int x = 0; x < size; x++) {
+        if (x + radius < size) {
+            sum += in[x + radius];
+        }
+        if (x - radius - 1 >= 0) {
+            sum -= in[x - radius - 1];
+        }
+        out[x] = sum / static_cast<float>(std::min(x + radius, size - 1) - std::max(x - radius, 0) + 1);
+    }
+}
+
+void SuperResolution::box_columns(const float *in, float *out, const int width, const int height, const int y,
+                                  const int radius) {
+    const int first = std::max(y - radius, 0);
+    const int last = std::min(y + radius, height - 1);
+    const float scale = 1.0f / static_cast<float>(last - first + 1);
+    float *__restrict row = out + y * width;
+    std::fill(row, row + width, 0.0f);
+    for (int k = first; k <= last; k++) {
+        const float *__restrict source = in + k * width;
+        for (int x = 0; x < width; x++) {
+            row[x] += source[x];
+        }
+    }
+    for (int x = 0; x < width; x++) {
+        row[x] *= scale;
+    }
+}
+
+void SuperResolution::update(const float *image, const uint8_t *sub_pages, const int sub_page, WorkerPool &pool) {
+    if (!is_enabled()) {
+        return;
+    }
+    if (!estimate_shift(image, sub_pages, sub_page)) {
+        reset();
+        n_resets++;
+    }
+    // Offset of the grid relative to the current subpage in sensor pixels. The grid moves by whole grid points, the
+    // remainder goes into the sample positions.
+    const int f = current_factor;
+    const float offset_x = -shift[0];
+    const float offset_y = -shift[1];
+    const int move_x = static_cast<int>(lroundf(offset_x * f));
+    const int move_y = static_cast<int>(lroundf(offset_y * f));
+    build_taps(offset_x - static_cast<float>(move_x) / f, width, columns);
+    build_taps(offset_y - static_cast<float>(move_y) / f, height, rows);
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            const int p = i * width + j;
+            const bool is_measured = sub_pages[p] == sub_page && std::isfinite(image[p]);
+            measured[p] = is_measured ? image[p] : 0.0f;
+            mask[p] = is_measured ? 1.0f : 0.0f;
+            float low = FLT_MAX;
+            float high = -FLT_MAX;
+            for (int y = std::max(i - 1, 0); y <= std::min(i + 1, height - 1); y++) {
+                for (int x = std::max(j - 1, 0); x <= std::min(j + 1, width - 1); x++) {
+                    if (std::isfinite(image[y * width + x])) {
+                        low = std::min(low, image[y * width + x]);
+                        high = std::max(high, image[y * width + x]);
+                    }
+                }
+            }
+            lower[p] = low - CLAMP_MARGIN;
+            upper[p] = high + CLAMP_MARGIN;
+        }
+    }
+
+    const int grid_width = out_width();
+    const int grid_height = out_height();
+    const int radius = f;
+    const int previous = current;
+    const int next = 1 - current;
+    const bool has_history = !is_empty;
+    const size_t n_bands = pool.concurrency();
+    // Accumulation, and the row means of the guided filter.
+    pool.run(n_bands, [&](size_t band) {
+        for (int y = static_cast<int>(band * grid_height / n_bands);
+             y < static_cast<int>((band + 1) * grid_height / n_bands); y++) {
+            const int source_y = y - move_y;
+            const bool is_row_inside = has_history && source_y >= 0 && source_y < grid_height;
+            const int *row_index = rows.index.data() + 2 * y;
+            const float *row_weight = rows.weight.data() + 2 * y;
+            for (int x = 0; x < grid_width; x++) {
+                const int source_x = x - move_x;
+                float sum = 0.0f;
+                float weight = 0.0f;
+                if (is_row_inside && source_x >= 0 && source_x < grid_width) {
+                    weight = weights[previous][source_y * grid_width + source_x];
+                    if (weight > 0.0f) {
+                        // Fade out the old samples, and limit them to what the sensor sees now around this point.
+                        const int p = rows.nearest[y] * width + columns.nearest[x];
+                        const float value = std::min(std::max(sums[previous][source_y * grid_width + source_x] /
+                                                              weight, lower[p]), upper[p]);
+                        weight *= DECAY;
+                        sum = value * weight;
+                    }
+                }
+                for (int l = 0; l < 2; l++) {
+                    for (int k = 0; k < 2; k++) {
+                        const int p = row_index[l] * width + columns.index[2 * x + k];
+                        const float w = row_weight[l] * columns.weight[2 * x + k];
+                        sum += w * measured[p];
+                        weight += w * mask[p];
+                    }
+                }
+                sums[next][y * grid_width + x] = sum;
+                weights[next][y * grid_width + x] = weight;
+                const float nearest = image[rows.nearest[y] * width + columns.nearest[x]];
+                accumulated[y * grid_width + x] = weight > 0.0f ? sum / weight : nearest;
+            }
+            const float *row = accumulated.data() + y * grid_width;
+            float *squares = box_out[0].data() + y * grid_width;
+            for (int x = 0; x < grid_width; x++) {
+                squares[x] = row[x] * row[x];
+            }
+            box_row(row, box_in[0].data() + y * grid_width, grid_width, radius);
+            box_row(squares, box_in[1].data() + y * grid_width, grid_width, radius);
+        }
+    }, "accumulate band");
+    // Local means and variances, the linear coefficients of the guided filter and their row means.
+    pool.run(n_bands, [&](size_t band) {
+        for (int y = static_cast<int>(band * grid_height / n_bands);
+             y < static_cast<int>((band + 1) * grid_height / n_bands); y++) {
+            box_columns(box_in[0].data(), mean.data(), grid_width, grid_height, y, radius);
+            box_columns(box_in[1].data(), box_out[1].data(), grid_width, grid_height, y, radius);
+            const float *m = mean.data() + y * grid_width;
+            float *a = box_out[0].data() + y * grid_width;
+            float *b = box_out[1].data() + y * grid_width;
+            for (int x = 0; x < grid_width; x++) {
+                const float variance = std::max(b[x] - m[x] * m[x], 0.0f);
+                a[x] = variance / (variance + GUIDE_EPSILON);
+                b[x] = (1.0f - a[x]) * m[x];
+            }
+            box_row(a, coefficients[0].data() + y * grid_width, grid_width, radius);
+            box_row(b, coefficients[1].data() + y * grid_width, grid_width, radius);
+        }
+    }, "guide band");
+    // Guided filter output. Where the coefficient a is close to 1 there is an edge, which is sharpened.
+    pool.run(n_bands, [&](size_t band) {
+        for (int y = static_cast<int>(band * grid_height / n_bands);
+             y < static_cast<int>((band + 1) * grid_height / n_bands); y++) {
+            box_columns(coefficients[0].data(), box_out[0].data(), grid_width, grid_height, y, radius);
+            box_columns(coefficients[1].data(), box_out[1].data(), grid_width, grid_height, y, radius);
+            const float *in = accumulated.data() + y * grid_width;
+            const float *m = mean.data() + y * grid_width;
+            const float *a = box_out[0].data() + y * grid_width;
+            const float *b = box_out[1].data() + y * grid_width;
+            float *out = output.data() + y * grid_width;
+            for (int x = 0; x < grid_width; x++) {
+                out[x] = a[x] * in[x] + b[x] + SHARPEN * a[x] * (in[x] - m[x]);
+            }
+        }
+    }, "filter band");
+    current = next;
+    is_empty = false;
+}
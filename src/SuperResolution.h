@@ -0,0 +1,124 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_SUPERRESOLUTION_H
+#define THERMALCAM_SUPERRESOLUTION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "WorkerPool.h"
+
+// Multi-frame super-resolution of the temperature image. Every subpage measures half of the pixels, at a slightly
+// different position when the camera or the scene moves. The global sub-pixel shift of every subpage is estimated
+// against the accumulated image, and the measured pixels are added to a grid with factor x the sensor resolution as
+// Gaussian weighted samples at their shifted positions. Older samples fade out and are clamped to the range of the
+// current neighbourhood, so that moving objects do not leave trails. The accumulated image is smoothed by a guided
+// filter, which keeps edges, and the edges are sharpened with the same filter coefficients.
+class SuperResolution {
+
+public:
+    SuperResolution();
+
+    // Prepares for width x height images. A factor below 2 disables super-resolution.
+    void configure(int factor, int width, int height);
+
+    int factor() const { return current_factor; }
+
+    bool is_enabled() const { return current_factor > 1; }
+
+    // Width and height of result().
+    int out_width() const { return width * current_factor; }
+
+    int out_height() const { return height * current_factor; }
+
+    // Adds image (width x height, row major), of which the pixels with sub_pages[i] == sub_page were measured in this
+    // subpage.
+    void update(const float *image, const uint8_t *sub_pages, int sub_page, WorkerPool &pool);
+
+    // Forgets the accumulated samples.
+    void reset();
+
+    // Super-resolved image, out_width() x out_height().
+    const float *result() const { return output.data(); }
+
+    // Shift of the last subpage relative to the accumulated image, in sensor pixels.
+    float shift_x() const { return shift[0]; }
+
+    float shift_y() const { return shift[1]; }
+
+    // Number of times the accumulated image was dropped because the motion was too large to follow.
+    size_t resets() const { return n_resets; }
+
+private:
+    // Width of the Gaussian that weights a sample by its distance to a grid point, in sensor pixels.
+    const float SAMPLE_SIGMA = 0.35f;
+    // Weight of the accumulated samples after every subpage.
+    const float DECAY = 0.9f;
+    // Accumulated values may exceed the range of the 3x3 neighbourhood in the current image by this many degrees.
+    const float CLAMP_MARGIN = 0.5f;
+    // Larger shifts, in sensor pixels, reset the accumulation.
+    const float MAX_SHIFT = 1.5f;
+    // The shift is only estimated when the image has at least this mean gradient, in degrees per sensor pixel.
+    const float MIN_GRADIENT = 0.2f;
+    // Guided filter: variance in degrees squared below which the image is smoothed, and the gain of the edges.
+    const float GUIDE_EPSILON = 0.25f;
+    const float SHARPEN = 0.5f;
+
+    // For every grid column or row: the two nearest sensor pixels and their Gaussian weights.
+    struct Taps {
+        std::vector<int> index;
+        std::vector<float> weight;
+        std::vector<int> nearest;
+    };
+
+    // Estimates the shift of image relative to the accumulated grid. Returns false when the motion is too large.
+    bool estimate_shift(const float *image, const uint8_t *sub_pages, int sub_page);
+
+    void build_taps(float offset, int size, Taps &taps) const;
+
+    // Mean over the 2 * radius + 1 window, along a row and along a column.
+    static void box_row(const float *in, float *out, int size, int radius);
+
+    static void box_columns(const float *in, float *out, int width, int height, int y, int radius);
+
+    int current_factor;
+    int width;
+    int height;
+    bool is_empty;
+    float shift[2];
+    size_t n_resets;
+    Taps columns;
+    Taps rows;
+    // Weighted sum and sum of weights of the samples, per grid point. Two sets: the grid moves every subpage.
+    std::vector<float> sums[2];
+    std::vector<float> weights[2];
+    int current;
+    // Sensor resolution: accumulated image, measured values and mask, and neighbourhood range.
+    std::vector<float> predicted;
+    std::vector<float> measured;
+    std::vector<float> mask;
+    std::vector<float> lower;
+    std::vector<float> upper;
+    // Grid resolution: accumulated image, guided filter intermediates and the result.
+    std::vector<float> accumulated;
+    std::vector<float> box_in[2];
+    std::vector<float> mean;
+    std::vector<float> coefficients[2];
+    std::vector<float> box_out[2];
+    std::vector<float> output;
+};
+
+#endif //THERMALCAM_SUPERRESOLUTION_H
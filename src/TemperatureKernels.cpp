@@ -0,0 +1,136 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <cmath>
+#include "SensorModel.h"
+#include "TemperatureKernels.h"
+
+namespace {
+
+const readoutMLX90640 FULL_FRAME = {0, 0, SensorModel::ROWS - 1, 0, SensorModel::COLUMNS - 1};
+
+// The arithmetic follows MLX90640_CalculateTo operation by operation, including its mix of float and double, so that
+// the results match the reference. Only the per frame terms are taken out of the pixel loop.
+template<bool Chess, bool CalibrationMatches>
+void calculate_region(uint16_t *frame, const paramsMLX90640 *params, const float emissivity, const float tr,
+                      const readoutMLX90640 &region, float *result) {
+    const int sub_page = frame[SensorModel::SUB_PAGE_WORD];
+    const float vdd = MLX90640_GetVdd(frame, params);
+    const float ta = MLX90640_GetTa(frame, params);
+    const float ta4 = std::pow((ta + 273.15), (double) 4);
+    const float tr4 = std::pow((tr + 273.15), (double) 4);
+    const float ta_tr = tr4 - (tr4 - ta4) / emissivity;
+
+    float alpha_corr_r[4];
+    alpha_corr_r[0] = 1 / (1 + params->ksTo[0] * 40);
+    alpha_corr_r[1] = 1;
+    alpha_corr_r[2] = (1 + params->ksTo[2] * params->ct[2]);
+    alpha_corr_r[3] = alpha_corr_r[2] * (1 + params->ksTo[3] * (params->ct[3] - params->ct[2]));
+
+    float gain = static_cast<int16_t>(frame[SensorModel::AUX_OFFSET + 10]);
+    gain = params->gainEE / gain;
+
+    const float ta_25 = ta - 25;
+    const double vdd_33 = vdd - 3.3;
+    float ir_data_cp = static_cast<int16_t>(frame[SensorModel::AUX_OFFSET + (sub_page == 0 ? 8 : 40)]);
+    ir_data_cp = ir_data_cp * gain;
+    const float cp_offset = CalibrationMatches || sub_page == 0 ? params->cpOffset[sub_page]
+                                                                : params->cpOffset[1] + params->ilChessC[0];
+    ir_data_cp = ir_data_cp - cp_offset * (1 + params->cpKta * ta_25) * (1 + params->cpKv * vdd_33);
+    const float tgc_cp = params->tgc * ir_data_cp;
+    const float tgc_cp_alpha = params->tgc * params->cpAlpha[sub_page];
+    const float ks_ta = 1 + params->KsTa * ta_25;
+    const double ks_to_1 = 1 - params->ksTo[1] * 273.15;
+
+    for (int row = region.rowStart; row <= region.rowEnd; row++) {
+        const int il_pattern = row & 1;
+        // Interleaved: the subpage is every other row. Chess: every other pixel, shifted by one on odd rows.
+        if (!Chess && il_pattern != sub_page) {
+            continue;
+        }
+        const int col_start = Chess ? region.colStart + ((region.colStart ^ sub_page ^ il_pattern) & 1)
+                                    : region.colStart;
+        const int col_step = Chess ? 2 : 1;
+        for (int col = col_start; col <= region.colEnd; col += col_step) {
+            const int pixel = row * SensorModel::COLUMNS + col;
+            float ir_data = static_cast<int16_t>(frame[pixel]);
+            ir_data = ir_data * gain;
+            ir_data = ir_data - params->offset[pixel] * (1 + params->kta[pixel] * ta_25) *
+                                (1 + params->kv[pixel] * vdd_33);
+            if (!CalibrationMatches) {
+                // Columns 1 and 3 of every group of 4 pixels were converted with the other ADC phase.
+                const int conversion_pattern = ((col & 3) == 1 ? -1 : (col & 3) == 3 ? 1 : 0) * (1 - 2 * il_pattern);
+                ir_data = ir_data + params->ilChessC[2] * (2 * il_pattern - 1) -
+                          params->ilChessC[1] * conversion_pattern;
+            }
+            ir_data = ir_data / emissivity;
+            ir_data = ir_data - tgc_cp;
+
+            const float alpha_compensated = (params->alpha[pixel] - tgc_cp_alpha) * ks_ta;
+            float sx = std::pow((double) alpha_compensated, (double) 3) * (ir_data + alpha_compensated * ta_tr);
+            sx = std::sqrt(std::sqrt(sx)) * params->ksTo[1];
+            float to = std::sqrt(std::sqrt(ir_data / (alpha_compensated * ks_to_1 + sx) + ta_tr)) - 273.15;
+            // Same as the comparison chain of the reference for sorted corner temperatures.
+            const int range = (to >= params->ct[1]) + (to >= params->ct[2]) + (to >= params->ct[3]);
+            to = std::sqrt(std::sqrt(ir_data / (alpha_compensated * alpha_corr_r[range] *
+                                                (1 + params->ksTo[range] * (to - params->ct[range]))) + ta_tr)) -
+                 273.15;
+            result[pixel] = to;
+        }
+    }
+}
+
+}
+
+template<bool Chess, bool CalibrationMatches>
+void calculate_to_specialized(uint16_t *frame, const paramsMLX90640 *params, const float emissivity, const float tr,
+                              float *result) {
+    calculate_region<Chess, CalibrationMatches>(frame, params, emissivity, tr, FULL_FRAME, result);
+}
+
+CalculateToFn select_calculate_to(const bool chess, const bool calibration_matches) {
+    if (chess) {
+        return calibration_matches ? calculate_to_specialized<true, true> : calculate_to_specialized<true, false>;
+    }
+    return calibration_matches ? calculate_to_specialized<false, true> : calculate_to_specialized<false, false>;
+}
+
+void calculate_to(uint16_t *frame, const paramsMLX90640 *params, const float emissivity, const float tr,
+                  float *result) {
+    const uint8_t mode = (frame[SensorModel::CONTROL_WORD] & 0x1000) >> 5;
+    select_calculate_to(mode != 0, mode == params->calibrationModeEE)(frame, params, emissivity, tr, result);
+}
+
+void calculate_to(uint16_t *frame, const paramsMLX90640 *params, const float emissivity, const float tr,
+                  const readoutMLX90640 &region, float *result) {
+    const uint8_t mode = (frame[SensorModel::CONTROL_WORD] & 0x1000) >> 5;
+    const bool calibration_matches = mode == params->calibrationModeEE;
+    if (mode != 0) {
+        if (calibration_matches) {
+            calculate_region<true, true>(frame, params, emissivity, tr, region, result);
+        } else {
+            calculate_region<true, false>(frame, params, emissivity, tr, region, result);
+        }
+    } else if (calibration_matches) {
+        calculate_region<false, true>(frame, params, emissivity, tr, region, result);
+    } else {
+        calculate_region<false, false>(frame, params, emissivity, tr, region, result);
+    }
+}
+
+template void calculate_to_specialized<false, false>(uint16_t *, const paramsMLX90640 *, float, float, float *);
+template void calculate_to_specialized<false, true>(uint16_t *, const paramsMLX90640 *, float, float, float *);
+template void calculate_to_specialized<true, false>(uint16_t *, const paramsMLX90640 *, float, float, float *);
+template void calculate_to_specialized<true, true>(uint16_t *, const paramsMLX90640 *, float, float, float *);
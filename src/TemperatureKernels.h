@@ -0,0 +1,44 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_TEMPERATUREKERNELS_H
+#define THERMALCAM_TEMPERATUREKERNELS_H
+
+#include <cstdint>
+#include <MLX90640_API.h>
+
+// Signature shared by MLX90640_CalculateTo and all optimized variants of it.
+typedef void (*CalculateToFn)(uint16_t *frameData, const paramsMLX90640 *params, float emissivity, float tr,
+                              float *result);
+
+// MLX90640_CalculateTo, specialized for the reading pattern and for whether that pattern matches the calibration
+// pattern in the EEPROM (calibrationModeEE). The loop only visits the pixels of the measured subpage, and the
+// interleaved/chess correction with ilChessC is compiled in only when the patterns differ.
+template<bool Chess, bool CalibrationMatches>
+void calculate_to_specialized(uint16_t *frame, const paramsMLX90640 *params, float emissivity, float tr,
+                              float *result);
+
+// Selects the specialization once, e.g. when the reading pattern is configured.
+CalculateToFn select_calculate_to(bool chess, bool calibration_matches);
+
+// Drop-in replacement of MLX90640_CalculateTo. Selects the specialization per frame from the reading pattern in the
+// control register word of the frame.
+void calculate_to(uint16_t *frame, const paramsMLX90640 *params, float emissivity, float tr, float *result);
+
+// Same, but only converts the pixels in the rows and columns of region. The other pixels of result are not written.
+void calculate_to(uint16_t *frame, const paramsMLX90640 *params, float emissivity, float tr,
+                  const readoutMLX90640 &region, float *result);
+
+#endif //THERMALCAM_TEMPERATUREKERNELS_H
@@ -13,77 +13,217 @@ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 See the License for the specific language governing permissions and
 limitations under the License.
 */
+#include <algorithm>
 #include <chrono>
+#include <cerrno>
 #include <cmath>
-#include <iomanip>
+#include <cstring>
+#include <future>
 #include <iostream>
+#include <thread>
 #include "ThermalCamera.h"
+#include "AllocationCounter.h"
 #include "constants.h"
 #include "colormap.h"
+#include "TraceRecorder.h"
 
-ThermalCamera::ThermalCamera() {
+ThermalCamera::ThermalCamera(const Options &options) : refresh_rate(options.fps),
+                                                       rate_controller(ADAPTIVE_MIN_FPS, ADAPTIVE_MAX_FPS,
+                                                                       options.adaptive_rate),
+                                                       interleaved(options.interleaved),
+                                                       perf_log_path(options.perf_log_path),
+                                                       trace_path(options.trace_path) {
+    startup_begin = now_nanos();
+    first_frame_nanos = 0;
     SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "=== ThermalCamera, Copyright 2020 Ava-X ===");
     char *base_path = SDL_GetBasePath();
     if (base_path) {
         resource_path = std::string(base_path) + "../resources";
         SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Resource path: %s\n", resource_path.c_str());
     }
-    init_sdl();
-    init_sensor();
+    readout.subPageRows = options.partial_readout && interleaved;
+    readout.rowStart = static_cast<uint8_t>(options.roi[0]);
+    readout.colStart = static_cast<uint8_t>(options.roi[1]);
+    readout.rowEnd = static_cast<uint8_t>(options.roi[2]);
+    readout.colEnd = static_cast<uint8_t>(options.roi[3]);
+    is_partial_readout = readout.subPageRows || readout.rowStart > 0 || readout.colStart > 0 ||
+                         readout.rowEnd < SensorModel::ROWS - 1 || readout.colEnd < SensorModel::COLUMNS - 1;
+    const int region_pixels = (readout.rowEnd - readout.rowStart + 1) * (readout.colEnd - readout.colStart + 1);
+    measure_area_threshold = static_cast<int>(round(region_pixels * MEASURE_AREA_FRACTION));
+    is_headless = options.headless_frames > 0 || options.check_allocations > 0;
+    is_test_pattern = is_headless && options.recordings.empty();
+    allocation_check_frames = static_cast<size_t>(options.check_allocations);
+    headless_frames = std::max(static_cast<size_t>(options.headless_frames),
+                               allocation_check_frames > 0 ? ALLOCATION_WARMUP_FRAMES + allocation_check_frames : 0);
+    is_failed = false;
+    if (allocation_check_frames > 0 && !AllocationCounter::available()) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Allocation counting is not available in this build");
+        is_failed = true;
+    }
+    framebuffer_path = options.framebuffer_path;
+    is_triggered = options.triggered && options.recordings.empty() && !is_headless;
+    is_measurement_started = false;
+    is_sensor_pending = false;
+    failed_sensors = 0;
+    if (options.partial_readout && !interleaved) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Partial readout of subpage rows requires --interleaved");
+    }
+    needs_redraw = true;
+    tracer().register_thread("main");
+    tracer().install_signal_handler(SIGUSR1);
+    is_replay = false;
+    replay_position = 0;
+    if (!options.recordings.empty()) {
+        const std::string &replay_path = options.recordings.front();
+        if (!replay.open(replay_path) || replay.size() == 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to replay %s", replay_path.c_str());
+            exit(EXIT_FAILURE);
+        }
+        is_replay = true;
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Replaying %zu frames from %s", replay.size(), replay_path.c_str());
+    }
+    if (options.sensors.empty() || is_replay) {
+        sensors.add(MLX_I2C_BUS, MLX_I2C_ADDR);
+    } else {
+        for (const SensorAddress &sensor : options.sensors) {
+            sensors.add(sensor.bus, static_cast<uint8_t>(sensor.address));
+        }
+    }
+    image_width = IMAGE_W * static_cast<int>(sensors.size());
+    image.resize(image_width * IMAGE_H);
+    image_sub_pages.resize(image.size());
+    for (int y = 0; y < IMAGE_W; y++) {
+        // Image column y of every sensor shows sensor row IMAGE_W - 1 - y, image row x shows sensor column x.
+        const int row = IMAGE_W - 1 - y;
+        for (int x = 0; x < IMAGE_H; x++) {
+            for (size_t s = 0; s < sensors.size(); s++) {
+                image_sub_pages[x * image_width + static_cast<int>(s) * IMAGE_W + y] =
+                        static_cast<uint8_t>(interleaved ? row & 1 : (row ^ x) & 1);
+            }
+        }
+    }
+    pixels.resize(image_width * IMAGE_H);
+    const ColorMap cm = get_colormap_magma();
+    for (size_t i = 0; i < palette.size(); i++) {
+        palette[i] = cm.b.at(i) << 16u | cm.g.at(i) << 8u | cm.r.at(i);
+    }
+    render_pool.reset(new WorkerPool(std::max(1u, std::thread::hardware_concurrency()) - 1));
+    power_save.configure(options.power_save, sensors.size());
+    // The EEPROM dump and sensor configuration only use the I2C bus, so they run next to the SDL, image and font
+    // initialization.
+    std::future<bool> sensor_ready = std::async(std::launch::async, &ThermalCamera::init_sensor, this);
+    const uint64_t sdl_begin = now_nanos();
+    const bool is_sdl_ready = init_sdl();
+    sdl_init_nanos = now_nanos() - sdl_begin;
+    // Both are done before exiting on a failure of either, so that no I2C transfer is cut off.
+    const bool is_sensor_ready = sensor_ready.get();
+    if (!is_sdl_ready || !is_sensor_ready) {
+        clean();
+        exit(EXIT_FAILURE);
+    }
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Initialized in %.1f ms (SDL %.1f ms, sensor %.1f ms)",
+                (now_nanos() - startup_begin) * 1e-6, sdl_init_nanos * 1e-6, sensor_init_nanos * 1e-6);
+    super_resolution.configure(options.super_resolution, image_width, IMAGE_H);
+    set_upscale_quality(options.upscale);
+    // The headless dump is compared against golden images, so it waits for the writer instead of dropping frames.
+    recorders.open(options, display_width, display_height, is_headless, sensors[0].eeprom, sensors.size());
+    if (!options.shared_frames_name.empty()) {
+        const char *name = options.shared_frames_name.c_str();
+        if (shared_frames.open(name, static_cast<int>(sensors.size()), SHARED_FRAME_SLOTS, EMISSIVITY, TA_SHIFT)) {
+            for (size_t s = 0; s < sensors.size(); s++) {
+                SharedSensorCalibration &calibration = shared_frames.calibration(static_cast<int>(s));
+                calibration.bus = sensors[s].bus;
+                calibration.address = sensors[s].address;
+                memcpy(calibration.eeprom, sensors[s].eeprom, sizeof(calibration.eeprom));
+            }
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Publishing frames to shared memory %s", name);
+        } else {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to create shared memory %s: %s", name,
+                         strerror(errno));
+        }
+    }
+    headless_begin = now_nanos();
     is_running = true;
     is_measuring = false;
     is_measuring_lpf = is_measuring;
     mean_temp = 0.0f;
     mean_temp_lpf = 0.0f;
+    message[0] = '\0';
     timer_is_animating = 0;
     animation_frame_nr = 0;
     frame_no = 0;
+    has_new_frame = false;
+    scheduler.set_pending(TASK_PROCESSING, false);
+    frame_stamp = {0, 0, 0};
+    to_stamp = frame_stamp;
+    pixels_stamp = frame_stamp;
+    mean_temp_stamp = frame_stamp;
 }
 
 ThermalCamera::~ThermalCamera() {
     clean();
 }
 
-void ThermalCamera::init_sdl() {
+bool ThermalCamera::init_sdl() {
     SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1");
-    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_Init() Failed: %s\n", SDL_GetError());
-    }
-    window = SDL_CreateWindow("ThermalCamera", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 0, 0,
-                              SDL_WINDOW_FULLSCREEN);
-    if (window == nullptr) {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_CreateWindow() Failed: %s\n", SDL_GetError());
-        clean();
-        exit(EXIT_FAILURE);
+    if (is_headless || !framebuffer_path.empty()) {
+        // Software renderer on a surface in memory: no video driver, window or vsync. In framebuffer mode, the
+        // surface has the size of the framebuffer and is copied to it on every present.
+        window = nullptr;
+        int width = HEADLESS_WIDTH;
+        int height = HEADLESS_HEIGHT;
+        if (!framebuffer_path.empty()) {
+            if (!framebuffer.open(framebuffer_path, width, height)) {
+                SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to open framebuffer %s: %s",
+                             framebuffer_path.c_str(), strerror(errno));
+                return false;
+            }
+            width = framebuffer.width();
+            height = framebuffer.height();
+            // Only for SDL_QUIT on SIGINT and SIGTERM, so that the console is restored.
+            SDL_Init(SDL_INIT_EVENTS);
+        }
+        surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+        if (surface == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_CreateRGBSurface() Failed: %s\n", SDL_GetError());
+            return false;
+        }
+        renderer = SDL_CreateSoftwareRenderer(surface);
+    } else {
+        if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_Init() Failed: %s\n", SDL_GetError());
+        }
+        window = SDL_CreateWindow("ThermalCamera", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 0, 0,
+                                  SDL_WINDOW_FULLSCREEN);
+        if (window == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_CreateWindow() Failed: %s\n", SDL_GetError());
+            return false;
+        }
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     }
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     if (renderer == nullptr) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_CreateRenderer() Failed: %s\n", SDL_GetError());
-        clean();
-        exit(EXIT_FAILURE);
+        return false;
     }
-    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, SENSOR_W, SENSOR_H);
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, image_width, IMAGE_H);
     if (texture == nullptr) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_CreateTexture() Failed: %s\n", SDL_GetError());
-        clean();
-        exit(EXIT_FAILURE);
+        return false;
     }
 
-    texture_r = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, SENSOR_H, SENSOR_H);
+    texture_r = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, IMAGE_H, IMAGE_H);
     if (texture_r == nullptr) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_CreateTexture() Failed: %s\n", SDL_GetError());
-        clean();
-        exit(EXIT_FAILURE);
+        return false;
     }
     // Load and create slider background
     std::string slider_bg_path = resource_path + "/images/slider_bg.bmp";
     SDL_Surface *image = SDL_LoadBMP(slider_bg_path.c_str());
     if (image == nullptr) {
         SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_LoadBMP() Failed: %s\n", SDL_GetError());
-        clean();
-        exit(EXIT_FAILURE);
+        return false;
     }
-    slider = SDL_CreateTextureFromSurface(renderer, image);
+    slider_sprite = ui.add(image);
     SDL_FreeSurface(image);
     // Load animation
     for (int i = 0; i < 6; i++) {
@@ -91,85 +231,113 @@ void ThermalCamera::init_sdl() {
         SDL_Surface *_image = SDL_LoadBMP(file_path.c_str());
         if (_image == nullptr) {
             SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_LoadBMP() Failed: %s\n", SDL_GetError());
-            clean();
-            exit(EXIT_FAILURE);
+            return false;
         }
-        SDL_Texture *_frame = SDL_CreateTextureFromSurface(renderer, _image);
-        animation.push_back(_frame);
+        animation_sprites.push_back(ui.add(_image));
+        SDL_FreeSurface(_image);
     }
     // Hide cursor
     SDL_ShowCursor(SDL_DISABLE);
-    // Init fonts
+    // Init fonts. Without the system font, e.g. on a build server, use the copy in the source tree.
     TTF_Init();
-    font64 = TTF_OpenFont(FONT_PATH.c_str(), 64);
-    font32 = TTF_OpenFont(FONT_PATH.c_str(), 36);
+    std::string font_path = FONT_PATH;
+    SDL_RWops *font_file = SDL_RWFromFile(font_path.c_str(), "rb");
+    if (font_file == nullptr) {
+        font_path = resource_path + "/../3rdparty/piboto/Piboto-Regular.ttf";
+    } else {
+        SDL_RWclose(font_file);
+    }
+    font64 = TTF_OpenFont(font_path.c_str(), 64);
+    font32 = TTF_OpenFont(font_path.c_str(), 36);
+    font16 = TTF_OpenFont(font_path.c_str(), 16);
     if (font64 == nullptr) {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to load font %s", FONT_PATH.c_str(), TTF_GetError());
-        clean();
-        exit(EXIT_FAILURE);
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to load font %s: %s", font_path.c_str(), TTF_GetError());
+        return false;
+    }
+    ui.add_font(font64);
+    ui.add_font(font32);
+    ui.add_font(font16);
+    if (!ui.build(renderer)) {
+        return false;
     }
     SDL_GetRendererOutputSize(renderer, &display_width, &display_height);
+    dirty.resize(display_width, display_height);
     SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Display dimension: (%d, %d)", display_width, display_height);
     // Set scaling and aspect ratio
     const double display_ratio = (double) display_width / display_height;
-    const double sensor_ratio = (double) SENSOR_W / SENSOR_H;
+    const double sensor_ratio = (double) image_width / IMAGE_H;
     if (display_ratio >= sensor_ratio) {
-        aspect_scale = display_height / SENSOR_H;
+        aspect_scale = display_height / IMAGE_H;
     } else {
-        aspect_scale = display_width / SENSOR_W;
+        aspect_scale = display_width / image_width;
     }
-    output_width = SENSOR_W * aspect_scale;
-    output_height = SENSOR_H * aspect_scale;
+    output_width = image_width * aspect_scale;
+    output_height = IMAGE_H * aspect_scale;
     offset_left = (display_width - output_width) / 2;
     offset_top = (display_height - output_height) / 2;
     // Override offset top to align the image with the top edge.
     offset_top = 0;
     rect_preserve_aspect = (SDL_Rect) {.x = offset_left, .y = offset_top, .w = output_width, .h = output_height};
     rect_fullscreen = (SDL_Rect) {.x = 0, .y = 0, .w = display_width, .h = display_height};
+    return true;
 }
 
-void ThermalCamera::init_sensor() {
-    MLX90640_SetDeviceMode(MLX_I2C_ADDR, 0);
-    MLX90640_SetSubPageRepeat(MLX_I2C_ADDR, 0);
-    switch (FPS) {
-        case 1:
-            MLX90640_SetRefreshRate(MLX_I2C_ADDR, 0b001);
-            break;
-        case 2:
-            MLX90640_SetRefreshRate(MLX_I2C_ADDR, 0b010);
-            break;
-        case 4:
-            MLX90640_SetRefreshRate(MLX_I2C_ADDR, 0b011);
-            break;
-        case 8:
-            MLX90640_SetRefreshRate(MLX_I2C_ADDR, 0b100);
-            break;
-        case 16:
-            MLX90640_SetRefreshRate(MLX_I2C_ADDR, 0b101);
-            break;
-        case 32:
-            MLX90640_SetRefreshRate(MLX_I2C_ADDR, 0b110);
-            break;
-        case 64:
-            MLX90640_SetRefreshRate(MLX_I2C_ADDR, 0b111);
-            break;
-        default:
-            printf("Unsupported framerate: %d", FPS);
-            clean();
-            exit(EXIT_FAILURE);
+bool ThermalCamera::init_sensor() {
+    const uint64_t begin = now_nanos();
+    bool is_calibrated;
+    if (is_replay) {
+        // The recording replaces the sensor, including its calibration.
+        memcpy(sensors[0].eeprom, replay.eeprom(), sizeof(sensors[0].eeprom));
+        is_calibrated = sensors.init_from_eeprom();
+    } else {
+        is_calibrated = is_test_pattern || sensors.init();
+    }
+    if (!is_calibrated) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to read the sensor EEPROM");
+        return false;
     }
-    MLX90640_SetChessMode(MLX_I2C_ADDR);
-    MLX90640_DumpEE(MLX_I2C_ADDR, eeMLX90640);
-    MLX90640_ExtractParameters(eeMLX90640, &mlx90640);
+    if (!is_test_pattern) {
+        // Pixels outside the region of interest are never measured, and would look stuck.
+        const bool is_full_frame = readout.rowStart == 0 && readout.colStart == 0 &&
+                                   readout.rowEnd == SensorModel::ROWS - 1 &&
+                                   readout.colEnd == SensorModel::COLUMNS - 1;
+        sensors.init_pixel_health(!interleaved, is_full_frame);
+    }
+    // The EEPROM holds the power-on value of the control register. Compose the configuration on top of it, so that
+    // set_refresh_rate() writes the control register exactly once, without reading it first.
+    sensor_config.stepMode = is_triggered ? 1 : 0;
+    sensor_config.subPageRepeat = is_triggered ? 1 : 0;
+    sensor_config.subPage = 0;
+    sensor_config.refreshRate = 0;
+    sensor_config.chessMode = interleaved ? 0 : 1;
+    if (!set_refresh_rate(refresh_rate)) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unsupported framerate: %d", refresh_rate);
+        return false;
+    }
+    sensor_init_nanos = now_nanos() - begin;
+    return true;
 }
 
 void ThermalCamera::clean() {
+    recorders.close();
+    shared_frames.close();
+    write_perf_log();
+    ui.clean();
     if (window != nullptr) {
         SDL_DestroyWindow(window);
     }
     if (renderer != nullptr) {
         SDL_DestroyRenderer(renderer);
     }
+    if (surface != nullptr) {
+        SDL_FreeSurface(surface);
+        surface = nullptr;
+    }
+    framebuffer.close();
+    if (texture_upscaled != nullptr) {
+        SDL_DestroyTexture(texture_upscaled);
+        texture_upscaled = nullptr;
+    }
     if (texture != nullptr) {
         SDL_DestroyTexture(texture);
     }
@@ -179,46 +347,336 @@ void ThermalCamera::clean() {
     SDL_Quit();
 }
 
-void ThermalCamera::update() {
+void ThermalCamera::tick() {
+    if (is_headless) {
+        tick_headless();
+        return;
+    }
+    scheduler.wait();
+    const uint64_t start = now_nanos();
+    handle_events();
+    if (scheduler.due(TASK_SENSOR)) {
+        if (acquire()) {
+            // Follow the sensor clock: wake up shortly before the next subpage is expected, and process this one now.
+            const auto data_ready = FrameScheduler::clock::time_point(std::chrono::nanoseconds(frame_stamp.data_ready));
+            scheduler.complete(TASK_SENSOR);
+            scheduler.resync(TASK_SENSOR, data_ready + scheduler.period(TASK_SENSOR) -
+                                          std::chrono::microseconds(SENSOR_WAKEUP_MICROS));
+            scheduler.resync(TASK_PROCESSING, data_ready);
+            scheduler.set_pending(TASK_PROCESSING, true);
+            has_new_frame = true;
+        } else {
+            scheduler.complete(TASK_SENSOR);
+            if (is_sensor_pending) {
+                // The subpage measurement has not finished yet.
+                scheduler.resync(TASK_SENSOR, FrameScheduler::clock::now() +
+                                              std::chrono::microseconds(SENSOR_POLL_MICROS));
+            }
+        }
+    }
+    bool is_processed = false;
+    uint64_t cpu_nanos = 0;
+    if (has_new_frame && scheduler.due(TASK_PROCESSING)) {
+        const uint64_t process_start = now_nanos();
+        if (update_power_save()) {
+            process();
+            cpu_nanos = now_nanos() - process_start;
+            is_processed = true;
+            // Show the new data right away; the display cadence only keeps the screen alive without new data.
+            scheduler.resync(TASK_DISPLAY, FrameScheduler::clock::now());
+        }
+        scheduler.complete(TASK_PROCESSING);
+        scheduler.set_pending(TASK_PROCESSING, false);
+        has_new_frame = false;
+    }
+    if (is_triggered && !is_measurement_started && !has_new_frame) {
+        start_measurement();
+    }
+    if (scheduler.due(TASK_DISPLAY)) {
+        // Only present when something visible changed, e.g. while idle only the animation and user input redraw.
+        if (!is_measuring_lpf) {
+            advance_animation();
+        }
+        update_dirty_region();
+        if (dirty.is_dirty()) {
+            const uint64_t render_nanos = render();
+            if (is_processed) {
+                cpu_nanos += render_nanos;
+            }
+        } else {
+            dirty.on_skip();
+            power_save.on_skipped_redraw();
+        }
+        scheduler.complete(TASK_DISPLAY);
+    }
+    const uint64_t end = now_nanos();
+    if (is_processed && rate_controller.is_enabled()) {
+        rate_controller.on_processed(cpu_nanos);
+        const int fps = rate_controller.update(refresh_rate, is_measuring, end);
+        if (fps != refresh_rate && set_refresh_rate(fps)) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Refresh rate changed to %d Hz", fps);
+        }
+    }
+    power_save.on_tick(end - start, end);
+    perf.record(STAGE_FRAME, start, end);
+}
+
+void ThermalCamera::tick_headless() {
+    if (allocation_check_frames > 0 && perf.histogram(STAGE_FRAME).count() == ALLOCATION_WARMUP_FRAMES) {
+        AllocationCounter::start();
+    }
+    const uint64_t start = now_nanos();
+    if (acquire()) {
+        process();
+    }
+    if (!is_measuring_lpf) {
+        advance_animation();
+    }
+    update_dirty_region();
+    if (dirty.is_dirty()) {
+        render();
+    } else {
+        dirty.on_skip();
+        // Also record the skipped frames, so the file names of the dump follow the frame number.
+        recorders.record(renderer, surface, now_nanos());
+    }
+    perf.record(STAGE_FRAME, start, now_nanos());
+    if (perf.histogram(STAGE_FRAME).count() >= headless_frames) {
+        is_running = false;
+    }
+    if (!is_running) {
+        if (allocation_check_frames > 0) {
+            check_allocations();
+        }
+        write_benchmark_report();
+    }
+}
+
+void ThermalCamera::check_allocations() {
+    const AllocationCounter::Counts counts = AllocationCounter::stop();
+    const uint64_t frames = perf.histogram(STAGE_FRAME).count();
+    const unsigned long long checked = frames > ALLOCATION_WARMUP_FRAMES ? frames - ALLOCATION_WARMUP_FRAMES : 0;
+    if (checked == 0) {
+        printf("Allocation check: the run ended within the %zu warm-up frames\n", ALLOCATION_WARMUP_FRAMES);
+        is_failed = true;
+    } else if (counts.allocations > 0) {
+        printf("Allocation check: %llu allocations of %llu bytes in %llu frames, the first of %zu bytes\n",
+               static_cast<unsigned long long>(counts.allocations), static_cast<unsigned long long>(counts.bytes),
+               checked, counts.first_size);
+        is_failed = true;
+    } else {
+        printf("Allocation check: no allocations in %llu frames\n", checked);
+    }
+}
+
+bool ThermalCamera::configure_sensor(const configMLX90640 &config) {
+    if (!is_replay && !is_test_pattern && !sensors.configure(config)) {
+        return false;
+    }
+    sensor_config = config;
+    return true;
+}
+
+bool ThermalCamera::set_refresh_rate(const int fps) {
+    const uint8_t code = RefreshRateController::rate_code(fps);
+    if (code == 0) {
+        return false;
+    }
+    configMLX90640 config = sensor_config;
+    config.refreshRate = code;
+    if (!configure_sensor(config)) {
+        return false;
+    }
+    refresh_rate = fps;
+    const auto period = std::chrono::microseconds(1000000 / fps);
+    scheduler.set_period(TASK_SENSOR, period);
+    scheduler.set_period(TASK_PROCESSING, period);
+    scheduler.set_period(TASK_DISPLAY, period);
+    timer_threshold_frames = static_cast<size_t>(round(TIMER_THRESHOLD_SECONDS * fps));
+    return true;
+}
+
+bool ThermalCamera::acquire() {
+    TRACE_SCOPE("acquire");
+    timingMLX90640 timing;
+    bool is_read;
+    if (is_test_pattern) {
+        fill_test_pattern();
+        timing.waitStart = timing.dataReady = timing.readDone = now_nanos();
+        is_read = true;
+    } else if (is_replay) {
+        // Frames are replayed at the current refresh rate, stamped as if the sensor just produced them.
+        if (replay_position >= replay.size()) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "End of replay after %zu frames", replay_position);
+            is_running = false;
+            return false;
+        }
+        FramePool<RawFrame>::Ref next = sensors[0].raw_frames.acquire();
+        is_read = static_cast<bool>(next);
+        if (is_read) {
+            memcpy(next->words, replay.frame(replay_position++), sizeof(next->words));
+            sensors[0].frame = std::move(next);
+            sensors[0].has_new_frame = true;
+        }
+        sensors[0].is_valid = is_read;
+        timing.waitStart = timing.dataReady = timing.readDone = now_nanos();
+    } else {
+        if (is_triggered && !is_measurement_started) {
+            return false;
+        }
+        is_sensor_pending = !sensors.poll(is_triggered);
+        if (is_sensor_pending) {
+            return false;
+        }
+        is_measurement_started = false;
+        is_read = sensors.acquire(is_partial_readout ? &readout : nullptr, is_triggered, sensor_config.subPage);
+        timing = sensors.timing();
+        if (sensors.failed() != failed_sensors) {
+            failed_sensors = sensors.failed();
+            if (failed_sensors > 0) {
+                SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "%zu of %zu sensors failed, recovering", failed_sensors,
+                            sensors.size());
+            } else {
+                SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "All sensors recovered");
+            }
+        }
+    }
+    perf.record(STAGE_I2C_WAIT, timing.waitStart, timing.dataReady);
+    perf.record(STAGE_I2C_READ, timing.dataReady, timing.readDone);
+    rate_controller.on_read(timing.readDone - timing.dataReady);
+    if (!is_read) {
+        return false;
+    }
     frame_no++;
-    auto start = std::chrono::system_clock::now();
-    MLX90640_GetFrameData(MLX_I2C_ADDR, frame);
+    perf.sensor_rate.tick();
+    power_save.on_frame();
+    frame_stamp = {frame_no, sensors[0].frame->words[SensorModel::SUB_PAGE_WORD], timing.dataReady};
+    // Triggered subpages can not be overwritten before they are read, so only a free-running sensor drops subpages.
+    latency.on_frame(frame_stamp, is_triggered ? 0 : 1000000000ull / refresh_rate);
+    if (!is_test_pattern) {
+        recorders.write_raw(sensors[0].frame->words);
+    }
+    return true;
+}
+
+void ThermalCamera::start_measurement() {
+    TRACE_SCOPE("start_measurement");
+    // Alternate the subpages, like the sensor does when it free-runs.
+    const uint8_t sub_page = frame_no == 0 ? 0 : static_cast<uint8_t>(frame_stamp.sub_page ^ 1);
+    sensors.start_measurement(sub_page);
+    sensor_config.subPage = sub_page;
+    is_measurement_started = true;
+    // A subpage measurement takes one refresh period. Poll for its end shortly before that.
+    scheduler.resync(TASK_SENSOR, FrameScheduler::clock::now() + scheduler.period(TASK_SENSOR) -
+                                  std::chrono::microseconds(SENSOR_WAKEUP_MICROS));
+}
 
-    eTa = MLX90640_GetTa(frame, &mlx90640) - 6.0f;
-    MLX90640_CalculateTo(frame, &mlx90640, EMISSIVITY, eTa, mlx90640To);
+void ThermalCamera::fill_test_pattern() {
+    // Warm body on a background with a vertical gradient. It walks from side to side, and leaves the view for 96 of
+    // every 256 frames. Pixel (ix, iy) of the image is pixel IMAGE_H * (IMAGE_W - 1 - ix) + iy of its sensor.
+    const bool is_present = frame_no % 256 < 160;
+    const float center_x = image_width * (0.5f + 0.25f * sinf(static_cast<float>(frame_no) * 0.05f));
+    const float center_y = IMAGE_H * 0.45f;
+    const float radius_x = IMAGE_W * 0.3f;
+    const float radius_y = IMAGE_H * 0.3f;
+    for (size_t s = 0; s < sensors.size(); s++) {
+        FramePool<ToFrame>::Ref to = sensors[s].to_frames.acquire();
+        if (!to) {
+            continue;
+        }
+        for (int y = 0; y < IMAGE_W; y++) {
+            const float dx = (static_cast<int>(s) * IMAGE_W + y - center_x) / radius_x;
+            for (int x = 0; x < IMAGE_H; x++) {
+                const float dy = (x - center_y) / radius_y;
+                const float r2 = dx * dx + dy * dy;
+                float value = 22.0f + 0.05f * x;
+                if (is_present && r2 < 1.0f) {
+                    value = 34.5f + 0.8f * (1.0f - r2);
+                }
+                to->values[IMAGE_H * (IMAGE_W - 1 - y) + x] = value;
+            }
+        }
+        sensors[s].to = std::move(to);
+        sensors[s].tr = 23.0f;
+    }
+    FramePool<RawFrame>::Ref frame = sensors[0].raw_frames.acquire();
+    if (frame) {
+        frame->words[SensorModel::SUB_PAGE_WORD] = static_cast<uint16_t>(frame_no & 1u);
+        sensors[0].frame = std::move(frame);
+    }
+}
 
-    MLX90640_BadPixelsCorrection((&mlx90640)->brokenPixels, mlx90640To, 1, &mlx90640);
-    MLX90640_BadPixelsCorrection((&mlx90640)->outlierPixels, mlx90640To, 1, &mlx90640);
+void ThermalCamera::process() {
+    TRACE_SCOPE("process");
+    uint64_t start = now_nanos();
+    if (!is_test_pattern) {
+        sensors.calculate_to(EMISSIVITY, TA_SHIFT, readout);
+    }
+    eTa = sensors[0].tr;
+    to_stamp = frame_stamp;
+    uint64_t end = now_nanos();
+    perf.record(STAGE_TO_CONVERSION, start, end);
+
+    start = end;
+    const int new_defects = is_test_pattern ? 0 : sensors.correct_bad_pixels();
+    if (new_defects > 0) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "%d new defect pixels detected", new_defects);
+    }
+    end = now_nanos();
+    perf.record(STAGE_BAD_PIXELS, start, end);
+
+    // Map the temperature values to colors, at a finer resolution when super-resolution is on.
+    start = end;
+    for (size_t s = 0; s < sensors.size(); s++) {
+        const float *to = sensors[s].to->values;
+        for (int y = 0; y < IMAGE_W; y++) {
+            for (int x = 0; x < IMAGE_H; x++) {
+                image[x * image_width + static_cast<int>(s) * IMAGE_W + y] = to[IMAGE_H * (IMAGE_W - 1 - y) + x];
+            }
+        }
+    }
+    if (is_super_resolution_active()) {
+        super_resolution.update(image.data(), image_sub_pages.data(), frame_stamp.sub_page, *render_pool);
+        end = now_nanos();
+        perf.record(STAGE_SUPER_RESOLUTION, start, end);
+        start = end;
+    }
+    map_colors();
+    pixels_stamp = to_stamp;
+    end = now_nanos();
+    perf.record(STAGE_COLORMAP, start, end);
 
-    // Scan the sensor and compute the mean skin temperature, assuming that skin temperature is between
-    // MIN_MEASURE_RANGE and MAX_MEASURE_RANGE.
+    // Scan the region of interest of the sensor and compute the mean skin temperature, assuming that skin temperature
+    // is between MIN_MEASURE_RANGE and MAX_MEASURE_RANGE. Pixels outside the region are never measured.
+    ScopedStage stage_statistics(perf, STAGE_STATISTICS);
     float sum_temp = 0.0f;
     int n_samples = 0;
-    for (int y = 0; y < SENSOR_W; y++) {
-        for (int x = 0; x < SENSOR_H; x++) {
-            // Read the temperature value for this pixel.
-            float val = mlx90640To[SENSOR_H * (SENSOR_W - 1 - y) + x];
-            // Map the value to a color
-            colormap(y, x, val, MIN_COLORMAP_RANGE, MAX_COLORMAP_RANGE);
-            // Sum and count the temperatures within the skin temperature range.
-            if (val > MIN_MEASURE_RANGE && val < MAX_MEASURE_RANGE) {
-                sum_temp += val;
-                n_samples += 1;
+    for (size_t s = 0; s < sensors.size(); s++) {
+        for (int row = readout.rowStart; row <= readout.rowEnd; row++) {
+            const float *values = sensors[s].to->values + row * SensorModel::COLUMNS;
+            for (int col = readout.colStart; col <= readout.colEnd; col++) {
+                // Sum and count the temperatures within the skin temperature range.
+                float val = values[col];
+                if (val > MIN_MEASURE_RANGE && val < MAX_MEASURE_RANGE) {
+                    sum_temp += val;
+                    n_samples += 1;
+                }
             }
         }
     }
     // Check if there are enough pixels within the temperature measuring range.
     bool is_measuring_prev = is_measuring;
-    is_measuring = n_samples > MEASURE_AREA_THRESHOLD;
+    is_measuring = n_samples > measure_area_threshold;
     if (is_measuring_prev != is_measuring) {
         timer_is_measuring = 0;
     } else {
         timer_is_measuring++;
     }
-    if (timer_is_measuring > TIMER_THRESHOLD_FRAMES) {
+    if (timer_is_measuring > timer_threshold_frames) {
         is_measuring_lpf = is_measuring;
     }
     // Compute the mean of the temperatures in the range.
+    mean_temp_stamp = to_stamp;
     if (n_samples > 0) {
         mean_temp = sum_temp / (float) n_samples;
     } else {
@@ -237,61 +695,137 @@ void ThermalCamera::update() {
     } else {
         mean_temp_lpf = -1.0f;
     }
-    // Format the temperature value to string
-    std::stringstream message_ss;
+    // Format the temperature value to string, in place so that no frame allocates
     if (mean_temp > MIN_MEASURE_RANGE && mean_temp < MAX_MEASURE_RANGE) {
-        message_ss << std::fixed << std::setprecision(1) << std::setw(4);
-        message_ss << mean_temp_lpf << "\xB0" << "C" << std::endl;
-        message = message_ss.str();
+        snprintf(message, sizeof(message), "%4.1f\xB0" "C", mean_temp_lpf);
     } else {
-        message = "";
+        message[0] = '\0';
     }
+    publish_frame(n_samples);
 }
 
+void ThermalCamera::publish_frame(const int measured_pixels) {
+    if (!shared_frames.is_open()) {
+        return;
+    }
+    TRACE_SCOPE("publish");
+    SharedFrameSlot *slot = shared_frames.begin();
+    slot->frame = to_stamp.sequence;
+    slot->data_ready = to_stamp.data_ready;
+    slot->sub_page = to_stamp.sub_page;
+    slot->refresh_rate = static_cast<uint32_t>(refresh_rate);
+    slot->flags = (is_measuring_lpf ? SHARED_FRAME_MEASURING : 0u) | (is_test_pattern ? SHARED_FRAME_TEST_PATTERN : 0u);
+    slot->measured_pixels = static_cast<uint32_t>(measured_pixels);
+    slot->mean_temp = mean_temp;
+    slot->mean_temp_lpf = mean_temp_lpf;
+    for (size_t s = 0; s < sensors.size(); s++) {
+        SharedSensorFrame *frame = SharedFramePublisher::sensor_frame(slot, static_cast<int>(s));
+        frame->tr = sensors[s].tr;
+        frame->is_valid = sensors[s].is_valid ? 1 : 0;
+        memcpy(frame->raw, sensors[s].frame->words, sizeof(frame->raw));
+        memcpy(frame->to, sensors[s].to->values, sizeof(frame->to));
+    }
+    slot->published_nanos = now_nanos();
+    shared_frames.commit(slot);
+}
 
-void ThermalCamera::render() {
+bool ThermalCamera::update_power_save() {
+    const int fps = power_save.update(sensors, is_measuring_lpf, refresh_rate, frame_stamp.data_ready);
+    if (fps != refresh_rate) {
+        if (!set_refresh_rate(fps)) {
+            power_save.on_rate_failed();
+        } else if (power_save.is_idle()) {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "No motion, idle at %d Hz", fps);
+        } else {
+            SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Motion detected, refresh rate back to %d Hz", fps);
+        }
+    }
+    return !power_save.is_idle();
+}
 
+uint64_t ThermalCamera::render() {
+    TRACE_SCOPE("render");
+    ScopedStage stage_render(perf, STAGE_RENDER);
+    const uint64_t start = now_nanos();
+    // A software target keeps its pixels, so only the dirty rectangle is redrawn. A window has to be redrawn
+    // completely, as the back buffer is undefined after a present.
+    const bool is_partial = surface != nullptr && !dirty.is_full();
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
-    render_sensor_frame();
-    if (is_measuring_lpf) {
-        render_slider();
-        render_temp_labels();
+    if (is_partial) {
+        SDL_RenderSetClipRect(renderer, &dirty.rect());
+        SDL_RenderFillRect(renderer, &dirty.rect());
     } else {
-        render_animation();
+        SDL_RenderClear(renderer);
     }
-    SDL_RenderPresent(renderer);
-//    screenshot();
+    {
+        ScopedStage stage(perf, STAGE_TEXTURE_UPLOAD);
+        render_sensor_frame();
+    }
+    {
+        ScopedStage stage(perf, STAGE_UI);
+        if (is_measuring_lpf) {
+            render_slider();
+            render_temp_labels();
+        } else {
+            render_animation();
+        }
+        render_perf_overlay();
+        ui.flush(renderer);
+    }
+    if (is_partial) {
+        SDL_RenderSetClipRect(renderer, nullptr);
+    }
+    recorders.record(renderer, surface, now_nanos());
+    // Presenting mostly waits for the display, which is no load.
+    const uint64_t cpu_nanos = now_nanos() - start;
+    {
+        ScopedStage stage(perf, STAGE_PRESENT);
+        SDL_RenderPresent(renderer);
+        if (framebuffer.is_open()) {
+            const SDL_Rect &r = dirty.rect();
+            framebuffer.present(static_cast<const uint32_t *>(surface->pixels), surface->pitch, r.x, r.y, r.w, r.h);
+        }
+    }
+    dirty.on_present(is_partial);
+    const uint64_t present = now_nanos();
+    latency.on_present(pixels_stamp, mean_temp_stamp, is_measuring_lpf, present);
+    power_save.on_present(present);
+    if (first_frame_nanos == 0 && pixels_stamp.sequence != 0) {
+        first_frame_nanos = present - startup_begin;
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Time to first frame: %.1f ms", first_frame_nanos * 1e-6);
+    }
+    perf.display_rate.tick();
+    needs_redraw = false;
+    return cpu_nanos;
 }
 
-void ThermalCamera::render_temp_labels() const {
-    SDL_Point origin = {0, 640 - 48};
+void ThermalCamera::render_temp_labels() {
+    SDL_Point origin = {0, VALUE_Y};
     SDL_Color text_color = {255, 255, 255, 255};
     render_text(message, text_color, origin, 1, font32);
-    std::string label = "Skin temperature:";
-    render_text(label, text_color, origin, 0, font32);
+    render_text(VALUE_CAPTION, text_color, origin, 0, font32);
     origin = {0, 0};
+    render_text(skin_label(), text_color, origin, 3, font64);
+}
+
+const char *ThermalCamera::skin_label() const {
     if (mean_temp_lpf <= 31.0) {
-        label = "Low";
+        return "Low";
     } else if (mean_temp_lpf > 31.0 && mean_temp_lpf <= 34.2) {
-        label = "Normal";
+        return "Normal";
     } else if (mean_temp_lpf > 34.2 && mean_temp_lpf <= 35.0) {
-        label = "High";
+        return "High";
     } else if (mean_temp_lpf > 35) {
-        label = "Very high";
+        return "Very high";
     }
-    render_text(label, text_color, origin, 3, font64);
+    return VALUE_CAPTION;
 }
 
-void
-ThermalCamera::render_text(const std::string &text, const SDL_Color &text_color, const SDL_Point origin,
-                           const int anchor,
-                           TTF_Font *font) const {
-    SDL_Surface *surf = TTF_RenderText_Solid(font, text.c_str(), text_color);
-    SDL_Texture *texture_txt = SDL_CreateTextureFromSurface(renderer, surf);
-    int text_width, text_height;
-    SDL_QueryTexture(texture_txt, nullptr, nullptr, &text_width, &text_height);
-    SDL_Rect dst;
+SDL_Rect ThermalCamera::text_rect(const char *text, const SDL_Point origin, const int anchor, TTF_Font *font) const {
+    const SDL_Point size = ui.text_size(font, text);
+    const int text_width = size.x;
+    const int text_height = size.y;
+    SDL_Rect dst = {};
     // top left
     if (anchor == 0) {
         dst = {origin.x, origin.y, text_width, text_height};
@@ -309,13 +843,26 @@ ThermalCamera::render_text(const std::string &text, const SDL_Color &text_color,
     else if (anchor == 3) {
         dst = {origin.x, display_height - text_height - origin.y, text_width, text_height};
     }
-    SDL_RenderCopy(renderer, texture_txt, nullptr, &dst);
-    SDL_FreeSurface(surf);
-    SDL_DestroyTexture(texture_txt);
+    return dst;
+}
+
+void
+ThermalCamera::render_text(const char *text, const SDL_Color &text_color, const SDL_Point origin,
+                           const int anchor,
+                           TTF_Font *font) {
+    const SDL_Rect dst = text_rect(text, origin, anchor, font);
+    ui.draw_text(font, text, {dst.x, dst.y}, text_color);
 }
 
 void ThermalCamera::render_sensor_frame() const {
-    SDL_UpdateTexture(texture, nullptr, (uint8_t *) pixels, SENSOR_W * sizeof(uint32_t));
+    if (upscaler.quality() != UPSCALE_GPU) {
+        SDL_UpdateTexture(texture_upscaled, nullptr, (uint8_t *) upscaled_pixels.data(),
+                          output_width * sizeof(uint32_t));
+        const SDL_Rect *rect = preserve_aspect ? &rect_preserve_aspect : &rect_fullscreen;
+        SDL_RenderCopyEx(renderer, texture_upscaled, nullptr, rect, rotation, nullptr, SDL_FLIP_NONE);
+        return;
+    }
+    SDL_UpdateTexture(texture, nullptr, (uint8_t *) pixels.data(), image_width * sizeof(uint32_t));
     SDL_SetRenderTarget(renderer, texture_r);
     SDL_RenderCopyEx(renderer, texture, nullptr, nullptr, rotation, nullptr, SDL_FLIP_NONE);
     SDL_SetRenderTarget(renderer, nullptr);
@@ -326,45 +873,111 @@ void ThermalCamera::render_sensor_frame() const {
     }
 }
 
-void ThermalCamera::render_slider() const {
+void ThermalCamera::render_slider() {
     if (!is_measuring_lpf) {
         return;
     }
-    const int ys1 = 640 + 20;
-    const int ys2 = 640 + 60;
-    const int margin1 = 4;
+    const int ys1 = SLIDER_Y1;
+    const int ys2 = SLIDER_Y2;
+    const int margin1 = MARKER_MARGIN;
     const int margin2 = margin1 + 2;
     SDL_Rect marker_rect;
     // slider background
     SDL_Rect rect_slider = {0, ys1, display_width, ys2 - ys1};
-    SDL_RenderCopy(renderer, slider, nullptr, &rect_slider);
+    ui.draw(slider_sprite, rect_slider);
     // marker
-    auto x_pos = (mean_temp_lpf - 31) / (36 - 31);
-    x_pos = fmin(1.0, x_pos);
-    x_pos = fmax(0.0, x_pos);
-    int x_marker = static_cast<int>(round(x_pos * (float) display_width));
+    const int x_marker = slider_marker_x();
 
-    marker_rect = {x_marker - margin2, ys1 - margin2, ys2 - ys1 + 2 * margin2};
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderFillRect(renderer, &marker_rect);
+    marker_rect = {x_marker - margin2, ys1 - margin2, 2 * margin2, ys2 - ys1 + 2 * margin2};
+    ui.fill(marker_rect, {0, 0, 0, 255});
 
     marker_rect = {x_marker - margin1, ys1 - margin1, 2 * margin1, ys2 - ys1 + 2 * margin1};
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-    SDL_RenderFillRect(renderer, &marker_rect);
+    ui.fill(marker_rect, {255, 255, 255, 255});
+
+}
+
+SDL_Rect ThermalCamera::slider_rect() const {
+    const int margin = MARKER_MARGIN + 2;
+    return {0, SLIDER_Y1 - margin, display_width, SLIDER_Y2 - SLIDER_Y1 + 2 * margin};
+}
+
+int ThermalCamera::slider_marker_x() const {
+    auto x_pos = (mean_temp_lpf - 31) / (36 - 31);
+    x_pos = fmin(1.0, x_pos);
+    x_pos = fmax(0.0, x_pos);
+    return static_cast<int>(round(x_pos * (float) display_width));
+}
 
+void ThermalCamera::update_dirty_region() {
+    if (needs_redraw) {
+        dirty.invalidate();
+    }
+    // Hidden layers cover nothing, so the area they covered is redrawn once.
+    const uint64_t hidden = UINT64_MAX;
+    const SDL_Rect none = {0, 0, 0, 0};
+    const bool is_upright = rotation % 180 == 0;
+    dirty.update(LAYER_IMAGE, image_version,
+                 is_upright && preserve_aspect ? rect_preserve_aspect : rect_fullscreen);
+    // The caption and the value share a row, placed as render_temp_labels() does.
+    const SDL_Point value_origin = {0, VALUE_Y};
+    const SDL_Rect caption_rect = text_rect(VALUE_CAPTION, value_origin, 0, font32);
+    const SDL_Rect message_rect = text_rect(message, value_origin, 1, font32);
+    const SDL_Rect value_rect = {0, VALUE_Y, display_width, std::max(caption_rect.h, message_rect.h)};
+    dirty.update(LAYER_VALUE, is_measuring_lpf ? DirtyRegion::text_key(message) : hidden,
+                 is_measuring_lpf ? value_rect : none);
+    const char *label = skin_label();
+    const SDL_Rect label_rect = text_rect(label, {0, 0}, 3, font64);
+    dirty.update(LAYER_LABEL, is_measuring_lpf ? DirtyRegion::text_key(label) : hidden,
+                 is_measuring_lpf ? SDL_Rect{0, label_rect.y, display_width, label_rect.h} : none);
+    dirty.update(LAYER_SLIDER, is_measuring_lpf ? slider_marker_x() : hidden,
+                 is_measuring_lpf ? slider_rect() : none);
+    const SDL_Rect animation_rect = {0, output_height, display_width, display_height - output_height};
+    dirty.update(LAYER_ANIMATION, is_measuring_lpf ? hidden : animation_frame_nr,
+                 is_measuring_lpf ? none : animation_rect);
+    // The numbers of the overlay change with every present.
+    const SDL_Rect overlay_rect = {0, 0, display_width, (N_STAGES + 5) * 20};
+    const bool is_overlay = show_perf_overlay && font16 != nullptr;
+    dirty.update(LAYER_OVERLAY, is_overlay ? perf.display_rate.count() : hidden, is_overlay ? overlay_rect : none);
 }
 
 void ThermalCamera::handle_events() {
+    if (tracer().poll(trace_path)) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Trace written to %s", trace_path.c_str());
+    }
     SDL_Event event;
-    SDL_PollEvent(&event);
+    if (!SDL_PollEvent(&event)) {
+        return;
+    }
     if (event.type == SDL_QUIT) {
         is_running = false;
     }
     if (event.type == SDL_KEYDOWN) {
+        needs_redraw = true;
         switch (event.key.keysym.sym) {
             case SDLK_ESCAPE:
                 is_running = false;
                 break;
+            case SDLK_PLUS:
+            case SDLK_EQUALS:
+                set_refresh_rate(refresh_rate * 2);
+                break;
+            case SDLK_MINUS:
+                set_refresh_rate(refresh_rate / 2);
+                break;
+            case SDLK_p:
+                show_perf_overlay = !show_perf_overlay;
+                break;
+            case SDLK_u:
+                set_upscale_quality(static_cast<UpscaleQuality>((upscaler.quality() + 1) % N_UPSCALE_QUALITIES));
+                map_colors();
+                break;
+            case SDLK_s:
+                set_super_resolution(super_resolution.factor() == 0 ? 2 : super_resolution.factor() == 2 ? 4 : 0);
+                break;
+            case SDLK_t:
+                tracer().start(static_cast<uint64_t>(TRACE_SECONDS * 1e9f));
+                SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Trace capture started");
+                break;
             default:
                 break;
         }
@@ -375,35 +988,162 @@ void ThermalCamera::colormap(const int x, const int y, float v, float vmin, floa
 
     // Normalize v
     v = (v - vmin) / (vmax - vmin);
-    auto color_index = static_cast<size_t>(round(255 * v));
-    color_index = color_index > 255 ? 255 : color_index;
-    color_index = color_index < 0 ? 0 : color_index;
-    const uint offset = (y * SENSOR_W + x);
-    ColorMap cm = get_colormap_magma();
-    pixels[offset] = cm.b.at(color_index) << 16u | cm.g.at(color_index) << 8u | cm.r.at(color_index);
+    const float level = roundf(255 * v);
+    const size_t color_index = level > 0.0f ? std::min(static_cast<size_t>(level), palette.size() - 1) : 0;
+    const uint offset = (y * image_width + x);
+    pixels[offset] = palette[color_index];
 }
 
-void ThermalCamera::render_animation() {
+void ThermalCamera::map_colors() {
+    image_version++;
+    if (upscaler.quality() != UPSCALE_GPU) {
+        const float *source = is_super_resolution_active() ? super_resolution.result() : image.data();
+        upscaler.run(source, MIN_COLORMAP_RANGE, MAX_COLORMAP_RANGE, palette.data(), upscaled_pixels.data(),
+                     *render_pool);
+        return;
+    }
+    for (int y = 0; y < IMAGE_H; y++) {
+        for (int x = 0; x < image_width; x++) {
+            colormap(x, y, image[y * image_width + x], MIN_COLORMAP_RANGE, MAX_COLORMAP_RANGE);
+        }
+    }
+}
+
+void ThermalCamera::set_upscale_quality(UpscaleQuality quality) {
+    if (quality != UPSCALE_GPU && texture_upscaled == nullptr) {
+        texture_upscaled = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING,
+                                             output_width, output_height);
+        if (texture_upscaled == nullptr) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "SDL_CreateTexture() Failed: %s\n", SDL_GetError());
+            quality = UPSCALE_GPU;
+        }
+        upscaled_pixels.resize(output_width * output_height);
+    }
+    const int width = super_resolution.is_enabled() ? super_resolution.out_width() : image_width;
+    const int height = super_resolution.is_enabled() ? super_resolution.out_height() : IMAGE_H;
+    upscaler.configure(quality, width, height, output_width, output_height);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Upscaling: %s, %dx%d to %dx%d", upscale_quality_name(quality),
+                width, height, output_width, output_height);
+}
+
+void ThermalCamera::set_super_resolution(const int factor) {
+    super_resolution.configure(factor, image_width, IMAGE_H);
+    set_upscale_quality(upscaler.quality());
+    if (is_super_resolution_active()) {
+        // Start from the last image, so that there is something to show until the next subpage.
+        super_resolution.update(image.data(), image_sub_pages.data(), to_stamp.sub_page, *render_pool);
+    } else if (factor > 1) {
+        SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Super-resolution requires upscaling on the CPU");
+    }
+    map_colors();
+}
 
-    if (timer_is_animating > TIMER_THRESHOLD_FRAMES) {
+bool ThermalCamera::is_super_resolution_active() const {
+    return super_resolution.is_enabled() && upscaler.quality() != UPSCALE_GPU;
+}
+
+bool ThermalCamera::advance_animation() {
+    if (timer_is_animating > timer_threshold_frames) {
         timer_is_animating = 0;
         animation_frame_nr++;
-        animation_frame_nr = animation_frame_nr >= animation.size() ? 0 : animation_frame_nr;
-    } else {
-        timer_is_animating++;
+        animation_frame_nr = animation_frame_nr >= animation_sprites.size() ? 0 : animation_frame_nr;
+        return true;
     }
+    timer_is_animating++;
+    return false;
+}
+
+void ThermalCamera::render_animation() {
+
     SDL_Rect animation_rect = {0, output_height, display_width, display_height - output_height};
-    SDL_RenderCopy(renderer, animation.at(animation_frame_nr), nullptr, &animation_rect);
+    ui.draw(animation_sprites.at(animation_frame_nr), animation_rect);
 
 }
 
-void ThermalCamera::screenshot() {
-    SDL_Surface *sshot = SDL_CreateRGBSurface(0, display_width, display_height, 32, 0x00ff0000, 0x0000ff00, 0x000000ff,
-                                              0xff000000);
-    SDL_RenderReadPixels(renderer, nullptr, SDL_PIXELFORMAT_ARGB8888, sshot->pixels, sshot->pitch);
-    std::stringstream ss;
-    ss << std::setfill('0') << std::setw(5) << frame_no;
-    auto filename = "/home/pi/Videos/" + ss.str() + ".bmp";
-    SDL_SaveBMP(sshot, filename.c_str());
-    SDL_FreeSurface(sshot);
-}
\ No newline at end of file
+void ThermalCamera::render_perf_overlay() {
+    if (!show_perf_overlay || font16 == nullptr) {
+        return;
+    }
+    const int line_height = 20;
+    const SDL_Color text_color = {255, 255, 255, 255};
+    SDL_Rect background = {0, 0, display_width, (N_STAGES + 5) * line_height};
+    ui.fill(background, {0, 0, 0, 192});
+
+    char line[96];
+    snprintf(line, sizeof(line), "sensor %.1f / %d Hz%s   display %.1f Hz   upscale %s%s", perf.sensor_rate.rate(),
+             refresh_rate, power_save.is_idle() ? " (idle)" : rate_controller.is_enabled() ? " (adaptive)" : "",
+             perf.display_rate.rate(), upscale_quality_name(upscaler.quality()),
+             !is_super_resolution_active() ? "" : super_resolution.factor() == 2 ? " sr 2x" : " sr 4x");
+    render_text(line, text_color, {4, 4}, 0, font16);
+    for (int i = 0; i < N_STAGES; i++) {
+        const LatencyHistogram &h = perf.histogram(static_cast<Stage>(i));
+        snprintf(line, sizeof(line), "%s:  p50 %.2f  p99 %.2f  max %.2f ms", stage_name(static_cast<Stage>(i)),
+                 h.percentile(0.50) * 1e-6, h.percentile(0.99) * 1e-6, h.max() * 1e-6);
+        render_text(line, text_color, {4, 4 + (i + 1) * line_height}, 0, font16);
+    }
+    const LatencyHistogram &image_latency = latency.image_latency(pixels_stamp.sub_page);
+    snprintf(line, sizeof(line), "latency p50 %.1f  p99 %.1f ms  dropped %llu  repeated %llu",
+             image_latency.percentile(0.50) * 1e-6, image_latency.percentile(0.99) * 1e-6,
+             static_cast<unsigned long long>(latency.sub_pages_dropped()),
+             static_cast<unsigned long long>(latency.sub_pages_repeated()));
+    render_text(line, text_color, {4, 4 + (N_STAGES + 1) * line_height}, 0, font16);
+    snprintf(line, sizeof(line), "missed deadlines  sensor %llu  processing %llu  display %llu",
+             static_cast<unsigned long long>(scheduler.missed(TASK_SENSOR)),
+             static_cast<unsigned long long>(scheduler.missed(TASK_PROCESSING)),
+             static_cast<unsigned long long>(scheduler.missed(TASK_DISPLAY)));
+    render_text(line, text_color, {4, 4 + (N_STAGES + 2) * line_height}, 0, font16);
+    unsigned long long dropped = 0;
+    unsigned long long recoveries = 0;
+    for (size_t s = 0; s < sensors.size(); s++) {
+        dropped += sensors[s].link.dropped();
+        recoveries += sensors[s].link.recoveries();
+    }
+    snprintf(line, sizeof(line), "sensor frames dropped %llu  recoveries %llu  failed %zu", dropped, recoveries,
+             failed_sensors);
+    render_text(line, text_color, {4, 4 + (N_STAGES + 3) * line_height}, 0, font16);
+}
+
+void ThermalCamera::write_perf_log() const {
+    if (perf_log_path.empty() || perf.histogram(STAGE_FRAME).count() == 0) {
+        return;
+    }
+    const bool is_written = perf.dump(perf_log_path.c_str(), [this](FILE *file) {
+        fprintf(file, "startup  sdl %.3f  sensor %.3f  first frame %.3f ms\n", sdl_init_nanos * 1e-6,
+                sensor_init_nanos * 1e-6, first_frame_nanos * 1e-6);
+        latency.write(file);
+        scheduler.write(file);
+        dirty.write(file);
+        power_save.write(file);
+        if (super_resolution.is_enabled()) {
+            fprintf(file, "super-resolution %dx  resets %zu\n", super_resolution.factor(), super_resolution.resets());
+        }
+        if (framebuffer.is_open()) {
+            framebuffer.write(file);
+        }
+        recorders.write(file);
+        if (shared_frames.is_open()) {
+            shared_frames.write(file);
+        }
+        for (size_t s = 0; s < sensors.size(); s++) {
+            fprintf(file, "sensor %zu (bus %d, address 0x%02x)\n", s, sensors[s].bus, sensors[s].address);
+            sensors[s].link.write(file);
+            sensors[s].health.write(file);
+            sensors[s].raw_frames.write(file, "raw frame");
+            sensors[s].to_frames.write(file, "To frame");
+        }
+    });
+    if (!is_written) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to write %s", perf_log_path.c_str());
+        return;
+    }
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Performance statistics written to %s", perf_log_path.c_str());
+}
+
+void ThermalCamera::write_benchmark_report() const {
+    const uint64_t nanos = now_nanos() - headless_begin;
+    const unsigned long long frames = perf.histogram(STAGE_FRAME).count();
+    printf("Ran %llu frames of %dx%d from %s in %.1f ms, %.1f frames/s\n", frames, display_width,
+           display_height, is_test_pattern ? "the test pattern" : "the replay", nanos * 1e-6, frames / (nanos * 1e-9));
+    dirty.write(stdout);
+    perf.write(stdout);
+}
@@ -16,45 +16,79 @@ limitations under the License.
 #ifndef THERMALCAM_THERMALCAMERA_H
 #define THERMALCAM_THERMALCAMERA_H
 
+#include <array>
+#include <memory>
 #include <string>
 #include <vector>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 #include <MLX90640_API.h>
 #include "constants.h"
+#include "DirtyRegion.h"
+#include "FramebufferOutput.h"
+#include "FrameLatency.h"
+#include "FrameRecording.h"
+#include "FrameScheduler.h"
+#include "Options.h"
+#include "PerfStats.h"
+#include "PowerSave.h"
+#include "Recorders.h"
+#include "RefreshRateController.h"
+#include "SensorArray.h"
+#include "SharedFrames.h"
+#include "SpriteAtlas.h"
+#include "SuperResolution.h"
+#include "Upscaler.h"
+#include "WorkerPool.h"
 
 
 class ThermalCamera {
 
 public:
-    ThermalCamera();
+    explicit ThermalCamera(const Options &options);
 
     virtual ~ThermalCamera();
 
-    void init_sdl();
+    // Returns false when the display, the images or the fonts could not be set up. The error is logged.
+    bool init_sdl();
 
-    void init_sensor();
+    // Reads the calibration and configures the sensor. Runs concurrently with init_sdl().
+    bool init_sensor();
 
-    void handle_events();
+    // Waits for the next deadline and runs the sensor, processing and display tasks that are due.
+    void tick();
 
-    void update();
+    void handle_events();
 
-    void render();
+    // Draws and presents a frame. Returns the CPU time spent on it, without the wait for the present.
+    uint64_t render();
 
     void clean();
 
     bool running() { return is_running; }
 
+    // True when a headless check failed.
+    bool failed() const { return is_failed; }
+
 
 private:
     SDL_Window *window;
     SDL_Renderer *renderer;
+    // Target of the software renderer in headless and framebuffer mode.
+    SDL_Surface *surface = nullptr;
+    // Output without X11: the composed surface is copied to the framebuffer.
+    std::string framebuffer_path;
+    FramebufferOutput framebuffer;
     SDL_Texture *texture;
     SDL_Texture *texture_r;
-    SDL_Texture *slider;
-    std::vector<SDL_Texture*> animation;
+    SDL_Texture *texture_upscaled = nullptr;
+    // Slider, animation, glyphs and fills, drawn in one batch per frame.
+    SpriteAtlas ui;
+    int slider_sprite = -1;
+    std::vector<int> animation_sprites;
     TTF_Font *font32;
     TTF_Font *font64;
+    TTF_Font *font16;
 
     // === Settings ===
     const float MIN_MEASURE_RANGE = 31.0f;
@@ -62,32 +96,118 @@ private:
     const float MIN_COLORMAP_RANGE = MIN_MEASURE_RANGE - 10.0f;
     const float MAX_COLORMAP_RANGE = MAX_MEASURE_RANGE - 3.0f;
     const float MEASURE_AREA_FRACTION = 0.10f;
-    const int MEASURE_AREA_THRESHOLD = static_cast<int>(round(SENSOR_W * SENSOR_H * MEASURE_AREA_FRACTION));
     // Emissivity value for human skin
     const float EMISSIVITY = 0.99;
     // Moving average parameter
     const float BETA = 0.90;
     // Screen rotation
     const int rotation = 0;
+    // Layout of the measurement below the image, which is 640 pixels high: the caption and the value, and under them
+    // the vertical extent of the slider, and the margin of the marker around it.
+    const int IMAGE_BOTTOM = 640;
+    const int VALUE_Y = IMAGE_BOTTOM - 48;
+    const char *const VALUE_CAPTION = "Skin temperature:";
+    const int SLIDER_Y1 = IMAGE_BOTTOM + 20;
+    const int SLIDER_Y2 = IMAGE_BOTTOM + 60;
+    const int MARKER_MARGIN = 4;
     // Font path
     const std::string FONT_PATH = "/usr/share/fonts/truetype/piboto/Piboto-Regular.ttf";
+    // Size of the offscreen image in headless mode and of a framebuffer stand-in file: the official 7" display in
+    // portrait orientation.
+    const int HEADLESS_WIDTH = 480;
+    const int HEADLESS_HEIGHT = 800;
+    // Frames rendered before the allocation check starts, one cycle of the test pattern, so that every buffer has
+    // grown to its final size.
+    const size_t ALLOCATION_WARMUP_FRAMES = 256;
+    // Frames kept in the shared memory ring, a quarter second at 64 Hz.
+    const int SHARED_FRAME_SLOTS = 16;
     // Measure timer
     const float TIMER_THRESHOLD_SECONDS = .6f;
-    const size_t TIMER_THRESHOLD_FRAMES = static_cast<int>(round(TIMER_THRESHOLD_SECONDS * FPS));
+    size_t timer_threshold_frames;
+    // Refresh rate range of the adaptive rate controller.
+    const int ADAPTIVE_MIN_FPS = 4;
+    const int ADAPTIVE_MAX_FPS = 32;
     size_t timer_is_measuring;
     size_t timer_is_animating;
 
     // === Buffers ===
-    // Eeprom parameters buffer
-    uint16_t eeMLX90640[832];
-    // Sensor parameters, converted from parameter buffer.
-    paramsMLX90640 mlx90640;
-    // Buffer for storing raw sensor output.
-    uint16_t frame[834];
-    // Buffer for storing converted sensor values (temperatures as float[]).
-    float mlx90640To[768];
+    // Sensors with their calibration, raw frames and converted temperatures. The images of the sensors are shown
+    // side by side, image_width pixels wide in total.
+    SensorArray sensors;
+    int image_width;
+    // Sensor configuration, written to all sensors.
+    configMLX90640 sensor_config;
+    // Sensor refresh rate in Hz, optionally adapted to the scene and the available headroom.
+    int refresh_rate;
+    RefreshRateController rate_controller;
+    // Sensor reading pattern and the part of the sensor RAM that is read every subpage.
+    bool interleaved;
+    readoutMLX90640 readout;
+    bool is_partial_readout;
+    // Number of pixels in the skin temperature range above which someone is measured, a fraction of the region.
+    int measure_area_threshold;
+    // Triggered acquisition: the sensor runs in step mode and measures a subpage only when started by the host.
+    bool is_triggered;
+    bool is_measurement_started;
+    // The sensors are polled until they have new data, and failed sensors are recovered in the background.
+    bool is_sensor_pending;
+    size_t failed_sensors;
+    // Stamps of the raw frames, the converted temperatures and the pixel colors.
+    FrameStamp frame_stamp;
+    FrameStamp to_stamp;
+    // Temperatures as they are displayed, image_width x IMAGE_H, and the colors of the 256 palette levels.
+    std::vector<float> image;
+    // Subpage that measures each pixel of the image, and the image accumulated over the subpages at a finer grid.
+    std::vector<uint8_t> image_sub_pages;
+    SuperResolution super_resolution;
+    std::array<uint32_t, 256> palette;
     // Buffer for storing pixel color values to visualize sensor output.
-    uint32_t pixels[768];
+    std::vector<uint32_t> pixels;
+    FrameStamp pixels_stamp;
+    // Image scaled to the output size on the CPU, unless the quality is UPSCALE_GPU.
+    Upscaler upscaler;
+    std::vector<uint32_t> upscaled_pixels;
+    std::unique_ptr<WorkerPool> render_pool;
+    // The recording that replaces the sensor.
+    FrameReplay replay;
+    bool is_replay;
+    size_t replay_position;
+    // Headless benchmark: a fixed number of frames rendered offscreen without waiting, from the replay or from a test
+    // pattern that replaces the sensor and the To conversion.
+    bool is_headless;
+    bool is_test_pattern;
+    size_t headless_frames;
+    uint64_t headless_begin;
+    // Number of headless frames after the warm-up in which any heap allocation fails the run.
+    size_t allocation_check_frames;
+    bool is_failed;
+    // Optional recordings of the raw sensor frames and of the rendered frames.
+    Recorders recorders;
+    // Every processed frame is published to a shared memory ring for other processes.
+    SharedFramePublisher shared_frames;
+    // Idle power save: low refresh rate and motion detection on the raw frames while nobody is measured.
+    PowerSave power_save;
+    bool needs_redraw;
+    // Present only what changed. The image version counts the colorings of the sensor image.
+    DirtyRegion dirty;
+    uint64_t image_version = 0;
+    // Per stage latencies, shown in the overlay and written to perf_log_path on exit.
+    PerfStats perf;
+    FrameLatency latency;
+    std::string perf_log_path;
+    bool show_perf_overlay = false;
+    // Schedules sensor reads, processing and display on absolute deadlines.
+    FrameScheduler scheduler;
+    bool has_new_frame;
+    // Trace capture, started with the 't' key or SIGUSR1.
+    const float TRACE_SECONDS = 5.0f;
+    std::string trace_path;
+
+    // Startup timing. Time-to-first-frame runs from construction until the first sensor image is presented.
+    uint64_t startup_begin;
+    uint64_t sdl_init_nanos;
+    uint64_t sensor_init_nanos;
+    uint64_t first_frame_nanos;
 
     // === Variables ===
     std::string resource_path;
@@ -109,25 +229,83 @@ private:
     float eTa;
     float mean_temp;
     float mean_temp_lpf;
-    std::string message;
+    FrameStamp mean_temp_stamp;
+    char message[16];
     int animation_frame_nr;
 
 
     // === Functions ===
+    // Composes the control register from config and writes it in a single transaction.
+    bool configure_sensor(const configMLX90640 &config);
+
+    bool set_refresh_rate(int fps);
+
+    bool acquire();
+
+    // Processes and renders the next frame without waiting for the sensor or the display.
+    void tick_headless();
+
+    // Starts the measurement of the next subpage in triggered mode.
+    void start_measurement();
+
+    // Fills in the temperatures of a person walking in and out of view, for the headless benchmark.
+    void fill_test_pattern();
+
+    void process();
+
+    // Applies the refresh rate chosen by the power save. Returns false when the frame does not need to be processed.
+    bool update_power_save();
+
     void colormap(int x, int y, float v, float vmin, float vmax);
 
+    // Colors the image, at display resolution when upscaling on the CPU.
+    void map_colors();
+
+    void set_upscale_quality(UpscaleQuality quality);
+
+    // Factor 0 shows the sensor resolution. Super-resolution only runs when upscaling on the CPU.
+    void set_super_resolution(int factor);
+
+    bool is_super_resolution_active() const;
+
     void render_sensor_frame() const;
 
-    void render_text(const std::string &text, const SDL_Color &text_color, SDL_Point origin, int anchor,
-                     TTF_Font *font) const;
+    // Screen rectangle of text at origin, measured from the corner given by anchor: 0 top left, 1 top right, 2 bottom
+    // right, 3 bottom left.
+    SDL_Rect text_rect(const char *text, SDL_Point origin, int anchor, TTF_Font *font) const;
+
+    void render_text(const char *text, const SDL_Color &text_color, SDL_Point origin, int anchor,
+                     TTF_Font *font);
+
+    void render_slider();
+
+    // Slider band including the marker, and the x position of the marker.
+    SDL_Rect slider_rect() const;
+
+    int slider_marker_x() const;
 
-    void render_slider() const;
+    const char *skin_label() const;
 
-    void render_temp_labels() const;
+    // Compares the layers with the last present; a redraw is needed when dirty.is_dirty().
+    void update_dirty_region();
+
+    void render_temp_labels();
+
+    bool advance_animation();
 
     void render_animation();
 
-    void screenshot();
+    void render_perf_overlay();
+
+    // Copies the raw and To frames and the measurement of the processed frame into the shared memory ring.
+    void publish_frame(int measured_pixels);
+
+    void write_perf_log() const;
+
+    void write_benchmark_report() const;
+
+    // Stops counting the allocations of the headless frames and reports them.
+    void check_allocations();
 };
 
 
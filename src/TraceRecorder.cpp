@@ -0,0 +1,163 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <cstdio>
+#include "PerfStats.h"
+#include "TraceRecorder.h"
+
+volatile sig_atomic_t TraceRecorder::requested = 0;
+
+namespace {
+
+void on_trace_signal(int) {
+    tracer().request();
+}
+
+}
+
+TraceRecorder &tracer() {
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+thread_local TraceRecorder::ThreadSlot TraceRecorder::slot;
+
+TraceRecorder::TraceRecorder() : active(false), deadline(0), duration(0), is_writing(false), is_write_ok(false) {
+}
+
+TraceRecorder::~TraceRecorder() {
+    if (writer.joinable()) {
+        writer.join();
+    }
+}
+
+TraceRecorder::ThreadSlot::~ThreadSlot() {
+    if (buffer != nullptr) {
+        buffer->is_owned.store(false, std::memory_order_release);
+    }
+}
+
+void TraceRecorder::register_thread(const char *name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (slot.buffer == nullptr) {
+        // A buffer of an ended thread may still hold events of the running capture.
+        if (!enabled()) {
+            for (auto &buffer : buffers) {
+                if (!buffer->is_owned.load(std::memory_order_acquire)) {
+                    slot.buffer = buffer.get();
+                    break;
+                }
+            }
+        }
+        if (slot.buffer == nullptr) {
+            buffers.emplace_back(new ThreadBuffer());
+            slot.buffer = buffers.back().get();
+            slot.buffer->events.resize(EVENTS_PER_THREAD);
+            slot.buffer->tid = static_cast<int>(buffers.size());
+        }
+        slot.buffer->size.store(0, std::memory_order_relaxed);
+        slot.buffer->is_owned.store(true, std::memory_order_relaxed);
+    }
+    slot.buffer->name = name;
+}
+
+void TraceRecorder::record(const char *name, const uint64_t begin, const uint64_t end) {
+    ThreadBuffer *buffer = slot.buffer;
+    if (!enabled() || buffer == nullptr) {
+        return;
+    }
+    const size_t n = buffer->size.load(std::memory_order_relaxed);
+    if (n >= buffer->events.size()) {
+        return;
+    }
+    buffer->events[n] = {name, begin, end};
+    buffer->size.store(n + 1, std::memory_order_release);
+}
+
+void TraceRecorder::start(const uint64_t duration_nanos) {
+    // The writer still reads the buffers of the previous capture.
+    if (enabled() || writer.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &buffer : buffers) {
+            buffer->size.store(0, std::memory_order_relaxed);
+        }
+    }
+    duration = duration_nanos;
+    deadline.store(now_nanos() + duration_nanos, std::memory_order_relaxed);
+    active.store(true, std::memory_order_release);
+}
+
+void TraceRecorder::install_signal_handler(const int signal_number) {
+    signal(signal_number, on_trace_signal);
+}
+
+bool TraceRecorder::poll(const std::string &path) {
+    bool is_written = false;
+    if (writer.joinable() && !is_writing.load(std::memory_order_acquire)) {
+        writer.join();
+        is_written = is_write_ok;
+    }
+    if (requested && !writer.joinable()) {
+        requested = 0;
+        start(duration > 0 ? duration : 5000000000ull);
+    }
+    if (enabled() && now_nanos() >= deadline.load(std::memory_order_relaxed)) {
+        // Stop first: the writer only reads the events that were complete when it looks at a buffer, and nothing is
+        // recorded into them until the next capture, which waits for the writer.
+        active.store(false, std::memory_order_release);
+        is_writing.store(true, std::memory_order_relaxed);
+        writer = std::thread([this, path] {
+            is_write_ok = write(path);
+            is_writing.store(false, std::memory_order_release);
+        });
+    }
+    return is_written;
+}
+
+bool TraceRecorder::write(const std::string &path) {
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"ThermalCamera\"}}");
+    for (const auto &buffer : buffers) {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                buffer->tid, buffer->name.c_str());
+        const size_t n = buffer->size.load(std::memory_order_acquire);
+        for (size_t i = 0; i < n; i++) {
+            const TraceEvent &event = buffer->events[i];
+            // Timestamps are in microseconds, with nanosecond resolution in the fraction.
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    event.name, buffer->tid, event.begin * 1e-3, (event.end - event.begin) * 1e-3);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+}
+
+ScopedTrace::ScopedTrace(const char *name) : name(name), begin(tracer().enabled() ? now_nanos() : 0) {
+}
+
+ScopedTrace::~ScopedTrace() {
+    if (begin != 0) {
+        tracer().record(name, begin, now_nanos());
+    }
+}
@@ -0,0 +1,125 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_TRACERECORDER_H
+#define THERMALCAM_TRACERECORDER_H
+
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct TraceEvent {
+    // Must point to a string literal, names are not copied.
+    const char *name;
+    uint64_t begin;
+    uint64_t end;
+};
+
+
+// Captures spans of all threads for a limited time and writes them as Chrome / Perfetto trace-event JSON.
+// Every thread writes into its own preallocated buffer, so recording takes no locks and does not allocate. A thread
+// gets its buffer when it registers; threads that did not register are not traced. When no capture is running, a
+// trace point costs a single relaxed atomic load. The trace is written on a thread of its own after the capture has
+// stopped, and no new capture starts before it is written.
+class TraceRecorder {
+
+public:
+    TraceRecorder();
+
+    ~TraceRecorder();
+
+    bool enabled() const { return active.load(std::memory_order_relaxed); }
+
+    void record(const char *name, uint64_t begin, uint64_t end);
+
+    // Allocates the buffer of the calling thread. Call it when the thread starts, before any capture can record on
+    // it. The buffer of a thread that ended is reused.
+    void register_thread(const char *name);
+
+    void start(uint64_t duration_nanos);
+
+    // Starts a capture when requested by signal, and starts writing the trace to path when the running capture is
+    // done. Returns true once a trace file was written.
+    bool poll(const std::string &path);
+
+    void request() { requested = 1; }
+
+    void install_signal_handler(int signal_number);
+
+    static const size_t EVENTS_PER_THREAD = 32768;
+
+private:
+    struct ThreadBuffer {
+        std::vector<TraceEvent> events;
+        std::atomic<size_t> size;
+        int tid;
+        std::string name;
+        // False once the thread that registered it has ended.
+        std::atomic<bool> is_owned;
+    };
+
+    // Buffer of the calling thread, released when the thread ends.
+    struct ThreadSlot {
+        ThreadBuffer *buffer = nullptr;
+
+        ~ThreadSlot();
+    };
+
+    static thread_local ThreadSlot slot;
+
+    bool write(const std::string &path);
+
+    std::atomic<bool> active;
+    std::atomic<uint64_t> deadline;
+    static volatile sig_atomic_t requested;
+    uint64_t duration;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    // Writes the finished capture. Only the thread that calls poll() and start() touches it.
+    std::thread writer;
+    std::atomic<bool> is_writing;
+    bool is_write_ok;
+};
+
+TraceRecorder &tracer();
+
+
+// Records the span between construction and destruction, if a capture is running.
+class ScopedTrace {
+
+public:
+    explicit ScopedTrace(const char *name);
+
+    ~ScopedTrace();
+
+private:
+    const char *name;
+    uint64_t begin;
+};
+
+#ifdef THERMALCAM_DISABLE_TRACE
+#define TRACE_SCOPE(name)
+#else
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) ScopedTrace TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#endif
+
+#endif //THERMALCAM_TRACERECORDER_H
@@ -0,0 +1,173 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cmath>
+#include "Upscaler.h"
+
+namespace {
+
+const float PI = 3.14159265f;
+
+float filter_support(const UpscaleQuality quality) {
+    switch (quality) {
+        case UPSCALE_BICUBIC:
+            return 2.0f;
+        case UPSCALE_LANCZOS:
+            return 3.0f;
+        default:
+            return 1.0f;
+    }
+}
+
+float filter_weight(const UpscaleQuality quality, float x) {
+    x = fabsf(x);
+    switch (quality) {
+        case UPSCALE_BICUBIC:
+            // Catmull-Rom, a = -0.5.
+            if (x < 1.0f) {
+                return 1.5f * x * x * x - 2.5f * x * x + 1.0f;
+            }
+            return x < 2.0f ? -0.5f * x * x * x + 2.5f * x * x - 4.0f * x + 2.0f : 0.0f;
+        case UPSCALE_LANCZOS:
+            if (x < 1e-6f) {
+                return 1.0f;
+            }
+            return x < 3.0f ? 3.0f * sinf(PI * x) * sinf(PI * x / 3.0f) / (PI * PI * x * x) : 0.0f;
+        default:
+            return x < 1.0f ? 1.0f - x : 0.0f;
+    }
+}
+
+}
+
+const char *upscale_quality_name(const UpscaleQuality quality) {
+    switch (quality) {
+        case UPSCALE_GPU:
+            return "gpu";
+        case UPSCALE_BILINEAR:
+            return "bilinear";
+        case UPSCALE_BICUBIC:
+            return "bicubic";
+        case UPSCALE_LANCZOS:
+            return "lanczos";
+        default:
+            return "unknown";
+    }
+}
+
+bool parse_upscale_quality(const std::string &name, UpscaleQuality &quality) {
+    for (int i = 0; i < N_UPSCALE_QUALITIES; i++) {
+        if (name == upscale_quality_name(static_cast<UpscaleQuality>(i))) {
+            quality = static_cast<UpscaleQuality>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+Upscaler::Upscaler() : current_quality(UPSCALE_GPU), width(0), height(0), out_width(0), out_height(0) {
+}
+
+void Upscaler::build_axis(const UpscaleQuality quality, const int in_size, const int out_size, Axis &axis) {
+    const float support = filter_support(quality);
+    const float scale = static_cast<float>(in_size) / out_size;
+    axis.n_taps = 2 * static_cast<int>(support);
+    axis.index.resize(static_cast<size_t>(out_size * axis.n_taps));
+    axis.weight.resize(axis.index.size());
+    for (int o = 0; o < out_size; o++) {
+        // Centers of the output pixels on the source grid. Taps beyond the border repeat the edge pixel.
+        const float center = (o + 0.5f) * scale - 0.5f;
+        const int first = static_cast<int>(floorf(center)) - axis.n_taps / 2 + 1;
+        float sum = 0.0f;
+        for (int k = 0; k < axis.n_taps; k++) {
+            const int i = o * axis.n_taps + k;
+            axis.index[i] = std::min(std::max(first + k, 0), in_size - 1);
+            axis.weight[i] = filter_weight(quality, center - (first + k));
+            sum += axis.weight[i];
+        }
+        for (int k = 0; k < axis.n_taps; k++) {
+            axis.weight[o * axis.n_taps + k] /= sum;
+        }
+    }
+}
+
+void Upscaler::configure(const UpscaleQuality quality, const int width, const int height, const int out_width,
+                         const int out_height) {
+    current_quality = quality;
+    this->width = width;
+    this->height = height;
+    this->out_width = out_width;
+    this->out_height = out_height;
+    if (quality == UPSCALE_GPU) {
+        return;
+    }
+    build_axis(quality, width, out_width, columns);
+    build_axis(quality, height, out_height, rows);
+    intermediate.resize(static_cast<size_t>(height * out_width));
+}
+
+void Upscaler::run(const float *source, const float vmin, const float vmax, const uint32_t *palette,
+                   uint32_t *output, WorkerPool &pool) {
+    const size_t n_bands = pool.concurrency();
+    row_buffers.resize(n_bands * out_width);
+
+    pool.run(n_bands, [this, source, n_bands](size_t band) {
+        const int n_taps = columns.n_taps;
+        for (int y = static_cast<int>(band * height / n_bands); y < static_cast<int>((band + 1) * height / n_bands);
+             y++) {
+            const float *in = source + y * width;
+            float *out = intermediate.data() + y * out_width;
+            for (int x = 0; x < out_width; x++) {
+                const int *index = columns.index.data() + x * n_taps;
+                const float *weight = columns.weight.data() + x * n_taps;
+                float sum = 0.0f;
+                for (int k = 0; k < n_taps; k++) {
+                    sum += weight[k] * in[index[k]];
+                }
+                out[x] = sum;
+            }
+        }
+    }, "upscale rows");
+
+    // Palette index = (v - vmin) * scale, rounded and clamped to 0..255.
+    const float scale = 255.0f / (vmax - vmin);
+    const float offset = 0.5f - vmin * scale;
+    pool.run(n_bands, [this, scale, offset, palette, output, n_bands](size_t band) {
+        const int n_taps = rows.n_taps;
+        float *__restrict acc = row_buffers.data() + band * out_width;
+        for (int y = static_cast<int>(band * out_height / n_bands);
+             y < static_cast<int>((band + 1) * out_height / n_bands); y++) {
+            const int *index = rows.index.data() + y * n_taps;
+            const float *weight = rows.weight.data() + y * n_taps;
+            std::fill(acc, acc + out_width, 0.0f);
+            for (int k = 0; k < n_taps; k++) {
+                const float *__restrict in = intermediate.data() + index[k] * out_width;
+                const float w = weight[k];
+                for (int x = 0; x < out_width; x++) {
+                    acc[x] += w * in[x];
+                }
+            }
+            uint32_t *out = output + y * out_width;
+            for (int x = 0; x < out_width; x++) {
+                // Written as selects, so that NaN maps to 0 and the loop still vectorizes.
+                float level = acc[x] * scale + offset;
+                level = level > 0.0f ? level : 0.0f;
+                level = level < 255.0f ? level : 255.0f;
+                out[x] = palette[static_cast<int>(level)];
+            }
+        }
+    }, "upscale columns");
+}
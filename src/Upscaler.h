@@ -0,0 +1,83 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_UPSCALER_H
+#define THERMALCAM_UPSCALER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "WorkerPool.h"
+
+// Quality tiers of the upscaler, from cheapest to sharpest.
+enum UpscaleQuality {
+    // The GPU stretches the sensor image, with the bilinear filter of the driver.
+    UPSCALE_GPU,
+    UPSCALE_BILINEAR,
+    // Catmull-Rom cubic, 4 taps per axis.
+    UPSCALE_BICUBIC,
+    // Lanczos with 3 lobes, 6 taps per axis.
+    UPSCALE_LANCZOS,
+    N_UPSCALE_QUALITIES
+};
+
+const char *upscale_quality_name(UpscaleQuality quality);
+
+// Returns false when name is not one of the names of upscale_quality_name().
+bool parse_upscale_quality(const std::string &name, UpscaleQuality &quality);
+
+
+// Separable resampling of the temperature image to display resolution, fused with the colormap. The filter taps and
+// weights of every output column and row are computed once by configure(). The horizontal pass filters the few
+// source rows, the vertical pass combines whole intermediate rows, so its inner loop runs over contiguous floats and
+// is vectorized by the compiler. Both passes are split in bands of rows over the threads of a worker pool.
+class Upscaler {
+
+public:
+    Upscaler();
+
+    // Prepares the filter tables for a width x height source and an out_width x out_height output.
+    void configure(UpscaleQuality quality, int width, int height, int out_width, int out_height);
+
+    UpscaleQuality quality() const { return current_quality; }
+
+    // Resamples source (row major) and maps the values from vmin to vmax on the 256 colors of palette.
+    void run(const float *source, float vmin, float vmax, const uint32_t *palette, uint32_t *output,
+             WorkerPool &pool);
+
+private:
+    // Filter taps of one axis: for every output position, n_taps source indices and weights.
+    struct Axis {
+        int n_taps;
+        std::vector<int> index;
+        std::vector<float> weight;
+    };
+
+    static void build_axis(UpscaleQuality quality, int in_size, int out_size, Axis &axis);
+
+    UpscaleQuality current_quality;
+    int width;
+    int height;
+    int out_width;
+    int out_height;
+    Axis columns;
+    Axis rows;
+    // Source rows after the horizontal pass, height x out_width.
+    std::vector<float> intermediate;
+    // One output row per band, before the colormap.
+    std::vector<float> row_buffers;
+};
+
+#endif //THERMALCAM_UPSCALER_H
@@ -0,0 +1,414 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <SDL2/SDL.h>
+#ifdef THERMALCAM_HAVE_LIBAV
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+}
+#endif
+#include "VideoRecorder.h"
+#include "AllocationCounter.h"
+#include "TraceRecorder.h"
+
+namespace {
+
+bool has_video_extension(const std::string &path) {
+    const size_t dot = path.rfind('.');
+    if (dot == std::string::npos) {
+        return false;
+    }
+    const std::string extension = path.substr(dot);
+    return extension == ".mp4" || extension == ".mkv" || extension == ".avi";
+}
+
+#ifdef THERMALCAM_HAVE_LIBAV
+
+// BT.601 coefficients in 8 bit fixed point, for the limited (video) or full (JPEG) range.
+struct YuvCoefficients {
+    int y[3];
+    int u[3];
+    int v[3];
+    int y_offset;
+};
+
+const YuvCoefficients LIMITED_RANGE = {{66, 129, 25}, {-38, -74, 112}, {112, -94, -18}, 16};
+const YuvCoefficients FULL_RANGE = {{77, 150, 29}, {-43, -85, 128}, {128, -107, -21}, 0};
+
+// Converts ARGB8888 to planar YUV 4:2:0, with the chroma of every 2 x 2 block averaged.
+void argb_to_yuv420(const uint32_t *argb, const int pitch, AVFrame *frame, const YuvCoefficients &c) {
+    for (int y = 0; y < frame->height; y += 2) {
+        const uint32_t *row0 = reinterpret_cast<const uint32_t *>(reinterpret_cast<const uint8_t *>(argb) + y * pitch);
+        const uint32_t *row1 = reinterpret_cast<const uint32_t *>(reinterpret_cast<const uint8_t *>(row0) + pitch);
+        uint8_t *y0 = frame->data[0] + y * frame->linesize[0];
+        uint8_t *y1 = y0 + frame->linesize[0];
+        uint8_t *u = frame->data[1] + y / 2 * frame->linesize[1];
+        uint8_t *v = frame->data[2] + y / 2 * frame->linesize[2];
+        for (int x = 0; x < frame->width; x += 2) {
+            const uint32_t p[4] = {row0[x], row0[x + 1], row1[x], row1[x + 1]};
+            int r_sum = 0, g_sum = 0, b_sum = 0;
+            for (int i = 0; i < 4; i++) {
+                const int r = static_cast<int>(p[i] >> 16u & 0xffu);
+                const int g = static_cast<int>(p[i] >> 8u & 0xffu);
+                const int b = static_cast<int>(p[i] & 0xffu);
+                const int luma = ((c.y[0] * r + c.y[1] * g + c.y[2] * b + 128) >> 8) + c.y_offset;
+                (i < 2 ? y0 : y1)[x + (i & 1)] = static_cast<uint8_t>(luma);
+                r_sum += r;
+                g_sum += g;
+                b_sum += b;
+            }
+            const int r = (r_sum + 2) >> 2;
+            const int g = (g_sum + 2) >> 2;
+            const int b = (b_sum + 2) >> 2;
+            u[x / 2] = static_cast<uint8_t>(((c.u[0] * r + c.u[1] * g + c.u[2] * b + 128) >> 8) + 128);
+            v[x / 2] = static_cast<uint8_t>(((c.v[0] * r + c.v[1] * g + c.v[2] * b + 128) >> 8) + 128);
+        }
+    }
+}
+
+#endif
+
+}
+
+VideoRecorder::VideoRecorder() : is_video(false), is_blocking(false), width(0), height(0), fps(0), is_running(false),
+                                 is_stopping(false), is_failed(false), next_sequence(0), first_nanos(0),
+                                 last_pts(-1), n_submitted(0), n_written(0), n_dropped(0), format(nullptr),
+                                 codec(nullptr), stream(nullptr), frame(nullptr), packet(nullptr) {
+}
+
+VideoRecorder::~VideoRecorder() {
+    close();
+}
+
+bool VideoRecorder::open(const std::string &file_path, const int w, const int h, const int rate,
+                         const bool blocking) {
+    close();
+    path = file_path;
+    is_video = has_video_extension(path);
+    is_blocking = blocking;
+    width = w;
+    height = h;
+    fps = rate;
+    is_failed = false;
+    first_nanos = 0;
+    last_pts = -1;
+    if (is_video) {
+        if (!open_encoder()) {
+            close_encoder();
+            return false;
+        }
+    } else {
+        codec_name = "bmp";
+    }
+    slots.resize(N_SLOTS);
+    for (Slot &slot : slots) {
+        slot.pixels.assign(static_cast<size_t>(width) * height, 0);
+        slot.state = SLOT_FREE;
+    }
+    is_stopping = false;
+    is_running = true;
+    thread = std::thread(&VideoRecorder::write_loop, this);
+    return true;
+}
+
+void VideoRecorder::close() {
+    if (!is_running) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        is_stopping = true;
+    }
+    queued.notify_all();
+    thread.join();
+    is_running = false;
+}
+
+int VideoRecorder::acquire() {
+    if (!is_running) {
+        return -1;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        // After a write error the writer thread is gone, and nothing would ever empty a buffer that is handed out.
+        if (is_failed) {
+            return -1;
+        }
+        for (int i = 0; i < N_SLOTS; i++) {
+            if (slots[i].state == SLOT_FREE) {
+                slots[i].state = SLOT_FILLING;
+                return i;
+            }
+        }
+        if (!is_blocking) {
+            break;
+        }
+        freed.wait(lock);
+    }
+    // Drop the oldest waiting frame and reuse its buffer.
+    int oldest = -1;
+    for (int i = 0; i < N_SLOTS; i++) {
+        if (slots[i].state == SLOT_QUEUED && (oldest < 0 || slots[i].sequence < slots[oldest].sequence)) {
+            oldest = i;
+        }
+    }
+    if (oldest >= 0) {
+        slots[oldest].state = SLOT_FILLING;
+    }
+    n_dropped++;
+    return oldest;
+}
+
+void VideoRecorder::submit(const int slot, const uint64_t nanos) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        slots[slot].nanos = nanos;
+        slots[slot].sequence = next_sequence++;
+        slots[slot].state = SLOT_QUEUED;
+        n_submitted++;
+    }
+    queued.notify_one();
+}
+
+bool VideoRecorder::push(const uint32_t *image, const int image_pitch, const uint64_t nanos) {
+    const int slot = acquire();
+    if (slot < 0) {
+        return false;
+    }
+    for (int y = 0; y < height; y++) {
+        memcpy(pixels(slot) + y * width, reinterpret_cast<const uint8_t *>(image) + y * image_pitch,
+               width * sizeof(uint32_t));
+    }
+    submit(slot, nanos);
+    return true;
+}
+
+void VideoRecorder::write_loop() {
+    // Encoding and writing files allocate, off the frame pipeline.
+    AllocationCounter::ignore_thread();
+    tracer().register_thread("video writer");
+    while (true) {
+        int slot = -1;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                for (int i = 0; i < N_SLOTS; i++) {
+                    if (slots[i].state == SLOT_QUEUED && (slot < 0 || slots[i].sequence < slots[slot].sequence)) {
+                        slot = i;
+                    }
+                }
+                if (slot >= 0 || is_stopping) {
+                    break;
+                }
+                queued.wait(lock);
+            }
+            if (slot < 0) {
+                break;
+            }
+            slots[slot].state = SLOT_WRITING;
+        }
+        const uint64_t begin = now_nanos();
+        const bool is_written = write_frame(slots[slot]);
+        const uint64_t end = now_nanos();
+        write_time.record(end - begin);
+        tracer().record("write frame", begin, end);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slots[slot].state = SLOT_FREE;
+            n_written += is_written;
+            if (!is_written) {
+                is_failed = true;
+            }
+        }
+        freed.notify_all();
+        if (!is_written) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to write a frame to %s, recording stopped",
+                         path.c_str());
+            break;
+        }
+    }
+    if (is_video) {
+        close_encoder();
+    }
+}
+
+bool VideoRecorder::write_frame(const Slot &slot) {
+    if (is_video) {
+        return encode(slot);
+    }
+    char name[16];
+    snprintf(name, sizeof(name), "/%05llu.bmp", static_cast<unsigned long long>(n_written));
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(const_cast<uint32_t *>(slot.pixels.data()), width,
+                                                              height, 32, pitch(), SDL_PIXELFORMAT_ARGB8888);
+    if (surface == nullptr) {
+        return false;
+    }
+    const bool is_saved = SDL_SaveBMP(surface, (path + name).c_str()) == 0;
+    SDL_FreeSurface(surface);
+    return is_saved;
+}
+
+#ifdef THERMALCAM_HAVE_LIBAV
+
+bool VideoRecorder::open_encoder() {
+    if (avformat_alloc_output_context2(&format, nullptr, nullptr, path.c_str()) < 0 || format == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unknown video container %s", path.c_str());
+        return false;
+    }
+    // The hardware encoders of the Pi first: the CPU is needed for the image pipeline.
+    const char *names[] = {"h264_v4l2m2m", "h264_omx", "libx264", "mjpeg"};
+    for (const char *name : names) {
+        const AVCodec *encoder = avcodec_find_encoder_by_name(name);
+        if (encoder == nullptr) {
+            continue;
+        }
+        codec = avcodec_alloc_context3(encoder);
+        codec->width = width & ~1;
+        codec->height = height & ~1;
+        codec->time_base = {1, 1000};
+        codec->framerate = {fps, 1};
+        codec->gop_size = fps;
+        codec->max_b_frames = 0;
+        codec->bit_rate = BIT_RATE;
+        codec->pix_fmt = encoder->id == AV_CODEC_ID_MJPEG ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_YUV420P;
+        if (format->oformat->flags & AVFMT_GLOBALHEADER) {
+            codec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+        if (encoder->id == AV_CODEC_ID_H264 && codec->priv_data != nullptr) {
+            // libx264 only; the other encoders ignore unknown options.
+            av_opt_set(codec->priv_data, "preset", "ultrafast", 0);
+            av_opt_set(codec->priv_data, "tune", "zerolatency", 0);
+        }
+        if (avcodec_open2(codec, encoder, nullptr) == 0) {
+            codec_name = name;
+            break;
+        }
+        avcodec_free_context(&codec);
+    }
+    if (codec == nullptr) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "No H.264 or MJPEG encoder available for %s", path.c_str());
+        return false;
+    }
+    stream = avformat_new_stream(format, nullptr);
+    if (stream == nullptr || avcodec_parameters_from_context(stream->codecpar, codec) < 0) {
+        return false;
+    }
+    stream->time_base = codec->time_base;
+    if (!(format->oformat->flags & AVFMT_NOFILE) && avio_open(&format->pb, path.c_str(), AVIO_FLAG_WRITE) < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to open %s", path.c_str());
+        return false;
+    }
+    if (avformat_write_header(format, nullptr) < 0) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to write the header of %s", path.c_str());
+        return false;
+    }
+    frame = av_frame_alloc();
+    packet = av_packet_alloc();
+    if (frame == nullptr || packet == nullptr) {
+        return false;
+    }
+    frame->format = codec->pix_fmt;
+    frame->width = codec->width;
+    frame->height = codec->height;
+    return av_frame_get_buffer(frame, 32) == 0;
+}
+
+bool VideoRecorder::encode(const Slot &slot) {
+    if (av_frame_make_writable(frame) < 0) {
+        return false;
+    }
+    argb_to_yuv420(slot.pixels.data(), pitch(), frame,
+                   codec->pix_fmt == AV_PIX_FMT_YUVJ420P ? FULL_RANGE : LIMITED_RANGE);
+    // Milliseconds since the first frame; frames that were not presented leave a longer gap.
+    if (first_nanos == 0) {
+        first_nanos = slot.nanos;
+    }
+    const auto pts = static_cast<int64_t>((slot.nanos - first_nanos) / 1000000);
+    last_pts = std::max(pts, last_pts + 1);
+    frame->pts = last_pts;
+    return send(frame);
+}
+
+bool VideoRecorder::send(AVFrame *av_frame) {
+    if (avcodec_send_frame(codec, av_frame) < 0) {
+        return false;
+    }
+    while (true) {
+        const int result = avcodec_receive_packet(codec, packet);
+        if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) {
+            return true;
+        }
+        if (result < 0) {
+            return false;
+        }
+        av_packet_rescale_ts(packet, codec->time_base, stream->time_base);
+        packet->stream_index = stream->index;
+        if (av_interleaved_write_frame(format, packet) < 0) {
+            return false;
+        }
+    }
+}
+
+void VideoRecorder::close_encoder() {
+    if (format != nullptr && frame != nullptr) {
+        // Flush the frames the encoder still holds, then finish the container.
+        send(nullptr);
+        av_write_trailer(format);
+    }
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    avcodec_free_context(&codec);
+    if (format != nullptr) {
+        if (!(format->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&format->pb);
+        }
+        avformat_free_context(format);
+        format = nullptr;
+    }
+    stream = nullptr;
+}
+
+#else
+
+bool VideoRecorder::open_encoder() {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Built without libavcodec, unable to record %s", path.c_str());
+    return false;
+}
+
+bool VideoRecorder::encode(const Slot &) {
+    return false;
+}
+
+bool VideoRecorder::send(AVFrame *) {
+    return false;
+}
+
+void VideoRecorder::close_encoder() {
+}
+
+#endif
+
+void VideoRecorder::write(FILE *file) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    fprintf(file, "recording %s (%s)  frames %llu  written %llu  dropped %llu  write p50 %.2f  p99 %.2f  max %.2f ms\n",
+            path.c_str(), codec_name.c_str(), static_cast<unsigned long long>(n_submitted),
+            static_cast<unsigned long long>(n_written), static_cast<unsigned long long>(n_dropped),
+            write_time.percentile(0.50) * 1e-6, write_time.percentile(0.99) * 1e-6, write_time.max() * 1e-6);
+}
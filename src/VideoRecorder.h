@@ -0,0 +1,140 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_VIDEORECORDER_H
+#define THERMALCAM_VIDEORECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "PerfStats.h"
+
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+struct AVPacket;
+struct AVStream;
+
+// Writes rendered frames on a background thread, so that encoding and file I/O never stall the display loop. A path
+// ending in .mp4, .mkv or .avi is encoded with libavcodec: the H.264 encoder of the Pi (V4L2 M2M or OMX), otherwise
+// libx264, otherwise MJPEG. Any other path is a directory that gets one BMP per frame.
+//
+// The frames go through a fixed pool of image buffers: the display loop acquires a free buffer, fills it and submits
+// it to the queue of the writer thread. When all buffers are taken, the oldest frame that is still waiting is dropped
+// and its buffer reused, so the recording stays close to live. In blocking mode, used offline, acquire() waits for
+// the writer instead.
+class VideoRecorder {
+
+public:
+    VideoRecorder();
+
+    virtual ~VideoRecorder();
+
+    // Starts writing width x height frames to path. fps is the nominal rate of the video; the time stamps follow the
+    // submit times, so frames that were not presented make no gaps.
+    bool open(const std::string &path, int width, int height, int fps, bool is_blocking = false);
+
+    // Writes the frames that are still queued and stops the thread.
+    void close();
+
+    bool is_open() const { return is_running && !is_failed.load(); }
+
+    // True when writing a frame failed. The writer thread has stopped then; close() the recorder.
+    bool failed() const { return is_failed.load(); }
+
+    // Returns a buffer of width x height ARGB8888 pixels, pitch() bytes per row, or -1 when the recorder is closed or
+    // failed, or when no buffer can be taken.
+    int acquire();
+
+    uint32_t *pixels(int slot) { return slots[slot].pixels.data(); }
+
+    int pitch() const { return width * static_cast<int>(sizeof(uint32_t)); }
+
+    // Queues a filled buffer, captured at nanos on the monotonic clock.
+    void submit(int slot, uint64_t nanos);
+
+    // Copies an image (pitch in bytes) into a buffer and queues it. Returns false when the frame was not queued.
+    bool push(const uint32_t *image, int image_pitch, uint64_t nanos);
+
+    void write(FILE *file) const;
+
+private:
+    enum SlotState {
+        SLOT_FREE,
+        SLOT_FILLING,
+        SLOT_QUEUED,
+        SLOT_WRITING
+    };
+
+    struct Slot {
+        std::vector<uint32_t> pixels;
+        uint64_t nanos;
+        // Submit order, to find the oldest queued frame.
+        uint64_t sequence;
+        SlotState state;
+    };
+
+    // Number of image buffers: one being written, one being filled and two waiting.
+    const int N_SLOTS = 4;
+    const int BIT_RATE = 2000000;
+
+    void write_loop();
+
+    bool write_frame(const Slot &slot);
+
+    bool open_encoder();
+
+    bool encode(const Slot &slot);
+
+    // Sends the frame, or nullptr to flush, and writes the packets that come out.
+    bool send(AVFrame *av_frame);
+
+    void close_encoder();
+
+    std::string path;
+    bool is_video;
+    bool is_blocking;
+    int width;
+    int height;
+    int fps;
+    std::vector<Slot> slots;
+    std::thread thread;
+    mutable std::mutex mutex;
+    std::condition_variable queued;
+    std::condition_variable freed;
+    bool is_running;
+    bool is_stopping;
+    std::atomic<bool> is_failed;
+    uint64_t next_sequence;
+    uint64_t first_nanos;
+    int64_t last_pts;
+    uint64_t n_submitted;
+    uint64_t n_written;
+    uint64_t n_dropped;
+    LatencyHistogram write_time;
+    std::string codec_name;
+    AVFormatContext *format;
+    AVCodecContext *codec;
+    AVStream *stream;
+    AVFrame *frame;
+    AVPacket *packet;
+};
+
+#endif //THERMALCAM_VIDEORECORDER_H
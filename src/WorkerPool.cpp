@@ -0,0 +1,105 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <string>
+#include "TraceRecorder.h"
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(const size_t n_threads) : current_function(nullptr), current_task(nullptr),
+                                                 current_name(nullptr), n_tasks(0), generation(0), next(0),
+                                                 remaining(0), active_workers(0), is_stopping(false) {
+    for (size_t i = 0; i < n_threads; i++) {
+        threads.emplace_back(&WorkerPool::work_loop, this, i);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        is_stopping = true;
+    }
+    wake.notify_all();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::dispatch(const size_t n, const TaskFunction function, const void *task, const char *name) {
+    if (threads.empty() || n == 1) {
+        for (size_t i = 0; i < n; i++) {
+            TRACE_SCOPE(name);
+            function(task, i);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current_function = function;
+        current_task = task;
+        current_name = name;
+        n_tasks = n;
+        next.store(0);
+        remaining.store(n);
+        generation++;
+    }
+    wake.notify_all();
+    work(function, task, name, n);
+    // Wait until the last iteration is done and no worker still looks at this loop.
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return remaining.load() == 0 && active_workers == 0; });
+    current_task = nullptr;
+}
+
+void WorkerPool::work(const TaskFunction function, const void *task, const char *name, const size_t n) {
+    for (size_t i = next.fetch_add(1); i < n; i = next.fetch_add(1)) {
+        {
+            TRACE_SCOPE(name);
+            function(task, i);
+        }
+        if (remaining.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(mutex);
+            done.notify_all();
+        }
+    }
+}
+
+void WorkerPool::work_loop(const size_t worker) {
+    const std::string name = "worker " + std::to_string(worker + 1);
+    tracer().register_thread(name.c_str());
+    uint64_t seen = 0;
+    while (true) {
+        TaskFunction function;
+        const void *task;
+        const char *task_name;
+        size_t n;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this, seen] { return is_stopping || (generation != seen && current_task != nullptr); });
+            if (is_stopping) {
+                return;
+            }
+            seen = generation;
+            function = current_function;
+            task = current_task;
+            task_name = current_name;
+            n = n_tasks;
+            active_workers++;
+        }
+        work(function, task, task_name, n);
+        std::lock_guard<std::mutex> lock(mutex);
+        active_workers--;
+        done.notify_all();
+    }
+}
@@ -0,0 +1,77 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#ifndef THERMALCAM_WORKERPOOL_H
+#define THERMALCAM_WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads that run the iterations of a parallel loop. The calling thread takes part in the loop, so a
+// pool without threads runs everything inline.
+class WorkerPool {
+
+public:
+    // Starts n_threads workers next to the calling thread.
+    explicit WorkerPool(size_t n_threads);
+
+    virtual ~WorkerPool();
+
+    // Runs task(0) .. task(n - 1) and returns when all of them are done. The task is called through a plain function
+    // pointer instead of a std::function, which would allocate for lambdas with more than two captures. Every call of
+    // the task is traced as a span called name, on the thread that runs it; name must be a string literal.
+    template<typename Task>
+    void run(size_t n, const Task &task, const char *name = "task") {
+        dispatch(n, &call<Task>, &task, name);
+    }
+
+    // Number of loop iterations that can run at the same time.
+    size_t concurrency() const { return threads.size() + 1; }
+
+private:
+    typedef void (*TaskFunction)(const void *task, size_t i);
+
+    template<typename Task>
+    static void call(const void *task, size_t i) {
+        (*static_cast<const Task *>(task))(i);
+    }
+
+    void dispatch(size_t n, TaskFunction function, const void *task, const char *name);
+
+    void work_loop(size_t worker);
+
+    void work(TaskFunction function, const void *task, const char *name, size_t n);
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    TaskFunction current_function;
+    const void *current_task;
+    const char *current_name;
+    size_t n_tasks;
+    uint64_t generation;
+    std::atomic<size_t> next;
+    std::atomic<size_t> remaining;
+    size_t active_workers;
+    bool is_stopping;
+};
+
+#endif //THERMALCAM_WORKERPOOL_H
@@ -16,18 +16,28 @@ limitations under the License.
 #ifndef THERMALCAM_CONSTANTS_H
 #define THERMALCAM_CONSTANTS_H
 
+#include "SensorModel.h"
 
 #define MLX_I2C_ADDR 0x33
-#define SENSOR_W 24
-#define SENSOR_H 32
+#define MLX_I2C_BUS 1
+// Size of the sensor image on screen. The image is rotated to portrait orientation, so its width is the number of
+// sensor rows and its height the number of sensor columns.
+#define IMAGE_W SensorModel::ROWS
+#define IMAGE_H SensorModel::COLUMNS
+// Default refresh rate, can be changed at runtime.
 // Valid frame rates are 1, 2, 4, 8, 16, 32 and 64
-#define FPS 16
 // The i2c baudrate is set to 1mhz to support these
-#define FRAME_TIME_MICROS (1000000/FPS)
-// Despite the framerate being ostensibly FPS hz
-// The frame is often not ready in time
-// This offset is added to the FRAME_TIME_MICROS
-// to account for this.
-#define OFFSET_MICROS 850
+#define FPS 16
+// The reflected temperature is estimated as the sensor temperature
+// minus this shift, by the application and by --verify.
+#define TA_SHIFT 6.0f
+// The main loop wakes up this long before the next subpage is
+// expected and polls the data ready bit for the remaining time.
+// The next wake up is aligned to the actual data ready moment, so
+// the loop follows the sensor clock without drift.
+#define SENSOR_WAKEUP_MICROS 1000
+// In triggered mode, the data ready bit is polled at this interval
+// once the measurement should have finished.
+#define SENSOR_POLL_MICROS 250
 
 #endif //THERMALCAM_CONSTANTS_H
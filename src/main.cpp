@@ -13,26 +13,25 @@ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 See the License for the specific language governing permissions and
 limitations under the License.
 */
-#include <chrono>
-#include <thread>
+#include <cstdlib>
 #include "constants.h"
+#include "KernelVerifier.h"
+#include "Options.h"
 #include "ThermalCamera.h"
 
-int main() {
-    ThermalCamera thermal_camera;
-    auto frame_time = std::chrono::microseconds(FRAME_TIME_MICROS + OFFSET_MICROS);
+int main(int argc, char *argv[]) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (options.verify) {
+        exit(run_kernel_verification(options.tolerance, options.recordings));
+    }
+    ThermalCamera thermal_camera(options);
     while (thermal_camera.running()) {
-        auto start = std::chrono::system_clock::now();
-
-        thermal_camera.handle_events();
-        thermal_camera.update();
-        thermal_camera.render();
-
-        auto end = std::chrono::system_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-        std::this_thread::sleep_for(std::chrono::microseconds(frame_time - elapsed));
-
+        thermal_camera.tick();
     }
     thermal_camera.clean();
-    exit(EXIT_SUCCESS);
-}
+    exit(thermal_camera.failed() ? EXIT_FAILURE : EXIT_SUCCESS);
+}
\ No newline at end of file
@@ -0,0 +1,129 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "FramePool.h"
+
+namespace {
+
+struct Frame {
+    uint32_t values[256];
+};
+
+bool check(bool ok, const char *what) {
+    printf("%-60s %s\n", what, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+// A producer publishes frames filled with their sequence number, while readers keep copies of the latest Ref and check
+// that the frame does not change while they hold it. Returns the number of torn frames seen.
+int run_threads(FramePool<Frame> &pool, int n_frames) {
+    std::mutex mutex;
+    FramePool<Frame>::Ref latest;
+    std::atomic<bool> is_done(false);
+    std::atomic<int> torn(0);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; r++) {
+        readers.emplace_back([&] {
+            while (!is_done.load()) {
+                FramePool<Frame>::Ref frame;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    frame = latest;
+                }
+                if (!frame) {
+                    continue;
+                }
+                for (int pass = 0; pass < 4; pass++) {
+                    for (uint32_t value : frame->values) {
+                        if (value != frame->values[0]) {
+                            torn++;
+                            break;
+                        }
+                    }
+                }
+            }
+        });
+    }
+    for (uint32_t sequence = 1; sequence <= static_cast<uint32_t>(n_frames);) {
+        FramePool<Frame>::Ref next = pool.acquire();
+        if (!next) {
+            std::this_thread::yield();
+            continue;
+        }
+        for (uint32_t &value : next->values) {
+            value = sequence;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        latest = std::move(next);
+        sequence++;
+    }
+    is_done = true;
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    return torn.load();
+}
+
+}
+
+// Reference counting, exhaustion and reuse of the slots of a FramePool, and frames that stay intact while readers on
+// other threads hold them.
+int main() {
+    bool ok = true;
+    FramePool<Frame> pool(4);
+
+    FramePool<Frame>::Ref a = pool.acquire();
+    ok &= check(a && a.use_count() == 1 && pool.available() == 3, "acquire takes a slot with one reference");
+    ok &= check(reinterpret_cast<uintptr_t>(a.get()) % 64 == 0, "frames are cache line aligned");
+    FramePool<Frame>::Ref b = a;
+    ok &= check(a.use_count() == 2 && b.get() == a.get(), "a copy shares the slot");
+    FramePool<Frame>::Ref c = std::move(b);
+    ok &= check(!b && c.use_count() == 2, "a move takes the reference along");
+    a.reset();
+    ok &= check(!a && c.use_count() == 1 && pool.available() == 3, "reset drops one reference");
+    Frame *slot = c.get();
+    c = FramePool<Frame>::Ref();
+    ok &= check(pool.available() == 4, "the last reference returns the slot");
+
+    std::vector<FramePool<Frame>::Ref> held;
+    for (int i = 0; i < 4; i++) {
+        held.push_back(pool.acquire());
+    }
+    FramePool<Frame>::Ref none = pool.acquire();
+    ok &= check(!none && pool.available() == 0 && pool.exhausted() == 1, "an exhausted pool returns an empty Ref");
+    bool is_reused = false;
+    for (const auto &ref : held) {
+        is_reused = is_reused || ref.get() == slot;
+    }
+    ok &= check(is_reused, "released slots are reused");
+    held.clear();
+    ok &= check(pool.available() == 4 && pool.acquire(), "all slots free again");
+
+    FramePool<Frame> large(100);
+    ok &= check(large.size() == 64, "at most 64 slots");
+
+    FramePool<Frame> shared(4);
+    const int torn = run_threads(shared, 20000);
+    printf("%d torn frames\n", torn);
+    ok &= check(torn == 0 && shared.available() == 4, "held frames are never reused");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,52 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "FrameScheduler.h"
+
+// Runs the task loop of ThermalCamera::tick with a sensor that never delivers a frame. Processing has no work and
+// must not wake up the loop, so the loop only wakes up for the sensor and display deadlines.
+int main() {
+    typedef FrameScheduler::clock clock;
+    const auto period = std::chrono::milliseconds(10);
+    const auto duration = std::chrono::milliseconds(300);
+    FrameScheduler scheduler;
+    for (int i = 0; i < N_TASKS; i++) {
+        scheduler.set_period(static_cast<Task>(i), period);
+    }
+    // One frame was processed, the next one is late or missing.
+    scheduler.complete(TASK_PROCESSING);
+    scheduler.set_pending(TASK_PROCESSING, false);
+
+    const clock::time_point end = clock::now() + duration;
+    unsigned long wakeups = 0;
+    while (clock::now() < end) {
+        scheduler.wait();
+        wakeups++;
+        if (scheduler.due(TASK_SENSOR)) {
+            scheduler.complete(TASK_SENSOR);
+        }
+        if (scheduler.due(TASK_DISPLAY)) {
+            scheduler.complete(TASK_DISPLAY);
+        }
+    }
+    // Two tasks wake up once per period each, allow for scheduling jitter.
+    const unsigned long limit = 4 * static_cast<unsigned long>(duration / period);
+    printf("%lu wakeups in %lld ms without sensor data, limit %lu\n", wakeups,
+           static_cast<long long>(duration.count()), limit);
+    return wakeups <= limit ? EXIT_SUCCESS : EXIT_FAILURE;
+}
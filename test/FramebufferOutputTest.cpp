@@ -0,0 +1,115 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include "FramebufferOutput.h"
+
+namespace {
+
+const int WIDTH = 48;
+const int HEIGHT = 32;
+// Rows of the source image are padded, as those of an SDL surface can be.
+const int PITCH = (WIDTH + 8) * 4;
+
+bool check(bool ok, const char *what) {
+    printf("%-60s %s\n", what, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+std::vector<uint32_t> make_image(uint32_t seed) {
+    std::vector<uint32_t> image(PITCH / 4 * HEIGHT, 0xDEADBEEF);
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            image[y * PITCH / 4 + x] = 0xFF000000u | (seed + static_cast<uint32_t>(y * WIDTH + x)) * 2654435761u >> 8;
+        }
+    }
+    return image;
+}
+
+// Reads the stand-in file back, as it is stored: ARGB8888 rows without padding.
+std::vector<uint32_t> read_file(const char *path) {
+    std::vector<uint32_t> pixels(WIDTH * HEIGHT);
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr || fread(pixels.data(), sizeof(uint32_t), pixels.size(), file) != pixels.size()) {
+        pixels.clear();
+    }
+    if (file != nullptr) {
+        fclose(file);
+    }
+    return pixels;
+}
+
+// Pixel of the image that was expected to be shown at x, y.
+bool matches(const std::vector<uint32_t> &shown, const std::vector<uint32_t> &image, int x, int y) {
+    return (shown[y * WIDTH + x] & 0xFFFFFFu) == (image[y * PITCH / 4 + x] & 0xFFFFFFu);
+}
+
+}
+
+// Presents images to the file that stands in for /dev/fb0 and compares the file with them: full and partial presents,
+// rectangles that are clipped at the border, and padded source rows.
+int main() {
+    char path[] = "/tmp/thermalcam-fb-XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to create a stand-in file\n");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    bool ok = true;
+    FramebufferOutput output;
+    ok &= check(output.open(path, WIDTH, HEIGHT) && output.width() == WIDTH && output.height() == HEIGHT,
+                "a regular file is a stand-in of the requested size");
+
+    const std::vector<uint32_t> first = make_image(1);
+    output.present(first.data(), PITCH);
+    std::vector<uint32_t> shown = read_file(path);
+    bool is_equal = shown.size() == WIDTH * HEIGHT;
+    for (int y = 0; is_equal && y < HEIGHT; y++) {
+        for (int x = 0; is_equal && x < WIDTH; x++) {
+            is_equal = matches(shown, first, x, y);
+        }
+    }
+    ok &= check(is_equal, "a full present shows the image");
+
+    // Only the rectangle is copied, also where it extends beyond the screen.
+    const std::vector<uint32_t> second = make_image(2);
+    const int x0 = 40;
+    const int y0 = 10;
+    output.present(second.data(), PITCH, x0, y0, 20, 8);
+    shown = read_file(path);
+    bool is_inside = shown.size() == WIDTH * HEIGHT;
+    bool is_outside = is_inside;
+    for (int y = 0; is_inside && y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            const bool is_dirty = x >= x0 && y >= y0 && y < y0 + 8;
+            is_inside = is_inside && (!is_dirty || matches(shown, second, x, y));
+            is_outside = is_outside && (is_dirty || matches(shown, first, x, y));
+        }
+    }
+    ok &= check(is_inside, "a partial present shows the changed rectangle");
+    ok &= check(is_outside, "a partial present keeps the rest");
+
+    output.present(second.data(), PITCH, -10, -10, 5, 5);
+    ok &= check(read_file(path) == shown, "a rectangle outside the screen writes nothing");
+    output.close();
+    ok &= check(!output.is_open(), "closed");
+    unlink(path);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,26 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <string>
+#include <vector>
+#include "KernelVerifier.h"
+#include "Options.h"
+
+// Same check as ThermalCamera --verify, without SDL: synthetic frames plus the recordings given on the command line,
+// at the default tolerance of --verify.
+int main(int argc, char *argv[]) {
+    const std::vector<std::string> recordings(argv + 1, argv + argc);
+    return run_kernel_verification(Options().tolerance, recordings);
+}
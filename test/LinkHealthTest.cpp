@@ -0,0 +1,127 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "FrameRecording.h"
+#include "LinkHealth.h"
+
+namespace {
+
+// Refresh rate code 0b101, 16 subpages per second.
+const uint64_t PERIOD = 62500000;
+
+bool check(bool ok, const char *what) {
+    printf("%-60s %s\n", what, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+struct Frame {
+    uint16_t words[SensorModel::FRAME_WORDS];
+};
+
+}
+
+// Frame validation on the frames of a recording: control register, subpage number and sequence, stuck bus, aux
+// range, and the decision to fail a sensor.
+int main(int argc, char *argv[]) {
+    FrameReplay replay;
+    if (argc < 2 || !replay.open(argv[1]) || replay.size() < 2) {
+        fprintf(stderr, "Usage: LinkHealthTest <recording with at least 2 frames>\n");
+        return EXIT_FAILURE;
+    }
+    std::vector<uint16_t> ee(replay.eeprom(), replay.eeprom() + SensorModel::EEPROM_WORDS);
+    paramsMLX90640 params;
+    MLX90640_ExtractParameters(ee.data(), &params);
+    // Two frames of the recording, one of each subpage, with the refresh rate the test assumes.
+    Frame frames[2];
+    for (size_t i = 0; i < replay.size(); i++) {
+        const uint16_t *words = replay.frame(i);
+        std::copy(words, words + SensorModel::FRAME_WORDS, frames[words[SensorModel::SUB_PAGE_WORD] & 1].words);
+    }
+    for (Frame &frame : frames) {
+        frame.words[SensorModel::CONTROL_WORD] = static_cast<uint16_t>(
+                (frame.words[SensorModel::CONTROL_WORD] & ~0x0388) | (0b101 << 7));
+    }
+    const uint16_t control = frames[0].words[SensorModel::CONTROL_WORD];
+    bool ok = true;
+
+    LinkHealth link;
+    uint64_t now = 1000000000;
+    ok &= check(link.validate(frames[0].words, params, nullptr, control, -1, now) == FRAME_OK, "valid frame");
+
+    Frame frame = frames[1];
+    ok &= check(link.validate(frame.words, params, nullptr, control ^ 0x0C00, -1, now += PERIOD) ==
+                FRAME_CONTROL_REGISTER, "resolution differs from the written control register");
+    ok &= check(link.validate(frame.words, params, nullptr, control ^ 0x0010, -1, now) == FRAME_OK,
+                "subpage select bits are not compared");
+
+    frame.words[SensorModel::SUB_PAGE_WORD] = 2;
+    ok &= check(link.validate(frame.words, params, nullptr, control, -1, now) == FRAME_SUB_PAGE, "subpage number 2");
+    ok &= check(link.validate(frames[1].words, params, nullptr, control, 0, now) == FRAME_SUB_PAGE,
+                "triggered measurement returned the other subpage");
+
+    // Free-running: 0 was accepted last, at the first now.
+    LinkHealth sequence;
+    now = 1000000000;
+    sequence.validate(frames[0].words, params, nullptr, control, -1, now);
+    ok &= check(sequence.validate(frames[0].words, params, nullptr, control, -1, now + PERIOD) == FRAME_SUB_PAGE,
+                "same subpage twice in a row");
+    ok &= check(sequence.validate(frames[1].words, params, nullptr, control, -1, now += PERIOD) == FRAME_OK,
+                "alternating subpages");
+    ok &= check(sequence.validate(frames[1].words, params, nullptr, control, -1, now += 2 * PERIOD) == FRAME_OK,
+                "same subpage after a missed one");
+    // Subpage repeat of subpage 1.
+    const uint16_t repeat = static_cast<uint16_t>(control | 0x0008 | 0x0010);
+    Frame repeated[2] = {frames[0], frames[1]};
+    repeated[0].words[SensorModel::CONTROL_WORD] = repeated[1].words[SensorModel::CONTROL_WORD] = repeat;
+    ok &= check(sequence.validate(repeated[1].words, params, nullptr, repeat, -1, now += PERIOD) == FRAME_OK &&
+                sequence.validate(repeated[0].words, params, nullptr, repeat, -1, now += PERIOD) == FRAME_SUB_PAGE,
+                "subpage repeat only accepts the selected subpage");
+
+    frame = frames[0];
+    std::fill(frame.words, frame.words + SensorModel::PIXELS / 2 + 1, 0xFFFF);
+    ok &= check(link.validate(frame.words, params, nullptr, control, -1, now += PERIOD) == FRAME_STUCK_BUS,
+                "most pixel words read 0xFFFF");
+    // Only the rows of the region are read, the others are whatever the buffer held.
+    const readoutMLX90640 region = {0, 20, SensorModel::ROWS - 1, 0, SensorModel::COLUMNS - 1};
+    ok &= check(link.validate(frame.words, params, &region, control, -1, now) == FRAME_OK,
+                "stuck words outside the region of interest are not counted");
+
+    frame = frames[1];
+    frame.words[SensorModel::AUX_OFFSET + 10] = 0;
+    ok &= check(link.validate(frame.words, params, nullptr, control, -1, now += PERIOD) == FRAME_AUX_RANGE,
+                "gain word 0");
+    frame = frames[1];
+    frame.words[SensorModel::AUX_OFFSET + 42] = 0x7FFF;
+    ok &= check(link.validate(frame.words, params, nullptr, control, -1, now) == FRAME_AUX_RANGE,
+                "supply voltage out of range");
+
+    // Corrupt frames are dropped, the sensor fails after MAX_DROPPED_FRAMES of them in a row or after a bus error.
+    LinkHealth failing;
+    bool is_used = failing.on_frame(FRAME_STUCK_BUS, now) || failing.on_frame(FRAME_AUX_RANGE, now);
+    ok &= check(!is_used && !failing.is_failed(), "two corrupt frames are dropped");
+    failing.on_frame(FRAME_SUB_PAGE, now);
+    ok &= check(failing.is_failed() && failing.dropped() == 3, "the third corrupt frame in a row fails the sensor");
+    failing.on_recovery(false, now);
+    ok &= check(!failing.is_retry_due(now + 10000000) && failing.is_retry_due(now + 20000000),
+                "a failed recovery doubles the back-off");
+    failing.on_recovery(true, now + 20000000);
+    ok &= check(!failing.is_failed() && failing.recoveries() == 1, "recovered");
+    ok &= check(!failing.on_frame(FRAME_BUS_ERROR, now) && failing.is_failed(), "a bus error fails the sensor");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
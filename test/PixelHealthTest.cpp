@@ -0,0 +1,106 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "PixelHealth.h"
+
+namespace {
+
+const int STUCK_PIXEL = 3 * SensorModel::COLUMNS + 4;
+const int NOISY_PIXEL = 12 * SensorModel::COLUMNS + 17;
+// Enough frames for the warm-up, the first check and the outlier rates that follow it.
+const int LIVE_FRAMES = 1600;
+
+bool check(bool ok, const char *what) {
+    printf("%-60s %s\n", what, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+// A flat scene with normal noise. One pixel never changes, another one often jumps far up or down.
+void live_frame(std::mt19937 &random, float *to) {
+    std::normal_distribution<float> noise(0.0f, 0.2f);
+    std::uniform_real_distribution<float> spike(0.0f, 1.0f);
+    for (int i = 0; i < SensorModel::PIXELS; i++) {
+        to[i] = 25.0f + noise(random);
+    }
+    to[STUCK_PIXEL] = 25.0f;
+    const float p = spike(random);
+    to[NOISY_PIXEL] += p < 0.2f ? 2.5f : p < 0.4f ? -2.5f : 0.0f;
+}
+
+}
+
+// Runtime defect detection on synthetic frames: stuck and noisy pixels are found without false positives, defects are
+// replaced by their neighbours, and the repeated frames of a stalled sensor are no measurements.
+int main() {
+    bool ok = true;
+    std::mt19937 random(42);
+    float to[SensorModel::PIXELS];
+
+    PixelHealth health;
+    for (int frame = 0; frame < LIVE_FRAMES; frame++) {
+        live_frame(random, to);
+        health.update(to);
+    }
+    ok &= check(health.reason(STUCK_PIXEL) == DEFECT_STUCK, "constant pixel is stuck");
+    ok &= check(health.reason(NOISY_PIXEL) == DEFECT_NOISY, "pixel with frequent spikes is noisy");
+    ok &= check(health.defects() == 2, "no other defects");
+
+    // Every column has its own temperature, so the neighbour mean of any pixel is its column.
+    for (int i = 0; i < SensorModel::PIXELS; i++) {
+        to[i] = static_cast<float>(i % SensorModel::COLUMNS);
+    }
+    to[STUCK_PIXEL] = 99.0f;
+    to[NOISY_PIXEL] = -99.0f;
+    health.correct(to);
+    ok &= check(to[STUCK_PIXEL] == static_cast<float>(STUCK_PIXEL % SensorModel::COLUMNS) &&
+                to[NOISY_PIXEL] == static_cast<float>(NOISY_PIXEL % SensorModel::COLUMNS),
+                "defects are replaced by the mean of their neighbours");
+
+    // The sensor stalls during the warm-up and its last frame is converted again and again. Those are no measurements:
+    // the stuck pixel is found only after enough live frames.
+    PixelHealth stalled;
+    for (int frame = 0; frame < 300; frame++) {
+        live_frame(random, to);
+        stalled.update(to);
+    }
+    int new_defects = 0;
+    for (int frame = 0; frame < LIVE_FRAMES; frame++) {
+        new_defects += stalled.update(to);
+    }
+    ok &= check(new_defects == 0 && stalled.defects() == 0, "repeated frames are not classified");
+    for (int frame = 0; frame < 300; frame++) {
+        live_frame(random, to);
+        stalled.update(to);
+    }
+    ok &= check(stalled.defects() == 1 && stalled.reason(STUCK_PIXEL) == DEFECT_STUCK,
+                "live frames after the stall complete the warm-up");
+
+    // The EEPROM lists end at the first entry that is not a pixel.
+    const uint16_t broken[] = {5, 0xFFFF, 6};
+    const uint16_t outliers[] = {0xFFFF, 7, 8};
+    PixelHealth listed;
+    listed.init(broken, outliers, 3, false);
+    ok &= check(listed.defects() == 1 && listed.reason(5) == DEFECT_EEPROM, "EEPROM lists are read up to the end mark");
+    for (int i = 0; i < SensorModel::PIXELS; i++) {
+        to[i] = static_cast<float>(i % SensorModel::COLUMNS);
+    }
+    to[5] = 99.0f;
+    listed.correct(to);
+    ok &= check(to[5] == 5.0f, "interleaved mode corrects from the same row");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
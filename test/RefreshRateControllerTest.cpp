@@ -0,0 +1,88 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include "RefreshRateController.h"
+
+namespace {
+
+const uint64_t SECOND = 1000000000ull;
+
+bool check(bool ok, const char *what) {
+    printf("%-60s %s\n", what, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+// Feeds frames of the given cost at the current rate for one second, and returns the rate the controller chose.
+int run_second(RefreshRateController &controller, int fps, bool is_measuring, uint64_t cpu_nanos, uint64_t bus_nanos,
+               uint64_t &now) {
+    for (int frame = 0; frame < fps; frame++) {
+        controller.on_frame(cpu_nanos, bus_nanos);
+        now += SECOND / fps;
+        fps = controller.update(fps, is_measuring, now);
+    }
+    return fps;
+}
+
+}
+
+// Rate decisions of the adaptive refresh rate on synthetic loads.
+int main() {
+    bool ok = true;
+    uint64_t now = 2 * SECOND;
+
+    // Cheap frames: while measuring, the rate doubles once per hold time up to the maximum.
+    RefreshRateController cheap(4, 32);
+    int fps = run_second(cheap, 4, true, 1000000, 500000, now);
+    ok &= check(fps == 8, "doubles while measuring");
+    fps = run_second(cheap, fps, true, 1000000, 500000, now);
+    ok &= check(fps == 16, "holds a second after every change");
+    for (int i = 0; i < 4; i++) {
+        fps = run_second(cheap, fps, true, 1000000, 500000, now);
+    }
+    ok &= check(fps == 32, "stops at the maximum");
+    for (int i = 0; i < 4; i++) {
+        fps = run_second(cheap, fps, false, 1000000, 500000, now);
+    }
+    ok &= check(fps == 4, "halves to the minimum without a person");
+
+    // 30 ms of CPU time per subpage: 16 Hz is a load of 0.48, 32 Hz would be 0.96, above the headroom.
+    RefreshRateController busy(4, 64);
+    fps = 4;
+    for (int i = 0; i < 6; i++) {
+        fps = run_second(busy, fps, true, 30000000, 500000, now);
+    }
+    ok &= check(fps == 16, "does not raise the rate beyond the CPU headroom");
+    fps = run_second(busy, fps, true, 70000000, 500000, now);
+    ok &= check(fps == 8, "lowers the rate on overload, even while measuring");
+
+    // The bus limits the rate the same way: 20 ms per transfer is a load of 0.64 at 32 Hz.
+    RefreshRateController bus(4, 64);
+    fps = 4;
+    for (int i = 0; i < 6; i++) {
+        fps = run_second(bus, fps, true, 1000000, 20000000, now);
+    }
+    ok &= check(fps == 32 && bus.bus_load(fps) < 0.7f, "does not raise the rate beyond the bus headroom");
+
+    RefreshRateController fixed(4, 32, false);
+    ok &= check(run_second(fixed, 4, true, 1000000, 500000, now) == 4, "keeps the rate when disabled");
+
+    ok &= check(RefreshRateController::rate_code(1) == 1 && RefreshRateController::rate_code(64) == 7 &&
+                RefreshRateController::rate_code(8) == 4, "control register codes of the supported rates");
+    ok &= check(RefreshRateController::rate_code(0) == 0 && RefreshRateController::rate_code(3) == 0 &&
+                RefreshRateController::rate_code(128) == 0, "no code for unsupported rates");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,145 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "SharedFrames.h"
+
+namespace {
+
+const int N_SENSORS = 2;
+const int N_SLOTS = 4;
+
+bool check(bool ok, const char *what) {
+    printf("%-60s %s\n", what, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+// Fills every field of the next frame with its number.
+SharedFrameSlot *fill(SharedFramePublisher &publisher, uint64_t n) {
+    SharedFrameSlot *slot = publisher.begin();
+    slot->frame = n;
+    for (int s = 0; s < N_SENSORS; s++) {
+        SharedSensorFrame *frame = SharedFramePublisher::sensor_frame(slot, s);
+        frame->tr = static_cast<float>(n);
+        for (uint16_t &word : frame->raw) {
+            word = static_cast<uint16_t>(n);
+        }
+        for (float &to : frame->to) {
+            to = static_cast<float>(n);
+        }
+    }
+    return slot;
+}
+
+void publish(SharedFramePublisher &publisher, uint64_t n) {
+    publisher.commit(fill(publisher, n));
+}
+
+// True when every field of a frame that was read holds the same frame number.
+bool is_consistent(const SharedFrameSlot *slot) {
+    for (int s = 0; s < N_SENSORS; s++) {
+        const SharedSensorFrame *frame = SharedFrameReader::sensor_frame(slot, s);
+        if (frame->tr != static_cast<float>(slot->frame)) {
+            return false;
+        }
+        for (uint16_t word : frame->raw) {
+            if (word != static_cast<uint16_t>(slot->frame)) {
+                return false;
+            }
+        }
+        for (float to : frame->to) {
+            if (to != static_cast<float>(slot->frame)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+}
+
+// The seqlock of the shared frame ring: frames are read in place while they are stable, reads that overlap a write of
+// the slot are rejected, and overwritten frames are not returned.
+int main() {
+    bool ok = true;
+    const std::string name = "/thermalcam-test-" + std::to_string(getpid());
+    SharedFramePublisher publisher;
+    SharedFrameReader reader;
+    if (!publisher.open(name, N_SENSORS, N_SLOTS, 0.95f, 6.0f)) {
+        fprintf(stderr, "Unable to create shared memory %s\n", name.c_str());
+        return EXIT_FAILURE;
+    }
+    publisher.calibration(1).address = 0x34;
+    ok &= check(!reader.open("/thermalcam-test-missing") && reader.open(name), "open only existing objects");
+    ok &= check(reader.is_live() && reader.layout().n_sensors == N_SENSORS && reader.layout().ta_shift == 6.0f &&
+                reader.calibration(1).address == 0x34, "layout and calibration");
+    ok &= check(reader.published() == 0 && reader.begin_read(0) == nullptr, "no frame before the first publish");
+
+    publish(publisher, 0);
+    const SharedFrameSlot *slot = reader.begin_read(0);
+    ok &= check(slot != nullptr && slot->frame == 0 && is_consistent(slot) && reader.end_read(slot, 0),
+                "read a published frame in place");
+
+    // The writer starts frame 1 + N_SLOTS in the slot of frame 1 while a reader reads it.
+    for (uint64_t n = 1; n <= N_SLOTS; n++) {
+        publish(publisher, n);
+    }
+    slot = reader.begin_read(1);
+    ok &= check(slot != nullptr, "frame 1 is still available");
+    SharedFrameSlot *writing = fill(publisher, 1 + N_SLOTS);
+    ok &= check(!reader.end_read(slot, 1), "a read during the write is torn");
+    publisher.commit(writing);
+    ok &= check(!reader.end_read(slot, 1), "a read across the whole write is lapped");
+    ok &= check(reader.begin_read(1) == nullptr && reader.begin_read(0) == nullptr, "overwritten frames are gone");
+    ok &= check(reader.begin_read(reader.published()) == nullptr, "the next frame is not there yet");
+    std::vector<uint8_t> buffer(reader.layout().slot_size);
+    const auto *copy = reinterpret_cast<const SharedFrameSlot *>(buffer.data());
+    ok &= check(reader.copy(reader.published() - 1, buffer.data()) && copy->frame == 1 + N_SLOTS &&
+                is_consistent(copy), "copy the latest frame");
+
+    // A reader that follows the ring while the writer runs as fast as it can: every accepted read is consistent.
+    std::atomic<bool> is_done(false);
+    std::thread writer([&publisher, &is_done] {
+        for (uint64_t n = 2 + N_SLOTS; n < 200000; n++) {
+            publish(publisher, n);
+        }
+        is_done = true;
+    });
+    uint64_t accepted = 0;
+    uint64_t rejected = 0;
+    uint64_t inconsistent = 0;
+    while (!is_done.load()) {
+        if (reader.copy(reader.published() - 1, buffer.data())) {
+            accepted++;
+            inconsistent += !is_consistent(copy);
+        } else {
+            rejected++;
+        }
+    }
+    writer.join();
+    printf("%llu reads accepted, %llu rejected\n", static_cast<unsigned long long>(accepted),
+           static_cast<unsigned long long>(rejected));
+    ok &= check(accepted > 0 && inconsistent == 0, "accepted reads are never torn");
+
+    publisher.close();
+    ok &= check(!reader.is_live(), "a closed object is not live");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
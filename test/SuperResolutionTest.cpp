@@ -0,0 +1,133 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "SuperResolution.h"
+#include "WorkerPool.h"
+
+namespace {
+
+const int WIDTH = 24;
+const int HEIGHT = 32;
+
+bool check(bool ok, const char *what) {
+    printf("%-60s %s\n", what, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+// Smooth scene with texture in both directions, as seen with the content moved by dx, dy sensor pixels.
+float scene(float x, float y, float dx, float dy) {
+    x += dx;
+    y += dy;
+    return 30.0f + 4.0f * sinf(0.6f * x) * cosf(0.5f * y) + 0.2f * x;
+}
+
+void render(std::vector<float> &image, float dx, float dy) {
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            image[y * WIDTH + x] = scene(static_cast<float>(x), static_cast<float>(y), dx, dy);
+        }
+    }
+}
+
+// Mean absolute difference between the super-resolved image at the sensor pixel centers and the scene.
+float center_error(const SuperResolution &sr, float dx, float dy) {
+    const int f = sr.factor();
+    float sum = 0.0f;
+    int n = 0;
+    for (int y = 2; y < HEIGHT - 2; y++) {
+        for (int x = 2; x < WIDTH - 2; x++) {
+            const float *r = sr.result() + (y * f + f / 2 - 1) * sr.out_width() + x * f + f / 2 - 1;
+            const float value = 0.25f * (r[0] + r[1] + r[sr.out_width()] + r[sr.out_width() + 1]);
+            sum += fabsf(value - scene(static_cast<float>(x), static_cast<float>(y), dx, dy));
+            n++;
+        }
+    }
+    return sum / n;
+}
+
+// Chess pattern subpages of a known scene, first at rest and then moving.
+bool test_super_resolution(WorkerPool &pool) {
+    bool ok = true;
+    SuperResolution sr;
+    sr.configure(1, WIDTH, HEIGHT);
+    ok &= check(!sr.is_enabled(), "factor 1 disables super-resolution");
+    sr.configure(2, WIDTH, HEIGHT);
+    ok &= check(sr.is_enabled() && sr.out_width() == 2 * WIDTH && sr.out_height() == 2 * HEIGHT,
+                "factor 2 doubles the resolution");
+
+    std::vector<uint8_t> sub_pages(WIDTH * HEIGHT);
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            sub_pages[y * WIDTH + x] = static_cast<uint8_t>((x + y) & 1);
+        }
+    }
+    std::vector<float> image(WIDTH * HEIGHT);
+    render(image, 0.0f, 0.0f);
+    for (int k = 0; k < 20; k++) {
+        sr.update(image.data(), sub_pages.data(), k & 1, pool);
+    }
+    ok &= check(fabsf(sr.shift_x()) < 0.05f && fabsf(sr.shift_y()) < 0.05f, "a static scene has no shift");
+    ok &= check(center_error(sr, 0.0f, 0.0f) < 0.1f, "a static scene is reproduced at the pixel centers");
+
+    // A single step of the scene, after it was accumulated at rest.
+    bool is_estimated = true;
+    for (float step : {0.4f, -0.4f}) {
+        for (int axis = 0; axis < 2; axis++) {
+            SuperResolution moved;
+            moved.configure(2, WIDTH, HEIGHT);
+            render(image, 0.0f, 0.0f);
+            for (int k = 0; k < 20; k++) {
+                moved.update(image.data(), sub_pages.data(), k & 1, pool);
+            }
+            render(image, axis == 0 ? step : 0.0f, axis == 1 ? step : 0.0f);
+            moved.update(image.data(), sub_pages.data(), 0, pool);
+            const float expected_x = axis == 0 ? step : 0.0f;
+            const float expected_y = axis == 1 ? step : 0.0f;
+            is_estimated = is_estimated && fabsf(moved.shift_x() - expected_x) < 0.1f &&
+                           fabsf(moved.shift_y() - expected_y) < 0.1f;
+        }
+    }
+    ok &= check(is_estimated, "a step of 0.4 pixels is estimated in x and y");
+
+    // A scene drifting by 0.1 pixels per subpage is followed without trails.
+    float dx = 0.0f;
+    float max_error = 0.0f;
+    for (int k = 0; k < 20; k++) {
+        dx += 0.1f;
+        render(image, dx, 0.0f);
+        sr.update(image.data(), sub_pages.data(), k & 1, pool);
+        max_error = std::max(max_error, center_error(sr, dx, 0.0f));
+    }
+    ok &= check(sr.resets() == 0 && max_error < 0.35f, "a drifting scene is followed");
+
+    render(image, dx + 3.0f, 0.0f);
+    sr.update(image.data(), sub_pages.data(), 0, pool);
+    ok &= check(sr.resets() == 1, "a jump beyond MAX_SHIFT resets the accumulation");
+    return ok;
+}
+
+}
+
+// Super-resolution of chess pattern subpages of a known scene: at rest, after a step, drifting and after a jump.
+int main() {
+    WorkerPool pool(2);
+    return test_super_resolution(pool) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,101 @@
+/*
+Copyright 2020 Gilbert François Duivesteijn
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "Upscaler.h"
+#include "WorkerPool.h"
+
+namespace {
+
+const int WIDTH = 24;
+const int HEIGHT = 32;
+
+bool check(bool ok, const char *what) {
+    printf("%-60s %s\n", what, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+// Upscales a known image by 3 with every CPU quality. The palette is the identity, so the output is the rounded value.
+bool test_upscaler(WorkerPool &pool) {
+    bool ok = true;
+    const int factor = 3;
+    std::vector<uint32_t> palette(256);
+    for (uint32_t i = 0; i < 256; i++) {
+        palette[i] = i;
+    }
+    std::vector<float> image(WIDTH * HEIGHT);
+    for (int i = 0; i < WIDTH * HEIGHT; i++) {
+        image[i] = static_cast<float>((i * 37) % 251);
+    }
+    std::vector<float> flat(WIDTH * HEIGHT, 100.0f);
+    std::vector<float> ramp(WIDTH * HEIGHT);
+    for (int i = 0; i < WIDTH * HEIGHT; i++) {
+        ramp[i] = 10.0f * (i % WIDTH);
+    }
+    std::vector<uint32_t> output(WIDTH * factor * HEIGHT * factor);
+    const int out_width = WIDTH * factor;
+    for (int q = UPSCALE_BILINEAR; q < N_UPSCALE_QUALITIES; q++) {
+        const UpscaleQuality quality = static_cast<UpscaleQuality>(q);
+        Upscaler upscaler;
+        upscaler.configure(quality, WIDTH, HEIGHT, out_width, HEIGHT * factor);
+        std::string name = upscale_quality_name(quality);
+
+        // Every third output pixel is centered on a source pixel, where the interpolating filters have weight 1.
+        upscaler.run(image.data(), 0.0f, 255.0f, palette.data(), output.data(), pool);
+        int n_wrong = 0;
+        for (int y = 0; y < HEIGHT; y++) {
+            for (int x = 0; x < WIDTH; x++) {
+                const int expected = static_cast<int>(image[y * WIDTH + x]);
+                const int actual = static_cast<int>(output[(factor * y + 1) * out_width + factor * x + 1]);
+                n_wrong += std::abs(actual - expected) > 0;
+            }
+        }
+        ok &= check(n_wrong == 0, (name + ": source pixels are kept").c_str());
+
+        upscaler.run(flat.data(), 0.0f, 255.0f, palette.data(), output.data(), pool);
+        bool is_flat = true;
+        for (uint32_t value : output) {
+            is_flat = is_flat && value == 100;
+        }
+        ok &= check(is_flat, (name + ": a flat image stays flat").c_str());
+
+        // Away from the borders, all filters reproduce a linear ramp.
+        upscaler.run(ramp.data(), 0.0f, 255.0f, palette.data(), output.data(), pool);
+        bool is_linear = true;
+        for (int x = 3 * factor; x < out_width - 3 * factor; x++) {
+            const float expected = 10.0f * ((x + 0.5f) / factor - 0.5f);
+            is_linear = is_linear && fabsf(static_cast<float>(output[5 * out_width + x]) - expected) <= 1.0f;
+        }
+        ok &= check(is_linear, (name + ": a ramp stays linear").c_str());
+
+        upscaler.run(ramp.data(), 50.0f, 100.0f, palette.data(), output.data(), pool);
+        ok &= check(output[5 * out_width] == 0 && output[6 * out_width - 1] == 255,
+                    (name + ": values outside the range are clamped").c_str());
+    }
+    return ok;
+}
+
+}
+
+// Every CPU upscale quality on known images: source pixels, a flat image, a linear ramp and clamping.
+int main() {
+    WorkerPool pool(2);
+    return test_upscaler(pool) ? EXIT_SUCCESS : EXIT_FAILURE;
+}